@@ -0,0 +1,136 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "AudioClock.h"
+
+AudioClock::AudioClock()
+{
+    m_resyncCount = 0;
+    reset(8000, 1);
+}
+
+void AudioClock::reset(int nominalRate, int channels)
+{
+    m_nominalRate = nominalRate;
+    m_channels = channels;
+
+    m_monotonic.start();
+    m_epochOffset = QDateTime::currentMSecsSinceEpoch();
+
+    m_started = false;
+    m_frames = 0;
+    m_rate = nominalRate;
+    m_driftPPM = 0;
+
+    m_phase = 1.0;
+    m_lastFrame.fill(0, channels);
+}
+
+void AudioClock::resync()
+{
+    //  keep the rate estimate - it is much more likely that we stalled than that the crystal changed
+
+    m_started = false;
+    m_resyncCount++;
+}
+
+qint64 AudioClock::blockArrived(int frames)
+{
+    qint64 now = m_monotonic.nsecsElapsed();
+    qint64 firstFrame = m_frames;
+
+    m_frames += frames;
+
+    if (!m_started) {
+        //  the end of the block has just arrived so the first frame was captured a block ago
+
+        m_baseNsecs = now - (qint64)(((double)frames * 1000000000.0) / m_rate);
+        m_baseFrames = firstFrame;
+        m_started = true;
+        return m_epochOffset + m_baseNsecs / 1000000;
+    }
+
+    qint64 span = now - m_baseNsecs;
+
+    if (span >= (qint64)AUDIOCLOCK_MIN_SPAN_MS * 1000000) {
+        double measured = ((double)(m_frames - m_baseFrames) * 1000000000.0) / (double)span;
+        double ppm = (measured / (double)m_nominalRate - 1.0) * 1000000.0;
+
+        if (qAbs(ppm) <= AUDIOCLOCK_MAX_PPM) {
+            m_rate = measured;
+            m_driftPPM = ppm;
+        }
+    }
+
+    qint64 predicted = m_baseNsecs + (qint64)(((double)(firstFrame - m_baseFrames) * 1000000000.0) / m_rate);
+    qint64 arrived = now - (qint64)(((double)frames * 1000000000.0) / m_rate);
+
+    if (qAbs(predicted - arrived) > (qint64)AUDIOCLOCK_MAX_ERROR_MS * 1000000) {
+        resync();
+        m_baseNsecs = arrived;
+        m_baseFrames = firstFrame;
+        m_started = true;
+        return m_epochOffset + arrived / 1000000;
+    }
+
+    return m_epochOffset + predicted / 1000000;
+}
+
+void AudioClock::correct(QByteArray& block)
+{
+    if (m_driftPPM == 0)
+        return;
+
+    //  input frames consumed per output frame - a fast card has to lose frames
+
+    double step = m_rate / (double)m_nominalRate;
+    const qint16 *in = (const qint16 *)block.constData();
+    int inFrames = block.length() / (m_channels * sizeof(qint16));
+
+    if (inFrames == 0)
+        return;
+
+    int outFrames = 0;
+    double pos = m_phase;
+
+    m_output.resize(((int)((double)inFrames / step) + 2) * m_channels);
+    qint16 *outPtr = m_output.data();
+
+    //  pos is relative to the last frame of the previous block so pos 1.0 is in[0]
+
+    while (pos < (double)inFrames) {
+        int index = (int)pos;
+        int frac = (int)((pos - index) * 32768.0);
+        const qint16 *a = (index == 0) ? m_lastFrame.constData() : in + (index - 1) * m_channels;
+        const qint16 *b = in + index * m_channels;
+
+        for (int c = 0; c < m_channels; c++)
+            *outPtr++ = a[c] + (((b[c] - a[c]) * frac) >> 15);
+
+        outFrames++;
+        pos += step;
+    }
+
+    m_phase = pos - (double)inFrames;
+    memcpy(m_lastFrame.data(), in + (inFrames - 1) * m_channels, m_channels * sizeof(qint16));
+
+    block.resize(outFrames * m_channels * sizeof(qint16));
+    memcpy(block.data(), m_output.constData(), block.length());
+}
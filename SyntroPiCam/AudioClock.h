@@ -0,0 +1,85 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef AUDIOCLOCK_H
+#define AUDIOCLOCK_H
+
+#include "SyntroLib.h"
+#include <qelapsedtimer.h>
+
+//  Tracks the sound card's sample clock against the system clock. Blocks are timestamped
+//  from the sample count rather than their (jittery) arrival time and, optionally, are
+//  micro-resampled so that the stream runs at exactly the nominal rate by the system clock.
+
+//  don't trust the rate estimate until it covers at least this span
+
+#define AUDIOCLOCK_MIN_SPAN_MS          5000
+
+//  if the sample derived time and the arrival time diverge by more than this, start again
+
+#define AUDIOCLOCK_MAX_ERROR_MS         250
+
+//  corrections larger than this are treated as a bad estimate rather than a real clock
+
+#define AUDIOCLOCK_MAX_PPM              1000
+
+class AudioClock
+{
+public:
+    AudioClock();
+
+    void reset(int nominalRate, int channels);
+
+    //  call on arrival of each block of frames captured frames. Returns the timestamp
+    //  (mS since epoch) of the first frame in the block
+
+    qint64 blockArrived(int frames);
+
+    //  stretches or shrinks a block of 16 bit interleaved audio by the measured drift
+
+    void correct(QByteArray& block);
+
+    double getDriftPPM() { return m_driftPPM; }
+    int getResyncCount() { return m_resyncCount; }
+
+private:
+    void resync();
+
+    int m_nominalRate;
+    int m_channels;
+
+    QElapsedTimer m_monotonic;                              // immune to wall clock steps
+    qint64 m_epochOffset;                                   // converts m_monotonic to mS since epoch
+
+    bool m_started;
+    qint64 m_baseNsecs;                                     // monotonic time of m_baseFrames
+    qint64 m_baseFrames;                                    // frame count at the start of the estimate
+    qint64 m_frames;                                        // total frames captured
+
+    double m_rate;                                          // measured frames per second
+    double m_driftPPM;
+    int m_resyncCount;
+
+    double m_phase;                                         // fractional input position for correct()
+    QVector<qint16> m_lastFrame;                            // last input frame of the previous block
+    QVector<qint16> m_output;                               // corrected block before copying back
+};
+
+#endif // AUDIOCLOCK_H
@@ -0,0 +1,363 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "AudioConverter.h"
+
+#include <math.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AUDIOCONVERTER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AUDIOCONVERTER_SSE2
+#endif
+
+//  Q15 dot product of n samples (n is a multiple of AUDIOCONVERTER_TAP_ALIGN).
+//  The filter's absolute coefficient sum is well under 2 so 32 bit accumulators can't overflow.
+
+static inline int dotProduct(const qint16 *coeffs, const qint16 *samples, int n)
+{
+#if defined(AUDIOCONVERTER_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+
+    for (int i = 0; i < n; i += 8) {
+        int16x8_t c = vld1q_s16(coeffs + i);
+        int16x8_t s = vld1q_s16(samples + i);
+        acc = vmlal_s16(acc, vget_low_s16(c), vget_low_s16(s));
+        acc = vmlal_s16(acc, vget_high_s16(c), vget_high_s16(s));
+    }
+
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+
+#elif defined(AUDIOCONVERTER_SSE2)
+    __m128i acc = _mm_setzero_si128();
+
+    for (int i = 0; i < n; i += 8)
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(coeffs + i)),
+                                                _mm_loadu_si128((const __m128i *)(samples + i))));
+
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+
+#else
+    int acc = 0;
+
+    for (int i = 0; i < n; i++)
+        acc += coeffs[i] * samples[i];
+
+    return acc;
+#endif
+}
+
+static inline qint16 saturateQ15(int acc)
+{
+    acc = (acc + (1 << 14)) >> 15;
+
+    if (acc > 32767)
+        return 32767;
+    if (acc < -32768)
+        return -32768;
+    return acc;
+}
+
+//  downmix specialisations - fixed channel counts let the compiler unroll and vectorise
+
+template <int CHANNELS> static void downmixToMono(const qint16 *in, int frames, qint16 *out)
+{
+    for (int i = 0; i < frames; i++) {
+        int sum = 0;
+
+        for (int c = 0; c < CHANNELS; c++)
+            sum += in[c];
+
+        out[i] = sum / CHANNELS;
+        in += CHANNELS;
+    }
+}
+
+template <> void downmixToMono<2>(const qint16 *in, int frames, qint16 *out)
+{
+    for (int i = 0; i < frames; i++)
+        out[i] = (in[2 * i] + in[2 * i + 1]) >> 1;
+}
+
+static void downmixToMono(const qint16 *in, int channels, int frames, qint16 *out)
+{
+    for (int i = 0; i < frames; i++) {
+        int sum = 0;
+
+        for (int c = 0; c < channels; c++)
+            sum += in[c];
+
+        out[i] = sum / channels;
+        in += channels;
+    }
+}
+
+static void deinterleave(const qint16 *in, int channel, int channels, int frames, qint16 *out)
+{
+    in += channel;
+
+    for (int i = 0; i < frames; i++) {
+        out[i] = *in;
+        in += channels;
+    }
+}
+
+static int gcd(int a, int b)
+{
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+AudioConverter::AudioConverter()
+{
+    m_active = false;
+    m_inRate = m_outRate = 0;
+    m_inChannels = m_outChannels = m_workChannels = 1;
+    m_interpolate = m_decimate = 1;
+    m_tapsPerPhase = 0;
+    m_nextTime = 0;
+    m_convertNsecs = 0;
+    m_convertFrames = 0;
+}
+
+bool AudioConverter::setFormat(int inRate, int inChannels, int outRate, int outChannels)
+{
+    m_active = false;
+
+    if ((inRate <= 0) || (outRate <= 0) || (inChannels <= 0) || (outChannels <= 0))
+        return false;
+
+    if (outChannels == 1)
+        m_workChannels = 1;
+    else if ((inChannels == 1) && (outChannels == 2))
+        m_workChannels = 1;
+    else if ((inChannels == outChannels) && (inChannels <= 2))
+        m_workChannels = inChannels;
+    else
+        return false;
+
+    m_inRate = inRate;
+    m_inChannels = inChannels;
+    m_outRate = outRate;
+    m_outChannels = outChannels;
+
+    int divisor = gcd(inRate, outRate);
+    m_interpolate = outRate / divisor;
+    m_decimate = inRate / divisor;
+
+    designFilter();
+
+    for (int c = 0; c < 2; c++)
+        m_work[c].fill(0, m_tapsPerPhase - 1);
+
+    m_nextTime = 0;
+    m_convertNsecs = 0;
+    m_convertFrames = 0;
+    m_active = (inRate != outRate) || (inChannels != outChannels);
+    return true;
+}
+
+void AudioConverter::designFilter()
+{
+    if (m_interpolate == m_decimate) {
+        m_tapsPerPhase = 1;
+        m_coeffs.clear();
+        return;
+    }
+
+    //  cutoff relative to the input rate, leaving a little room for the transition band
+
+    double cutoff = 0.45 * qMin(1.0, (double)m_interpolate / (double)m_decimate);
+    double span = qMax(1.0, (double)m_decimate / (double)m_interpolate);
+
+    m_tapsPerPhase = (int)ceil(2 * AUDIOCONVERTER_ZERO_CROSSINGS * span);
+    m_tapsPerPhase = ((m_tapsPerPhase + AUDIOCONVERTER_TAP_ALIGN - 1) / AUDIOCONVERTER_TAP_ALIGN) * AUDIOCONVERTER_TAP_ALIGN;
+
+    int length = m_tapsPerPhase * m_interpolate;
+    double centre = (double)(length - 1) / 2.0;
+    QVector<double> prototype(length);
+
+    //  Blackman windowed sinc at the upsampled rate
+
+    for (int i = 0; i < length; i++) {
+        double x = ((double)i - centre) / (double)m_interpolate;
+        double sinc = (x == 0) ? 1.0 : sin(M_PI * 2 * cutoff * x) / (M_PI * 2 * cutoff * x);
+        double window = 0.42 - 0.5 * cos(2 * M_PI * i / (length - 1)) + 0.08 * cos(4 * M_PI * i / (length - 1));
+        prototype[i] = sinc * window;
+    }
+
+    //  split into phases, normalise each to unity DC gain and store reversed so
+    //  the taps line up with ascending sample addresses
+
+    m_coeffs.resize(length);
+
+    for (int phase = 0; phase < m_interpolate; phase++) {
+        double sum = 0;
+
+        for (int k = 0; k < m_tapsPerPhase; k++)
+            sum += prototype[phase + k * m_interpolate];
+
+        for (int k = 0; k < m_tapsPerPhase; k++)
+            m_coeffs[phase * m_tapsPerPhase + (m_tapsPerPhase - 1 - k)] =
+                    (qint16)floor(32767.0 * prototype[phase + k * m_interpolate] / sum + 0.5);
+    }
+}
+
+int AudioConverter::maxOutputFrames(int inFrames)
+{
+    return (int)(((qint64)inFrames * m_interpolate) / m_decimate) + 1;
+}
+
+double AudioConverter::getConvertCost()
+{
+    double cost = 0;
+
+    if (m_convertFrames > 0)
+        cost = ((double)m_convertNsecs / 1000.0) / ((double)m_convertFrames / (double)m_outRate);
+
+    m_convertNsecs = 0;
+    m_convertFrames = 0;
+    return cost;
+}
+
+void AudioConverter::downmix(const qint16 *in, int inFrames)
+{
+    int history = m_tapsPerPhase - 1;
+
+    for (int c = 0; c < m_workChannels; c++)
+        m_work[c].resize(history + inFrames);
+
+    if (m_workChannels == 1) {
+        qint16 *out = m_work[0].data() + history;
+
+        switch (m_inChannels) {
+        case 1:
+            memcpy(out, in, inFrames * sizeof(qint16));
+            break;
+
+        case 2:
+            downmixToMono<2>(in, inFrames, out);
+            break;
+
+        case 4:
+            downmixToMono<4>(in, inFrames, out);
+            break;
+
+        default:
+            downmixToMono(in, m_inChannels, inFrames, out);
+            break;
+        }
+    } else {
+        for (int c = 0; c < m_workChannels; c++)
+            deinterleave(in, c, m_inChannels, inFrames, m_work[c].data() + history);
+    }
+}
+
+int AudioConverter::resampleDecimate(int channel, int inFrames, qint16 *out)
+{
+    //  integer decimation (L == 1) - only one phase and the step is a whole number of samples
+
+    const qint16 *samples = m_work[channel].constData();
+    const qint16 *coeffs = m_coeffs.constData();
+    int pos = (int)m_nextTime;
+    int count = 0;
+
+    while (pos < inFrames) {
+        out[count * m_outChannels] = saturateQ15(dotProduct(coeffs, samples + pos, m_tapsPerPhase));
+        pos += m_decimate;
+        count++;
+    }
+
+    return count;
+}
+
+int AudioConverter::resample(int channel, int inFrames, qint16 *out)
+{
+    if (m_interpolate == m_decimate) {
+        //  channel conversion only
+
+        const qint16 *samples = m_work[channel].constData();
+
+        for (int i = 0; i < inFrames; i++)
+            out[i * m_outChannels] = samples[i];
+        return inFrames;
+    }
+
+    if (m_interpolate == 1)
+        return resampleDecimate(channel, inFrames, out);
+
+    const qint16 *samples = m_work[channel].constData();
+    qint64 time = m_nextTime;
+    qint64 end = (qint64)inFrames * m_interpolate;
+    int count = 0;
+
+    while (time < end) {
+        int base = (int)(time / m_interpolate);
+        int phase = (int)(time % m_interpolate);
+
+        out[count * m_outChannels] = saturateQ15(dotProduct(m_coeffs.constData() + phase * m_tapsPerPhase,
+                                                            samples + base, m_tapsPerPhase));
+        time += m_decimate;
+        count++;
+    }
+
+    return count;
+}
+
+int AudioConverter::process(const qint16 *in, int inFrames, qint16 *out)
+{
+    int outFrames = 0;
+    int history = m_tapsPerPhase - 1;
+
+    m_convertTimer.start();
+
+    downmix(in, inFrames);
+
+    for (int c = 0; c < m_workChannels; c++)
+        outFrames = resample(c, inFrames, out + c);
+
+    //  mono to stereo just duplicates the resampled channel
+
+    if ((m_workChannels == 1) && (m_outChannels == 2)) {
+        for (int i = 0; i < outFrames; i++)
+            out[2 * i + 1] = out[2 * i];
+    }
+
+    //  advance time and keep the tail as history for the next block
+
+    m_nextTime += (qint64)outFrames * m_decimate - (qint64)inFrames * m_interpolate;
+
+    for (int c = 0; c < m_workChannels; c++)
+        memmove(m_work[c].data(), m_work[c].constData() + inFrames, history * sizeof(qint16));
+
+    m_convertNsecs += m_convertTimer.nsecsElapsed();
+    m_convertFrames += outFrames;
+
+    return outFrames;
+}
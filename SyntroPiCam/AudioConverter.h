@@ -0,0 +1,92 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef AUDIOCONVERTER_H
+#define AUDIOCONVERTER_H
+
+#include "SyntroLib.h"
+#include <qelapsedtimer.h>
+
+//  Converts captured audio from the device's native format to the stream format.
+//  Channels are downmixed first (any count to mono, or mono to stereo) and then a
+//  polyphase FIR performs the rational rate change. Samples are 16 bit interleaved.
+
+//  filter length in input zero crossings either side of the centre tap
+
+#define AUDIOCONVERTER_ZERO_CROSSINGS   8
+
+//  taps per phase are padded to a multiple of this so the SIMD dot product has no tail
+
+#define AUDIOCONVERTER_TAP_ALIGN        8
+
+class AudioConverter
+{
+public:
+    AudioConverter();
+
+    //  returns false if the conversion isn't supported
+
+    bool setFormat(int inRate, int inChannels, int outRate, int outChannels);
+
+    //  true if the input and output formats differ
+
+    bool isActive() { return m_active; }
+
+    //  max output frames that can be produced from inFrames input frames
+
+    int maxOutputFrames(int inFrames);
+
+    //  converts inFrames frames from in to out and returns the number of output frames
+
+    int process(const qint16 *in, int inFrames, qint16 *out);
+
+    //  returns the uS of CPU used per second of output audio since the last call
+
+    double getConvertCost();
+
+private:
+    void designFilter();
+    void downmix(const qint16 *in, int inFrames);
+    int resample(int channel, int inFrames, qint16 *out);
+    int resampleDecimate(int channel, int inFrames, qint16 *out);
+
+    bool m_active;
+
+    int m_inRate;
+    int m_inChannels;
+    int m_outRate;
+    int m_outChannels;
+    int m_workChannels;                                     // channels actually resampled
+
+    int m_interpolate;                                      // L - upsampling factor
+    int m_decimate;                                         // M - downsampling factor
+
+    int m_tapsPerPhase;
+    QVector<qint16> m_coeffs;                               // m_interpolate phases of m_tapsPerPhase taps, reversed
+
+    QVector<qint16> m_work[2];                              // history followed by current block, per work channel
+    qint64 m_nextTime;                                      // next output time in units of 1/L input samples
+
+    QElapsedTimer m_convertTimer;
+    qint64 m_convertNsecs;
+    qint64 m_convertFrames;
+};
+
+#endif // AUDIOCONVERTER_H
@@ -25,6 +25,8 @@
 #include <qfile.h>
 #include <qgroupbox.h>
 #include "AudioDriver.h"
+#include "AudioEncoder.h"
+#include "AudioSource.h"
 
 AudioDlg::AudioDlg(QWidget *parent)
     : QDialog(parent, Qt::WindowCloseButtonHint | Qt::WindowTitleHint)
@@ -37,6 +39,23 @@ AudioDlg::AudioDlg(QWidget *parent)
 	m_rateMap[0] = 8000;
     m_rateMap[1] = 48000;
 
+    //  0 means capture in the stream format
+
+    m_captureChannelMap[0] = 0;
+    m_captureChannelMap[1] = 1;
+    m_captureChannelMap[2] = 2;
+
+    m_captureRateMap[0] = 0;
+    m_captureRateMap[1] = 16000;
+    m_captureRateMap[2] = 44100;
+    m_captureRateMap[3] = 48000;
+
+    m_blockDurationMap[0] = 10;
+    m_blockDurationMap[1] = 20;
+    m_blockDurationMap[2] = 40;
+    m_blockDurationMap[3] = 50;
+    m_blockDurationMap[4] = 100;
+
 	layoutWindow();
 
 	connect(m_buttons, SIGNAL(accepted()), this, SLOT(onOk()));
@@ -57,6 +76,26 @@ void AudioDlg::onOk()
 		changed = true;
 	}
 
+    if (m_sourceType->currentIndex() != settings->value(AUDIO_SOURCE).toInt()) {
+        settings->setValue(AUDIO_SOURCE, m_sourceType->currentIndex());
+        changed = true;
+    }
+
+    if (m_sourcePath->text() != settings->value(AUDIO_SOURCE_PATH).toString()) {
+        settings->setValue(AUDIO_SOURCE_PATH, m_sourcePath->text());
+        changed = true;
+    }
+
+    if (m_sourceToneFreq->text() != settings->value(AUDIO_SOURCE_TONEFREQ).toString()) {
+        settings->setValue(AUDIO_SOURCE_TONEFREQ, m_sourceToneFreq->text());
+        changed = true;
+    }
+
+    if ((m_sourceRealtime->checkState() == Qt::Checked) != settings->value(AUDIO_SOURCE_REALTIME).toBool()) {
+        settings->setValue(AUDIO_SOURCE_REALTIME, m_sourceRealtime->checkState() == Qt::Checked);
+        changed = true;
+    }
+
     if (m_inputCard->text() != settings->value(AUDIO_INPUT_CARD).toString()) {
         settings->setValue(AUDIO_INPUT_CARD, m_inputCard->text());
         changed = true;
@@ -81,6 +120,42 @@ void AudioDlg::onOk()
 		}
 	}
 
+    if (m_captureChannels->currentIndex() != -1) {
+        if (m_captureChannelMap[m_captureChannels->currentIndex()] != settings->value(AUDIO_CAPTURE_CHANNELS).toInt()) {
+            settings->setValue(AUDIO_CAPTURE_CHANNELS, m_captureChannelMap[m_captureChannels->currentIndex()]);
+            changed = true;
+        }
+    }
+
+    if (m_captureSampleRate->currentIndex() != -1) {
+        if (m_captureRateMap[m_captureSampleRate->currentIndex()] != settings->value(AUDIO_CAPTURE_SAMPLERATE).toInt()) {
+            settings->setValue(AUDIO_CAPTURE_SAMPLERATE, m_captureRateMap[m_captureSampleRate->currentIndex()]);
+            changed = true;
+        }
+    }
+
+    if (m_blockDuration->currentIndex() != -1) {
+        if (m_blockDurationMap[m_blockDuration->currentIndex()] != settings->value(AUDIO_BLOCKDURATION).toInt()) {
+            settings->setValue(AUDIO_BLOCKDURATION, m_blockDurationMap[m_blockDuration->currentIndex()]);
+            changed = true;
+        }
+    }
+
+    if (m_codec->currentIndex() != settings->value(AUDIO_CODEC, AUDIO_CODEC_PCM).toInt()) {
+        settings->setValue(AUDIO_CODEC, m_codec->currentIndex());
+        changed = true;
+    }
+
+    if ((m_mmap->checkState() == Qt::Checked) != settings->value(AUDIO_MMAP).toBool()) {
+        settings->setValue(AUDIO_MMAP, m_mmap->checkState() == Qt::Checked);
+        changed = true;
+    }
+
+    if ((m_driftResample->checkState() == Qt::Checked) != settings->value(AUDIO_DRIFT_RESAMPLE).toBool()) {
+        settings->setValue(AUDIO_DRIFT_RESAMPLE, m_driftResample->checkState() == Qt::Checked);
+        changed = true;
+    }
+
 	settings->endGroup();
 
 	delete settings;
@@ -143,6 +218,15 @@ void AudioDlg::layoutWindow()
 
     formLayout = new QFormLayout;
 
+    m_sourceType = new QComboBox;
+    m_sourceType->setMinimumWidth(160);
+
+    for (int i = 0; i < AUDIO_SOURCE_COUNT; i++)
+        m_sourceType->addItem(AudioSource::sourceName(i));
+
+    m_sourceType->setCurrentIndex(settings->value(AUDIO_SOURCE, AUDIO_SOURCE_ALSA).toInt());
+    formLayout->addRow(tr("Source type"), m_sourceType);
+
     getDeviceList();
 
     m_audioSource = new QComboBox;
@@ -165,6 +249,21 @@ void AudioDlg::layoutWindow()
 
     selectCurrentDevice(settings);
 
+    m_sourcePath = new QLineEdit;
+    m_sourcePath->setMinimumWidth(200);
+    m_sourcePath->setText(settings->value(AUDIO_SOURCE_PATH).toString());
+    formLayout->addRow(tr("File (.wav or raw)"), m_sourcePath);
+
+    m_sourceToneFreq = new QLineEdit;
+    m_sourceToneFreq->setMaximumWidth(60);
+    m_sourceToneFreq->setText(settings->value(AUDIO_SOURCE_TONEFREQ).toString());
+    m_sourceToneFreq->setValidator(new QIntValidator(20, 20000));
+    formLayout->addRow(tr("Tone frequency (Hz)"), m_sourceToneFreq);
+
+    m_sourceRealtime = new QCheckBox;
+    m_sourceRealtime->setCheckState(settings->value(AUDIO_SOURCE_REALTIME).toBool() ? Qt::Checked : Qt::Unchecked);
+    formLayout->addRow(tr("Pace in real time"), m_sourceRealtime);
+
     QGroupBox *group = new QGroupBox("Source");
     group->setLayout(formLayout);
     centralLayout->addWidget(group);
@@ -195,6 +294,59 @@ void AudioDlg::layoutWindow()
 
     formLayout->addRow(tr("Sample rate (sps)"), m_sampleRate);
 
+    m_captureChannels = new QComboBox(this);
+    m_captureChannels->setMaximumWidth(80);
+
+    for (int i = 0; i < 3; i++) {
+        m_captureChannels->addItem(m_captureChannelMap[i] == 0 ? QString("Same") : QString::number(m_captureChannelMap[i]));
+
+        if (m_captureChannelMap[i] == settings->value(AUDIO_CAPTURE_CHANNELS).toInt())
+            m_captureChannels->setCurrentIndex(i);
+    }
+
+    formLayout->addRow(tr("Capture channels"), m_captureChannels);
+
+    m_captureSampleRate = new QComboBox(this);
+    m_captureSampleRate->setMaximumWidth(80);
+
+    for (int i = 0; i < 4; i++) {
+        m_captureSampleRate->addItem(m_captureRateMap[i] == 0 ? QString("Same") : QString::number(m_captureRateMap[i]));
+
+        if (m_captureRateMap[i] == settings->value(AUDIO_CAPTURE_SAMPLERATE).toInt())
+            m_captureSampleRate->setCurrentIndex(i);
+    }
+
+    formLayout->addRow(tr("Capture rate (sps)"), m_captureSampleRate);
+
+    m_blockDuration = new QComboBox(this);
+    m_blockDuration->setMaximumWidth(80);
+
+    for (int i = 0; i < 5; i++) {
+        m_blockDuration->addItem(QString::number(m_blockDurationMap[i]));
+
+        if (m_blockDurationMap[i] == settings->value(AUDIO_BLOCKDURATION).toInt())
+            m_blockDuration->setCurrentIndex(i);
+    }
+
+    formLayout->addRow(tr("Block duration (mS)"), m_blockDuration);
+
+    m_codec = new QComboBox(this);
+    m_codec->setMaximumWidth(100);
+
+    for (int i = 0; i < AUDIO_CODEC_COUNT; i++)
+        m_codec->addItem(AudioEncoder::codecName(i));
+
+    m_codec->setCurrentIndex(settings->value(AUDIO_CODEC, AUDIO_CODEC_PCM).toInt());
+    formLayout->addRow(tr("Codec"), m_codec);
+
+    m_mmap = new QCheckBox(this);
+    formLayout->addRow(tr("Memory mapped capture"), m_mmap);
+    m_mmap->setCheckState(settings->value(AUDIO_MMAP).toBool() ? Qt::Checked : Qt::Unchecked);
+
+    m_driftResample = new QCheckBox(this);
+    formLayout->addRow(tr("Lock to system clock"), m_driftResample);
+    m_driftResample->setCheckState(settings->value(AUDIO_DRIFT_RESAMPLE).toBool() ? Qt::Checked : Qt::Unchecked);
+
     group = new QGroupBox("Parameters");
     group->setLayout(formLayout);
     centralLayout->addWidget(group);
@@ -56,15 +56,28 @@ private:
     QStringList m_deviceList;
 
     QCheckBox *m_enable;
+    QComboBox *m_sourceType;
+    QLineEdit *m_sourcePath;
+    QLineEdit *m_sourceToneFreq;
+    QCheckBox *m_sourceRealtime;
     QComboBox *m_audioSource;
     QLabel *m_inputDevice;
     QLabel *m_inputCard;
     QComboBox *m_channels;
 	QComboBox *m_sampleRate;
+    QComboBox *m_captureChannels;
+    QComboBox *m_captureSampleRate;
+    QComboBox *m_blockDuration;
+    QComboBox *m_codec;
+    QCheckBox *m_mmap;
+    QCheckBox *m_driftResample;
 	QDialogButtonBox *m_buttons;
 
 	int m_channelMap[2];
     int m_rateMap[2];
+    int m_captureChannelMap[3];
+    int m_captureRateMap[4];
+    int m_blockDurationMap[5];
 };
 
 #endif // AUDIODLG_H
@@ -23,6 +23,8 @@
 #include "CamClient.h"
 #include "SyntroPiCam.h"
 
+#include <qsocketnotifier.h>
+
 #define STATE_DISCONNECTED  0
 #define STATE_DETECTED      1
 #define STATE_CAPTURING     2
@@ -31,15 +33,50 @@
 #define DISCONNECT_MIN_TICKS    4
 #define DETECT_MIN_TICKS        10
 #define CONNECT_MIN_TICKS       6
-#define TIMER_INTERVAL          10
 
 
 AudioDriver::AudioDriver() : SyntroThread("AudioDriver", PRODUCT_TYPE)
 {
-    m_buffer = NULL;
     m_handle = NULL;
     m_params = NULL;
+    m_pollFds = NULL;
+    m_pollFdCount = 0;
+    m_bufferFrames = 0;
+    m_fillIndex = -1;
+    m_poolNext = 0;
+    m_mmapActive = false;
     m_timer = -1;
+    m_xrunCount = 0;
+    m_source = NULL;
+    m_sourceTimer = -1;
+}
+
+int AudioDriver::getXrunCount()
+{
+    QMutexLocker lock(&m_xrunLock);
+
+    return m_xrunCount;
+}
+
+double AudioDriver::getConvertCost()
+{
+    QMutexLocker lock(&m_convertLock);
+
+    return m_converter.getConvertCost();
+}
+
+double AudioDriver::getClockDrift()
+{
+    QMutexLocker lock(&m_clockLock);
+
+    return m_clock.getDriftPPM();
+}
+
+int AudioDriver::getClockResyncs()
+{
+    QMutexLocker lock(&m_clockLock);
+
+    return m_clock.getResyncCount();
 }
 
 void AudioDriver::newAudioSrc()
@@ -65,19 +102,34 @@ void AudioDriver::startCapture()
     if (!m_enabled)
         return;
 
+    if (m_sourceType != AUDIO_SOURCE_ALSA) {
+        if (startSource()) {
+            m_state = STATE_CAPTURING;
+            emit audioState(QString("%1 %2/%3/%4").arg(m_source->description())
+                    .arg(m_audioChannels).arg(AUDIO_FIXED_SIZE).arg(m_audioSampleRate));
+        } else {
+            m_state = STATE_DISCONNECTED;
+            emit audioState("Disconnected");
+        }
+        return;
+    }
+
     // optimize the typical case on startup
-    if (deviceExists() && openDevice()) {
+    if (deviceExists() && openDevice() && startPolling()) {
         m_state = STATE_CAPTURING;
         emit audioState(QString("%1/%2/%3").arg(m_audioChannels).arg(AUDIO_FIXED_SIZE).arg(m_audioSampleRate));
         m_ticks = CONNECT_MIN_TICKS;
     } 
     else {
+        closeDevice();
         m_state = STATE_DISCONNECTED;
         m_ticks = 0;
         emit audioState("Disconnected");
     }
 
-    m_timer = startTimer(TIMER_INTERVAL);
+    //  the timer only drives hot-plug detection - capture is driven by the ALSA poll descriptors
+
+    m_timer = startTimer(TICK_DURATION_MS);
 }
 
 void AudioDriver::stopCapture()
@@ -87,9 +139,78 @@ void AudioDriver::stopCapture()
 
     m_timer = -1;
 
+    if (m_sourceTimer != -1)
+        killTimer(m_sourceTimer);
+
+    m_sourceTimer = -1;
+
+    if (m_source != NULL) {
+        delete m_source;
+        m_source = NULL;
+    }
+
     closeDevice();
 }
 
+bool AudioDriver::startSource()
+{
+    m_source = AudioSource::createSource(m_sourceType, m_sourcePath, m_sourceToneFrequency);
+
+    if (m_source == NULL) {
+        appLogError(QString("Unknown audio source type %1").arg(m_sourceType));
+        return false;
+    }
+
+    //  a WAV file dictates its own format - the converter takes it to the stream format
+
+    if (!m_source->open(m_captureSampleRate, m_captureChannels) || !setupConversion()) {
+        delete m_source;
+        m_source = NULL;
+        return false;
+    }
+
+    m_bufferFrames = 0;
+    m_sourceFrames = 0;
+    m_sourceStartTime = QDateTime::currentMSecsSinceEpoch();
+    m_sourceElapsed.start();
+
+    //  real time sources tick at twice the block rate and catch up on late ticks
+
+    m_sourceTimer = startTimer(m_sourceRealtime ? qMax(1, m_audioBlockDuration / 2) : 0);
+    return true;
+}
+
+void AudioDriver::sourceTick()
+{
+    int blocks = 1;
+
+    if (m_sourceRealtime) {
+        qint64 due = (m_sourceElapsed.nsecsElapsed() / 1000) * m_captureSampleRate / 1000000;
+
+        blocks = (due - m_sourceFrames) / m_audioFramesPerBlock;
+
+        //  don't flood CamClient after a long stall - just slip
+
+        if (blocks > AUDIO_BLOCK_POOL_SIZE) {
+            m_sourceFrames += (qint64)(blocks - AUDIO_BLOCK_POOL_SIZE) * m_audioFramesPerBlock;
+            blocks = AUDIO_BLOCK_POOL_SIZE;
+        }
+    }
+
+    for (int i = 0; i < blocks; i++) {
+        if (m_source->read(captureBlock(), m_audioFramesPerBlock) != m_audioFramesPerBlock) {
+            appLogError(QString("Read from audio source %1 failed").arg(m_source->description()));
+            stopCapture();
+            m_state = STATE_DISCONNECTED;
+            emit audioState("Disconnected");
+            return;
+        }
+
+        m_bufferFrames = m_audioFramesPerBlock;
+        blockComplete();
+    }
+}
+
 bool AudioDriver::loadSettings()
 {
     QSettings *settings = SyntroUtils::getSettings();
@@ -105,26 +226,69 @@ bool AudioDriver::loadSettings()
     if (!settings->contains(AUDIO_ENABLE))
         settings->setValue(AUDIO_ENABLE, false);
 
+    if (!settings->contains(AUDIO_SOURCE))
+        settings->setValue(AUDIO_SOURCE, AUDIO_SOURCE_ALSA);
+
+    if (!settings->contains(AUDIO_SOURCE_PATH))
+        settings->setValue(AUDIO_SOURCE_PATH, "");
+
+    if (!settings->contains(AUDIO_SOURCE_TONEFREQ))
+        settings->setValue(AUDIO_SOURCE_TONEFREQ, 1000);
+
+    if (!settings->contains(AUDIO_SOURCE_REALTIME))
+        settings->setValue(AUDIO_SOURCE_REALTIME, true);
+
     if (!settings->contains(AUDIO_CHANNELS))
         settings->setValue(AUDIO_CHANNELS, 2);
 
     if (!settings->contains(AUDIO_SAMPLERATE))
         settings->setValue(AUDIO_SAMPLERATE, 8000);
 
+    if (!settings->contains(AUDIO_CAPTURE_CHANNELS))
+        settings->setValue(AUDIO_CAPTURE_CHANNELS, 0);
+
+    if (!settings->contains(AUDIO_CAPTURE_SAMPLERATE))
+        settings->setValue(AUDIO_CAPTURE_SAMPLERATE, 0);
+
+    if (!settings->contains(AUDIO_DRIFT_RESAMPLE))
+        settings->setValue(AUDIO_DRIFT_RESAMPLE, false);
+
+    if (!settings->contains(AUDIO_BLOCKDURATION))
+        settings->setValue(AUDIO_BLOCKDURATION, AUDIO_BLOCKDURATION_DEFAULT);
+
+    if (!settings->contains(AUDIO_MMAP))
+        settings->setValue(AUDIO_MMAP, false);
+
     m_audioDevice = settings->value(AUDIO_INPUT_DEVICE).toInt();
     m_audioCard = settings->value(AUDIO_INPUT_CARD).toInt();
     m_enabled = settings->value(AUDIO_ENABLE).toBool();
 
+    m_sourceType = settings->value(AUDIO_SOURCE).toInt();
+    m_sourcePath = settings->value(AUDIO_SOURCE_PATH).toString();
+    m_sourceToneFrequency = settings->value(AUDIO_SOURCE_TONEFREQ).toInt();
+    m_sourceRealtime = settings->value(AUDIO_SOURCE_REALTIME).toBool();
+
     m_audioChannels = settings->value(AUDIO_CHANNELS).toInt();
     m_audioSampleRate = settings->value(AUDIO_SAMPLERATE).toInt();
+    m_captureChannels = settings->value(AUDIO_CAPTURE_CHANNELS).toInt();
+    m_captureSampleRate = settings->value(AUDIO_CAPTURE_SAMPLERATE).toInt();
+    m_audioBlockDuration = settings->value(AUDIO_BLOCKDURATION).toInt();
+    m_mmapRequested = settings->value(AUDIO_MMAP).toBool();
+    m_driftResample = settings->value(AUDIO_DRIFT_RESAMPLE).toBool();
 
-    emit audioFormat(m_audioSampleRate, m_audioChannels, AUDIO_FIXED_SIZE);
+    if (m_audioBlockDuration < AUDIO_BLOCKDURATION_MIN)
+        m_audioBlockDuration = AUDIO_BLOCKDURATION_MIN;
+    if (m_audioBlockDuration > AUDIO_BLOCKDURATION_MAX)
+        m_audioBlockDuration = AUDIO_BLOCKDURATION_MAX;
 
-    //  Make blocks last 100mS
+    if (m_captureChannels <= 0)
+        m_captureChannels = m_audioChannels;
+    if (m_captureSampleRate <= 0)
+        m_captureSampleRate = m_audioSampleRate;
 
-    m_audioFramesPerBlock = m_audioSampleRate / 10;
+    //  block sizes depend on the rate the device actually gives us - see setupConversion()
 
-    m_bytesPerBlock = m_audioChannels * (AUDIO_FIXED_SIZE / 8) * m_audioFramesPerBlock;
+    emit audioFormat(m_audioSampleRate, m_audioChannels, AUDIO_FIXED_SIZE);
 
     settings->endGroup();
 
@@ -133,9 +297,12 @@ bool AudioDriver::loadSettings()
     return true;
 }
 
-void AudioDriver::timerEvent(QTimerEvent *)
+void AudioDriver::timerEvent(QTimerEvent *event)
 {
-    int rc;
+    if (event->timerId() == m_sourceTimer) {
+        sourceTick();
+        return;
+    }
 
     switch (m_state) {
     case STATE_DISCONNECTED:
@@ -146,39 +313,312 @@ void AudioDriver::timerEvent(QTimerEvent *)
                 m_ticks = 0;
             }
         }
-
-        msleep(TICK_DURATION_MS);
         break;
 
     case STATE_DETECTED:
         if (++m_ticks > DETECT_MIN_TICKS) {
-            if (openDevice()) {
+            if (openDevice() && startPolling()) {
                 m_state = STATE_CAPTURING;
                 emit audioState(QString("%1/%2/%3").arg(m_audioChannels).arg(AUDIO_FIXED_SIZE).arg(m_audioSampleRate));
                 m_ticks = 0;
+            } else {
+                closeDevice();
             }
         }
-
-        msleep(TICK_DURATION_MS);
         break;
 
     case STATE_CAPTURING:
-        if ((rc = snd_pcm_readi(m_handle, m_buffer, m_audioFramesPerBlock)) != m_audioFramesPerBlock) {
-            appLogError(QString("Read from audio interface failed: %1").arg(snd_strerror(rc)));
-            closeDevice();
-            m_state = STATE_DISCONNECTED;
-            m_ticks = 0;
-            emit audioState("Disconnected");
-            msleep(TICK_DURATION_MS);
+        break;
+    }
+}
+
+void AudioDriver::audioReady()
+{
+    unsigned short revents;
+
+    if (m_state != STATE_CAPTURING || m_handle == NULL)
+        return;
+
+    //  the notifiers only say that something happened - collect the real events and let ALSA demangle them
+
+    if (poll(m_pollFds, m_pollFdCount, 0) < 0)
+        return;
+
+    if (snd_pcm_poll_descriptors_revents(m_handle, m_pollFds, m_pollFdCount, &revents) < 0)
+        return;
+
+    if (revents & POLLERR) {
+        switch (snd_pcm_state(m_handle)) {
+        case SND_PCM_STATE_XRUN:
+            if (!recoverCapture(-EPIPE))
+                return;
+            break;
+
+        case SND_PCM_STATE_SUSPENDED:
+            if (!recoverCapture(-ESTRPIPE))
+                return;
+            break;
+
+        default:
+            deviceLost(-ENODEV);
+            return;
         }
-        else {
-            emit newAudio(QByteArray((const char *)m_buffer, m_bytesPerBlock));
+    }
+
+    if (revents & POLLIN) {
+        if (m_mmapActive)
+            readAvailableMmap();
+        else
+            readAvailable();
+    }
+}
+
+char *AudioDriver::fillBlock()
+{
+    if (m_fillIndex != -1)
+        return m_blockPool[m_fillIndex].data();
+
+    //  a block is free once CamClient has dropped all its references to it
+
+    for (int i = 0; i < m_blockPool.count(); i++) {
+        if (m_blockPool[i].isDetached()) {
+            m_fillIndex = i;
+
+            //  converted blocks are trimmed to the frames produced - this doesn't reallocate
+
+            m_blockPool[i].resize(m_bytesPerBlock);
+            return m_blockPool[i].data();
         }
+    }
 
-        break;
+    if (m_blockPool.count() < AUDIO_BLOCK_POOL_SIZE) {
+        m_blockPool.append(QByteArray(m_bytesPerBlock, 0));
+        m_fillIndex = m_blockPool.count() - 1;
+    } else {
+        //  consumer is holding on to everything - replace one and let the old one go when CamClient is done
+
+        m_fillIndex = m_poolNext;
+        m_blockPool[m_fillIndex] = QByteArray(m_bytesPerBlock, 0);
+        m_poolNext = (m_poolNext + 1) % AUDIO_BLOCK_POOL_SIZE;
+    }
+
+    return m_blockPool[m_fillIndex].data();
+}
+
+char *AudioDriver::captureBlock()
+{
+    if (m_converter.isActive())
+        return m_captureBuffer.data();
+
+    return fillBlock();
+}
+
+void AudioDriver::blockComplete()
+{
+    qint64 timestamp;
+
+    if (m_source != NULL) {
+        //  stand-in sources are their own clock
+
+        timestamp = m_sourceStartTime + (m_sourceFrames * 1000) / m_captureSampleRate;
+        m_sourceFrames += m_audioFramesPerBlock;
+    } else {
+        m_clockLock.lock();
+        timestamp = m_clock.blockArrived(m_audioFramesPerBlock);
+        m_clockLock.unlock();
+    }
+
+    if (m_converter.isActive()) {
+        char *block = fillBlock();
+        int frames;
+
+        m_convertLock.lock();
+        frames = m_converter.process((const qint16 *)m_captureBuffer.constData(), m_audioFramesPerBlock, (qint16 *)block);
+        m_convertLock.unlock();
+
+        m_blockPool[m_fillIndex].resize(frames * m_audioChannels * (AUDIO_FIXED_SIZE / 8));
+    }
+
+    if (m_driftResample) {
+        m_clockLock.lock();
+        m_clock.correct(m_blockPool[m_fillIndex]);
+        m_clockLock.unlock();
+    }
+
+    emit newAudio(m_blockPool[m_fillIndex], timestamp);
+    m_fillIndex = -1;
+    m_bufferFrames = 0;
+}
+
+void AudioDriver::readAvailable()
+{
+    snd_pcm_sframes_t rc;
+
+    while (m_handle != NULL) {
+        rc = snd_pcm_readi(m_handle, captureBlock() + m_bufferFrames * m_bytesPerFrame,
+                           m_audioFramesPerBlock - m_bufferFrames);
+
+        if (rc == -EAGAIN)
+            break;
+
+        if (rc < 0) {
+            if (!recoverCapture(rc))
+                return;
+            continue;
+        }
+
+        m_bufferFrames += rc;
+
+        if (m_bufferFrames == m_audioFramesPerBlock)
+            blockComplete();
     }
 }
 
+void AudioDriver::readAvailableMmap()
+{
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames;
+    snd_pcm_sframes_t avail;
+    snd_pcm_sframes_t committed;
+    int rc;
+
+    while (m_handle != NULL) {
+        if ((avail = snd_pcm_avail_update(m_handle)) < 0) {
+            if (!recoverCapture(avail))
+                return;
+            continue;
+        }
+
+        if (avail == 0)
+            break;
+
+        frames = qMin((snd_pcm_uframes_t)avail, (snd_pcm_uframes_t)(m_audioFramesPerBlock - m_bufferFrames));
+
+        if ((rc = snd_pcm_mmap_begin(m_handle, &areas, &offset, &frames)) < 0) {
+            if (!recoverCapture(rc))
+                return;
+            continue;
+        }
+
+        //  interleaved so all channels live in area 0 - this is the only copy between the ring and CamClient
+
+        const char *src = (const char *)areas[0].addr + areas[0].first / 8 + offset * (areas[0].step / 8);
+        memcpy(captureBlock() + m_bufferFrames * m_bytesPerFrame, src, frames * m_bytesPerFrame);
+
+        committed = snd_pcm_mmap_commit(m_handle, offset, frames);
+
+        if ((committed < 0) || ((snd_pcm_uframes_t)committed != frames)) {
+            if (!recoverCapture(committed >= 0 ? -EPIPE : committed))
+                return;
+            continue;
+        }
+
+        m_bufferFrames += frames;
+
+        if (m_bufferFrames == m_audioFramesPerBlock)
+            blockComplete();
+    }
+}
+
+bool AudioDriver::recoverCapture(int err)
+{
+    if (err == -EPIPE) {
+        m_xrunLock.lock();
+        m_xrunCount++;
+        m_xrunLock.unlock();
+        appLogWarn(QString("Audio capture overrun"));
+    }
+
+    if (snd_pcm_recover(m_handle, err, 1) < 0) {
+        deviceLost(err);
+        return false;
+    }
+
+    //  a partial block would straddle the gap so throw it away (the pool block is simply refilled)
+
+    m_bufferFrames = 0;
+
+    //  frames have been lost so the sample count no longer tracks time
+
+    m_clockLock.lock();
+    m_clock.reset(m_captureSampleRate, m_audioChannels);
+    m_clockLock.unlock();
+
+    //  a resumed stream may already be running again. Only a prepared one needs starting
+
+    if ((snd_pcm_state(m_handle) == SND_PCM_STATE_PREPARED) && (snd_pcm_start(m_handle) < 0)) {
+        deviceLost(err);
+        return false;
+    }
+
+    return true;
+}
+
+void AudioDriver::deviceLost(int err)
+{
+    appLogError(QString("Read from audio interface failed: %1").arg(snd_strerror(err)));
+    closeDevice();
+    m_state = STATE_DISCONNECTED;
+    m_ticks = 0;
+    emit audioState("Disconnected");
+}
+
+bool AudioDriver::startPolling()
+{
+    int rc;
+
+    if ((m_pollFdCount = snd_pcm_poll_descriptors_count(m_handle)) <= 0) {
+        appLogError("Failed to get audio poll descriptor count");
+        return false;
+    }
+
+    m_pollFds = (struct pollfd *)malloc(sizeof(struct pollfd) * m_pollFdCount);
+
+    if ((rc = snd_pcm_poll_descriptors(m_handle, m_pollFds, m_pollFdCount)) < 0) {
+        appLogError(QString("Failed to get audio poll descriptors: %1").arg(snd_strerror(rc)));
+        return false;
+    }
+
+    for (int i = 0; i < m_pollFdCount; i++) {
+        QSocketNotifier *notifier;
+
+        if (m_pollFds[i].events & POLLOUT)
+            notifier = new QSocketNotifier(m_pollFds[i].fd, QSocketNotifier::Write, this);
+        else
+            notifier = new QSocketNotifier(m_pollFds[i].fd, QSocketNotifier::Read, this);
+
+        connect(notifier, SIGNAL(activated(int)), this, SLOT(audioReady()));
+        m_notifiers.append(notifier);
+    }
+
+    if ((rc = snd_pcm_start(m_handle)) < 0) {
+        appLogError(QString("Failed to start audio capture: %1").arg(snd_strerror(rc)));
+        return false;
+    }
+
+    return true;
+}
+
+void AudioDriver::stopPolling()
+{
+    //  may be called from audioReady() so the notifiers can't be deleted directly
+
+    for (int i = 0; i < m_notifiers.count(); i++) {
+        m_notifiers[i]->setEnabled(false);
+        m_notifiers[i]->deleteLater();
+    }
+
+    m_notifiers.clear();
+
+    if (m_pollFds != NULL) {
+        free(m_pollFds);
+        m_pollFds = NULL;
+    }
+
+    m_pollFdCount = 0;
+}
+
 bool AudioDriver::deviceExists()
 {
     QFile devices(QString("/proc/asound/pcm"));
@@ -211,10 +651,13 @@ bool AudioDriver::openDevice()
 {
     int rc;
     static bool first_open = true;
+    snd_pcm_uframes_t periodSize;
+    snd_pcm_uframes_t bufferSize;
+    snd_pcm_sw_params_t *swParams;
 
     QString audioDevice = QString("plughw:%1,%2").arg(m_audioCard).arg(m_audioDevice);
 
-    if ((rc = snd_pcm_open(&m_handle, audioDevice.toLatin1(), SND_PCM_STREAM_CAPTURE, 0)) < 0) {
+    if ((rc = snd_pcm_open(&m_handle, audioDevice.toLatin1(), SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK)) < 0) {
 	if (first_open) {
             appLogError(QString("Failed to open audio device %1 - %2")
                 .arg(audioDevice).arg(snd_strerror(rc)));
@@ -237,7 +680,16 @@ bool AudioDriver::openDevice()
         return false;
     }
 
-    if ((rc = snd_pcm_hw_params_set_access(m_handle, m_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+    m_mmapActive = false;
+
+    if (m_mmapRequested) {
+        if ((rc = snd_pcm_hw_params_set_access(m_handle, m_params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0)
+            appLogWarn(QString("Audio device %1 does not support mmap access, using read access").arg(audioDevice));
+        else
+            m_mmapActive = true;
+    }
+
+    if (!m_mmapActive && (rc = snd_pcm_hw_params_set_access(m_handle, m_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
         appLogError(QString("Failed to set audio hardware access: %1").arg(snd_strerror(rc)));
         closeDevice();
         return false;
@@ -249,18 +701,46 @@ bool AudioDriver::openDevice()
         return false;
     }
 
-    if ((rc = snd_pcm_hw_params_set_rate_near(m_handle, m_params, (unsigned int *)&m_audioSampleRate, 0)) < 0) {
+    if ((rc = snd_pcm_hw_params_set_rate_near(m_handle, m_params, (unsigned int *)&m_captureSampleRate, 0)) < 0) {
         appLogError(QString("Failed to set audio sample rate: %1").arg(snd_strerror(rc)));
         closeDevice();
         return false;
     }
 
-    if ((rc = snd_pcm_hw_params_set_channels(m_handle, m_params, m_audioChannels)) < 0) {
+    if ((rc = snd_pcm_hw_params_set_channels(m_handle, m_params, m_captureChannels)) < 0) {
         appLogError(QString("Failed to set audio channel count: %1").arg(snd_strerror(rc)));
         closeDevice();
         return false;
     }
 
+    //  the device may not have given us exactly the rate asked for
+
+    if (!setupConversion()) {
+        closeDevice();
+        return false;
+    }
+
+    //  one period per block so that the poll descriptors wake us once per block
+
+    periodSize = m_audioFramesPerBlock;
+
+    if ((rc = snd_pcm_hw_params_set_period_size_near(m_handle, m_params, &periodSize, 0)) < 0) {
+        appLogError(QString("Failed to set audio period size: %1").arg(snd_strerror(rc)));
+        closeDevice();
+        return false;
+    }
+
+    bufferSize = periodSize * AUDIO_PERIODS_PER_BUFFER;
+
+    if (bufferSize < (snd_pcm_uframes_t)((m_captureSampleRate * AUDIO_MIN_BUFFER_MS) / 1000))
+        bufferSize = periodSize * (((m_captureSampleRate * AUDIO_MIN_BUFFER_MS) / 1000 + periodSize - 1) / periodSize);
+
+    if ((rc = snd_pcm_hw_params_set_buffer_size_near(m_handle, m_params, &bufferSize)) < 0) {
+        appLogError(QString("Failed to set audio buffer size: %1").arg(snd_strerror(rc)));
+        closeDevice();
+        return false;
+    }
+
     if ((rc = snd_pcm_hw_params(m_handle, m_params)) < 0) {
         appLogError(QString("Failed to set audio parameters: %1").arg(snd_strerror(rc)));
         closeDevice();
@@ -270,28 +750,74 @@ bool AudioDriver::openDevice()
     snd_pcm_hw_params_free(m_params);
     m_params = NULL;
 
+    if ((rc = snd_pcm_sw_params_malloc(&swParams)) < 0) {
+        appLogError(QString("Failed to allocate audio software parameter structure: %1").arg(snd_strerror(rc)));
+        closeDevice();
+        return false;
+    }
+
+    snd_pcm_sw_params_current(m_handle, swParams);
+    snd_pcm_sw_params_set_avail_min(m_handle, swParams, m_audioFramesPerBlock);
+    rc = snd_pcm_sw_params(m_handle, swParams);
+    snd_pcm_sw_params_free(swParams);
+
+    if (rc < 0) {
+        appLogError(QString("Failed to set audio software parameters: %1").arg(snd_strerror(rc)));
+        closeDevice();
+        return false;
+    }
+
     if ((rc = snd_pcm_prepare (m_handle)) < 0) {
         appLogError(QString("Failed to prepare audio interface for use: %1").arg(snd_strerror(rc)));
         closeDevice();
         return false;
     }
 
-    m_buffer = (unsigned char *)malloc(m_bytesPerBlock);
+    m_bufferFrames = 0;
+
+    return true;
+}
+
+bool AudioDriver::setupConversion()
+{
+    QMutexLocker lock(&m_convertLock);
+
+    m_audioFramesPerBlock = (m_captureSampleRate * m_audioBlockDuration) / 1000;
+    m_bytesPerFrame = m_captureChannels * (AUDIO_FIXED_SIZE / 8);
+
+    if (!m_converter.setFormat(m_captureSampleRate, m_captureChannels, m_audioSampleRate, m_audioChannels)) {
+        appLogError(QString("Unsupported audio conversion from %1/%2 to %3/%4")
+                    .arg(m_captureChannels).arg(m_captureSampleRate).arg(m_audioChannels).arg(m_audioSampleRate));
+        return false;
+    }
+
+    m_clockLock.lock();
+    m_clock.reset(m_captureSampleRate, m_audioChannels);
+    m_clockLock.unlock();
+
+    if (m_converter.isActive()) {
+        m_captureBuffer.resize(m_audioFramesPerBlock * m_bytesPerFrame);
+        m_bytesPerBlock = m_converter.maxOutputFrames(m_audioFramesPerBlock) * m_audioChannels * (AUDIO_FIXED_SIZE / 8);
+    } else {
+        m_captureBuffer.clear();
+        m_bytesPerBlock = m_audioFramesPerBlock * m_bytesPerFrame;
+    }
 
     return true;
 }
 
 void AudioDriver::closeDevice()
 {
+    stopPolling();
+
     if (m_handle != NULL) {
         snd_pcm_close(m_handle);
         m_handle = NULL;
     }
 
-    if (m_buffer != NULL) {
-        free(m_buffer);
-        m_buffer = NULL;
-    }
+    m_blockPool.clear();
+    m_fillIndex = -1;
+    m_poolNext = 0;
 
     if (m_params != NULL) {
         snd_pcm_hw_params_free(m_params);
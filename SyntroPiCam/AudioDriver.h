@@ -21,8 +21,12 @@
 #define AUDIODRIVER_H
 
 #include "SyntroLib.h"
+#include "AudioConverter.h"
+#include "AudioClock.h"
+#include "AudioSource.h"
 #include <QSize>
 #include <QSettings>
+#include <qmutex.h>
 
 //  Size in bits of sample
 
@@ -44,23 +48,77 @@
 #define	AUDIO_INPUT_CARD               "AudioInputCard"
 #define	AUDIO_INPUT_DEVICE             "AudioInputDevice"
 
+//  where audio comes from - one of the AUDIO_SOURCE_ types. Anything other than ALSA is a
+//  stand-in for testing the audio path without hardware
+
+#define AUDIO_SOURCE                   "AudioSource"
+#define AUDIO_SOURCE_PATH              "AudioSourcePath"
+#define AUDIO_SOURCE_TONEFREQ          "AudioSourceToneFreq"
+
+//  pace stand-in sources in real time, otherwise generate blocks as fast as possible
+
+#define AUDIO_SOURCE_REALTIME          "AudioSourceRealtime"
+
 //  parameters to use
 
 #define AUDIO_CHANNELS                 "AudioChannels"
 #define AUDIO_SAMPLERATE               "AudioSampleRate"
 
+//  format to capture from the device if different from the stream format (0 means the same).
+//  The driver converts to the stream format so a device's native rate doesn't go through plug.
+
+#define AUDIO_CAPTURE_CHANNELS         "AudioCaptureChannels"
+#define AUDIO_CAPTURE_SAMPLERATE       "AudioCaptureSampleRate"
+
+//  micro-resample captured audio so it runs at exactly the nominal rate by the system clock
+
+#define AUDIO_DRIFT_RESAMPLE           "AudioDriftResample"
+
+//  duration of each captured block in mS - sets the latency added by the driver
+
+#define AUDIO_BLOCKDURATION            "AudioBlockDuration"
+
+#define AUDIO_BLOCKDURATION_MIN        10
+#define AUDIO_BLOCKDURATION_MAX        100
+#define AUDIO_BLOCKDURATION_DEFAULT    100
+
+//  use mmap access to the ALSA ring if the device supports it
+
+#define AUDIO_MMAP                     "AudioMmap"
+
+//  minimum number of ALSA periods (one period is one block) in the capture ring
+
+#define AUDIO_PERIODS_PER_BUFFER       4
+
+//  the ring always holds at least this many mS so short blocks don't overrun on a busy system
+
+#define AUDIO_MIN_BUFFER_MS            200
+
+//  max number of blocks recycled between the driver and CamClient
+
+#define AUDIO_BLOCK_POOL_SIZE          16
+
+class QSocketNotifier;
+
 class AudioDriver : public SyntroThread
 {
 	Q_OBJECT
 
 public:
     AudioDriver();
+    int getXrunCount();
+    double getConvertCost();
+    double getClockDrift();
+    int getClockResyncs();
 
 public slots:
     void newAudioSrc();
 
+private slots:
+    void audioReady();
+
 signals:
-    void newAudio(QByteArray);
+    void newAudio(QByteArray, qint64);
     void audioState(QString);
     void audioFormat(int sampleRate, int channels, int sampleSize);
 
@@ -71,29 +129,75 @@ protected:
 
 private:
     bool loadSettings();
+    bool startSource();
+    void sourceTick();
     bool deviceExists();
     void startCapture();
     void stopCapture();
     bool openDevice();
     void closeDevice();
+    bool startPolling();
+    void stopPolling();
+    void readAvailable();
+    void readAvailableMmap();
+    char *fillBlock();
+    char *captureBlock();
+    bool setupConversion();
+    void blockComplete();
+    bool recoverCapture(int err);
+    void deviceLost(int err);
 
     int m_audioDevice;
     int m_audioCard;
 
+    int m_sourceType;
+    QString m_sourcePath;
+    int m_sourceToneFrequency;
+    bool m_sourceRealtime;
+    AudioSource *m_source;                                  // NULL when capturing from ALSA
+    int m_sourceTimer;
+    QElapsedTimer m_sourceElapsed;                          // paces real time sources
+    qint64 m_sourceStartTime;                               // timestamp of the first source frame
+    qint64 m_sourceFrames;                                  // frames delivered so far by the source
+
     snd_pcm_t *m_handle;
     snd_pcm_hw_params_t *m_params;
-    unsigned char *m_buffer;
+    QList<QByteArray> m_blockPool;                          // blocks are reused once CamClient has released them
+    int m_fillIndex;                                        // pool index of block being filled or -1
+    int m_poolNext;                                         // next pool entry to replace if none are free
+    int m_bufferFrames;                                     // frames accumulated so far in the block being filled
+
+    struct pollfd *m_pollFds;
+    int m_pollFdCount;
+    QList<QSocketNotifier *> m_notifiers;                   // one per ALSA poll descriptor
 
     int m_audioChannels;
     int m_audioSampleRate;
-    int m_audioFramesPerBlock;
-    int m_bytesPerBlock;
+    int m_captureChannels;
+    int m_captureSampleRate;
+    int m_audioBlockDuration;
+    int m_audioFramesPerBlock;                              // frames per block at the capture rate
+    int m_bytesPerFrame;                                    // capture frame size
+    int m_bytesPerBlock;                                    // stream block size
+
+    AudioConverter m_converter;                             // capture to stream format - protected by m_convertLock
+    QMutex m_convertLock;
+    QByteArray m_captureBuffer;                             // capture side block when converting
 
     bool m_enabled;
+    bool m_mmapRequested;
+    bool m_mmapActive;
+    bool m_driftResample;
+
+    AudioClock m_clock;                                     // sample clock vs system clock - protected by m_clockLock
+    QMutex m_clockLock;
 
     int m_state;
     int m_ticks;
     int m_timer;
+
+    int m_xrunCount;
+    QMutex m_xrunLock;
 };
 
 #endif // AUDIODRIVER_H
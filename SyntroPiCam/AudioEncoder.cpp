@@ -0,0 +1,351 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "AudioEncoder.h"
+
+//  IMA-ADPCM tables
+
+static const int imaIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const int imaStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+//  G.711 segment end points
+
+static const int muLawSegEnd[8] = {0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff, 0xfff, 0x1fff};
+static const int aLawSegEnd[8] = {0x1f, 0x3f, 0x7f, 0xff, 0x1ff, 0x3ff, 0x7ff, 0xfff};
+
+unsigned char AudioEncoder::m_muLawTable[16384];
+unsigned char AudioEncoder::m_aLawTable[8192];
+bool AudioEncoder::m_tablesValid = false;
+
+static int segment(int val, const int *segEnd)
+{
+    for (int i = 0; i < 8; i++) {
+        if (val <= segEnd[i])
+            return i;
+    }
+    return 8;
+}
+
+//  reference encoders - only used to build the lookup tables
+
+static unsigned char linearToMuLaw(int pcm)
+{
+    int mask;
+    int seg;
+
+    pcm >>= 2;
+
+    if (pcm < 0) {
+        pcm = -pcm;
+        mask = 0x7f;
+    } else {
+        mask = 0xff;
+    }
+
+    if (pcm > 8159)
+        pcm = 8159;
+
+    pcm += 0x84 >> 2;
+
+    if ((seg = segment(pcm, muLawSegEnd)) >= 8)
+        return (unsigned char)(0x7f ^ mask);
+
+    return (unsigned char)(((seg << 4) | ((pcm >> (seg + 1)) & 0x0f)) ^ mask);
+}
+
+static unsigned char linearToALaw(int pcm)
+{
+    int mask;
+    int seg;
+    int aval;
+
+    pcm >>= 3;
+
+    if (pcm >= 0) {
+        mask = 0xd5;
+    } else {
+        mask = 0x55;
+        pcm = -pcm - 1;
+    }
+
+    if ((seg = segment(pcm, aLawSegEnd)) >= 8)
+        return (unsigned char)(0x7f ^ mask);
+
+    aval = seg << 4;
+
+    if (seg < 2)
+        aval |= (pcm >> 1) & 0x0f;
+    else
+        aval |= (pcm >> seg) & 0x0f;
+
+    return (unsigned char)(aval ^ mask);
+}
+
+AudioEncoder::AudioEncoder()
+{
+    initTables();
+
+    m_codec = AUDIO_CODEC_PCM;
+    m_sampleRate = 8000;
+    m_channels = 1;
+    m_encodeNsecs = 0;
+    m_encodeSamples = 0;
+
+    for (int i = 0; i < AUDIO_ENCODER_MAX_CHANNELS; i++) {
+        m_predictor[i] = 0;
+        m_stepIndex[i] = 0;
+    }
+}
+
+void AudioEncoder::initTables()
+{
+    if (m_tablesValid)
+        return;
+
+    //  the tables cover every input value after the codec's own initial shift so
+    //  encoding is a single load per sample with no branches
+
+    for (int i = 0; i < 16384; i++)
+        m_muLawTable[i] = linearToMuLaw((i - 8192) << 2);
+
+    for (int i = 0; i < 8192; i++)
+        m_aLawTable[i] = linearToALaw((i - 4096) << 3);
+
+    m_tablesValid = true;
+}
+
+void AudioEncoder::setFormat(int codec, int sampleRate, int channels)
+{
+    if ((codec < 0) || (codec >= AUDIO_CODEC_COUNT))
+        codec = AUDIO_CODEC_PCM;
+
+    //  ADPCM keeps per channel state so fall back to PCM for silly channel counts
+
+    if ((codec == AUDIO_CODEC_IMAADPCM) && (channels > AUDIO_ENCODER_MAX_CHANNELS))
+        codec = AUDIO_CODEC_PCM;
+
+    m_codec = codec;
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+
+    for (int i = 0; i < AUDIO_ENCODER_MAX_CHANNELS; i++) {
+        m_predictor[i] = 0;
+        m_stepIndex[i] = 0;
+    }
+
+    m_encodeNsecs = 0;
+    m_encodeSamples = 0;
+}
+
+int AudioEncoder::getSubtype()
+{
+    switch (m_codec) {
+    case AUDIO_CODEC_IMAADPCM:
+        return SYNTRO_RECORD_TYPE_AUDIO_IMAADPCM;
+
+    case AUDIO_CODEC_MULAW:
+        return SYNTRO_RECORD_TYPE_AUDIO_MULAW;
+
+    case AUDIO_CODEC_ALAW:
+        return SYNTRO_RECORD_TYPE_AUDIO_ALAW;
+
+    default:
+        return SYNTRO_RECORD_TYPE_AUDIO_PCM;
+    }
+}
+
+const char *AudioEncoder::codecName(int codec)
+{
+    switch (codec) {
+    case AUDIO_CODEC_IMAADPCM:
+        return "IMA-ADPCM";
+
+    case AUDIO_CODEC_MULAW:
+        return "mu-law";
+
+    case AUDIO_CODEC_ALAW:
+        return "A-law";
+
+    default:
+        return "PCM";
+    }
+}
+
+double AudioEncoder::getEncodeCost()
+{
+    double cost = 0;
+
+    if ((m_encodeSamples > 0) && (m_sampleRate > 0))
+        cost = ((double)m_encodeNsecs / 1000.0) / ((double)m_encodeSamples / (double)m_sampleRate);
+
+    m_encodeNsecs = 0;
+    m_encodeSamples = 0;
+    return cost;
+}
+
+QByteArray AudioEncoder::encode(const QByteArray& pcm)
+{
+    QByteArray out;
+    int samples = pcm.length() / sizeof(qint16);
+    int frames = samples / m_channels;
+    const qint16 *in = (const qint16 *)pcm.constData();
+
+    if (m_codec == AUDIO_CODEC_PCM)
+        return pcm;
+
+    m_encodeTimer.start();
+
+    switch (m_codec) {
+    case AUDIO_CODEC_IMAADPCM:
+        out.resize(AUDIO_IMAADPCM_HEADER_SIZE * m_channels + (frames * m_channels + 1) / 2);
+        encodeIMAADPCM(in, frames, (unsigned char *)out.data());
+        break;
+
+    case AUDIO_CODEC_MULAW:
+        out.resize(samples);
+        encodeG711(in, samples, (unsigned char *)out.data(), m_muLawTable, 2, 8192);
+        break;
+
+    case AUDIO_CODEC_ALAW:
+        out.resize(samples);
+        encodeG711(in, samples, (unsigned char *)out.data(), m_aLawTable, 3, 4096);
+        break;
+    }
+
+    m_encodeNsecs += m_encodeTimer.nsecsElapsed();
+    m_encodeSamples += samples;
+
+    return out;
+}
+
+void AudioEncoder::encodeG711(const qint16 *pcm, int samples, unsigned char *out, const unsigned char *table, int shift, int offset)
+{
+    int i;
+
+    //  unrolled so the compiler can keep the loads in flight - there's no SIMD gather on the Pi
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        out[i] = table[(pcm[i] >> shift) + offset];
+        out[i + 1] = table[(pcm[i + 1] >> shift) + offset];
+        out[i + 2] = table[(pcm[i + 2] >> shift) + offset];
+        out[i + 3] = table[(pcm[i + 3] >> shift) + offset];
+    }
+
+    for (; i < samples; i++)
+        out[i] = table[(pcm[i] >> shift) + offset];
+}
+
+void AudioEncoder::encodeIMAADPCM(const qint16 *pcm, int frames, unsigned char *out)
+{
+    int channel;
+    int frame;
+    int nibbleIndex = 0;
+    unsigned char *data;
+
+    //  headers carry the state at the start of the block
+
+    for (channel = 0; channel < m_channels; channel++) {
+        out[0] = m_predictor[channel] & 0xff;
+        out[1] = (m_predictor[channel] >> 8) & 0xff;
+        out[2] = m_stepIndex[channel];
+        out[3] = 0;
+        out += AUDIO_IMAADPCM_HEADER_SIZE;
+    }
+
+    data = out;
+
+    for (frame = 0; frame < frames; frame++) {
+        for (channel = 0; channel < m_channels; channel++) {
+            int predictor = m_predictor[channel];
+            int index = m_stepIndex[channel];
+            int step = imaStepTable[index];
+            int diff = *pcm++ - predictor;
+            int vpdiff = step >> 3;
+            int code = 0;
+
+            if (diff < 0) {
+                code = 8;
+                diff = -diff;
+            }
+
+            if (diff >= step) {
+                code |= 4;
+                diff -= step;
+                vpdiff += step;
+            }
+
+            step >>= 1;
+
+            if (diff >= step) {
+                code |= 2;
+                diff -= step;
+                vpdiff += step;
+            }
+
+            step >>= 1;
+
+            if (diff >= step) {
+                code |= 1;
+                vpdiff += step;
+            }
+
+            if (code & 8)
+                predictor -= vpdiff;
+            else
+                predictor += vpdiff;
+
+            if (predictor > 32767)
+                predictor = 32767;
+            else if (predictor < -32768)
+                predictor = -32768;
+
+            index += imaIndexTable[code];
+
+            if (index < 0)
+                index = 0;
+            else if (index > 88)
+                index = 88;
+
+            m_predictor[channel] = predictor;
+            m_stepIndex[channel] = index;
+
+            if (nibbleIndex & 1)
+                data[nibbleIndex >> 1] |= code << 4;
+            else
+                data[nibbleIndex >> 1] = code;
+
+            nibbleIndex++;
+        }
+    }
+}
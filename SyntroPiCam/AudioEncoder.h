@@ -0,0 +1,102 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef AUDIOENCODER_H
+#define AUDIOENCODER_H
+
+#include "SyntroLib.h"
+#include <qelapsedtimer.h>
+
+//  settings key (in AUDIO_GROUP) for the codec used on the MJPPCM stream
+
+#define AUDIO_CODEC                    "AudioCodec"
+
+#define AUDIO_CODEC_PCM                0               // raw 16 bit PCM
+#define AUDIO_CODEC_IMAADPCM           1               // IMA-ADPCM, 4 bits per sample
+#define AUDIO_CODEC_MULAW              2               // G.711 mu-law, 8 bits per sample
+#define AUDIO_CODEC_ALAW               3               // G.711 A-law, 8 bits per sample
+
+#define AUDIO_CODEC_COUNT              4
+
+//  record subtypes for the compressed formats. These need to stay in step with SyntroAVDefs.h
+
+#ifndef SYNTRO_RECORD_TYPE_AUDIO_MULAW
+#define SYNTRO_RECORD_TYPE_AUDIO_MULAW      32
+#endif
+
+#ifndef SYNTRO_RECORD_TYPE_AUDIO_ALAW
+#define SYNTRO_RECORD_TYPE_AUDIO_ALAW       33
+#endif
+
+#ifndef SYNTRO_RECORD_TYPE_AUDIO_IMAADPCM
+#define SYNTRO_RECORD_TYPE_AUDIO_IMAADPCM   34
+#endif
+
+//  IMA-ADPCM blocks are self contained so a receiver can start on any record:
+//
+//  per channel header - predictor (int16 little endian), step index (uint8), reserved (uint8)
+//  followed by one nibble per sample in interleaved order, low nibble first
+
+#define AUDIO_IMAADPCM_HEADER_SIZE     4
+
+#define AUDIO_ENCODER_MAX_CHANNELS     8
+
+class AudioEncoder
+{
+public:
+    AudioEncoder();
+
+    void setFormat(int codec, int sampleRate, int channels);
+    int getCodec() { return m_codec; }
+    int getSubtype();
+
+    //  pcm is interleaved 16 bit samples
+
+    QByteArray encode(const QByteArray& pcm);
+
+    //  returns the uS of CPU used per second of single channel audio since the last call
+
+    double getEncodeCost();
+
+    static const char *codecName(int codec);
+
+private:
+    void encodeIMAADPCM(const qint16 *pcm, int frames, unsigned char *out);
+    void encodeG711(const qint16 *pcm, int samples, unsigned char *out, const unsigned char *table, int shift, int offset);
+
+    static void initTables();
+
+    static unsigned char m_muLawTable[16384];               // indexed by (sample >> 2) + 8192
+    static unsigned char m_aLawTable[8192];                 // indexed by (sample >> 3) + 4096
+    static bool m_tablesValid;
+
+    int m_codec;
+    int m_sampleRate;
+    int m_channels;
+
+    int m_predictor[AUDIO_ENCODER_MAX_CHANNELS];            // ADPCM state carried between blocks
+    int m_stepIndex[AUDIO_ENCODER_MAX_CHANNELS];
+
+    QElapsedTimer m_encodeTimer;
+    qint64 m_encodeNsecs;                                   // time spent encoding since last getEncodeCost()
+    qint64 m_encodeSamples;                                 // single channel samples encoded since last getEncodeCost()
+};
+
+#endif // AUDIOENCODER_H
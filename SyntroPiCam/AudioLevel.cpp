@@ -0,0 +1,168 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "AudioLevel.h"
+
+#include <math.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AUDIOLEVEL_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AUDIOLEVEL_SSE2
+#endif
+
+//  sum of squares and peak magnitude of count samples
+
+static void measure(const qint16 *samples, int count, quint64& sumSquares, int& peak)
+{
+    int i = 0;
+    int maxSample = 0;
+    int minSample = 0;
+
+    sumSquares = 0;
+
+#if defined(AUDIOLEVEL_NEON)
+    int64x2_t acc = vdupq_n_s64(0);
+    int16x8_t maxv = vdupq_n_s16(0);
+    int16x8_t minv = vdupq_n_s16(0);
+
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t s = vld1q_s16(samples + i);
+        int32x4_t sq = vmull_s16(vget_low_s16(s), vget_low_s16(s));
+        acc = vpadalq_s32(acc, sq);
+        sq = vmull_s16(vget_high_s16(s), vget_high_s16(s));
+        acc = vpadalq_s32(acc, sq);
+        maxv = vmaxq_s16(maxv, s);
+        minv = vminq_s16(minv, s);
+    }
+
+    sumSquares = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+
+    qint16 lanes[8];
+
+    vst1q_s16(lanes, maxv);
+    for (int j = 0; j < 8; j++)
+        maxSample = qMax(maxSample, (int)lanes[j]);
+
+    vst1q_s16(lanes, minv);
+    for (int j = 0; j < 8; j++)
+        minSample = qMin(minSample, (int)lanes[j]);
+
+#elif defined(AUDIOLEVEL_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    __m128i maxv = _mm_setzero_si128();
+    __m128i minv = _mm_setzero_si128();
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(samples + i));
+
+        //  each pair sum is at most 2^31 so it is treated as unsigned and widened to 64 bits
+
+        __m128i sq = _mm_madd_epi16(s, s);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+        maxv = _mm_max_epi16(maxv, s);
+        minv = _mm_min_epi16(minv, s);
+    }
+
+    quint64 sums[2];
+    qint16 lanes[8];
+
+    _mm_storeu_si128((__m128i *)sums, acc);
+    sumSquares = sums[0] + sums[1];
+
+    _mm_storeu_si128((__m128i *)lanes, maxv);
+    for (int j = 0; j < 8; j++)
+        maxSample = qMax(maxSample, (int)lanes[j]);
+
+    _mm_storeu_si128((__m128i *)lanes, minv);
+    for (int j = 0; j < 8; j++)
+        minSample = qMin(minSample, (int)lanes[j]);
+#endif
+
+    for (; i < count; i++) {
+        int s = samples[i];
+
+        sumSquares += s * s;
+        maxSample = qMax(maxSample, s);
+        minSample = qMin(minSample, s);
+    }
+
+    peak = qMax(maxSample, -minSample);
+}
+
+static double toDB(double level)
+{
+    if (level <= 0)
+        return AUDIOLEVEL_MIN_DB;
+
+    double db = 20.0 * log10(level / 32768.0);
+
+    return db < AUDIOLEVEL_MIN_DB ? AUDIOLEVEL_MIN_DB : db;
+}
+
+AudioLevel::AudioLevel()
+{
+    m_threshold = 0;
+    setFormat(8000, 1);
+}
+
+void AudioLevel::setFormat(int sampleRate, int channels)
+{
+    m_sampleRate = sampleRate > 0 ? sampleRate : 8000;
+    m_channels = channels > 0 ? channels : 1;
+
+    m_rms = AUDIOLEVEL_MIN_DB;
+    m_peak = AUDIOLEVEL_MIN_DB;
+    m_noiseFloor = AUDIOLEVEL_MIN_DB;
+    m_floorValid = false;
+}
+
+bool AudioLevel::process(const qint16 *samples, int count)
+{
+    quint64 sumSquares;
+    int peak;
+
+    if (count <= 0)
+        return false;
+
+    measure(samples, count, sumSquares, peak);
+
+    m_rms = toDB(sqrt((double)sumSquares / (double)count));
+    m_peak = toDB(peak);
+
+    //  the floor follows quiet periods down at once but only creeps up so that a
+    //  sustained noise doesn't look like activity forever
+
+    if (!m_floorValid) {
+        m_noiseFloor = m_rms;
+        m_floorValid = true;
+    } else if (m_rms < m_noiseFloor) {
+        m_noiseFloor = m_rms;
+    } else {
+        double seconds = (double)count / (double)(m_sampleRate * m_channels);
+        m_noiseFloor = qMin(m_rms, m_noiseFloor + AUDIOLEVEL_FLOOR_RISE_DB_PER_SEC * seconds);
+    }
+
+    return (m_rms > m_threshold) && (m_rms > m_noiseFloor + AUDIOLEVEL_VAD_MARGIN_DB);
+}
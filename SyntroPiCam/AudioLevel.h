@@ -0,0 +1,71 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef AUDIOLEVEL_H
+#define AUDIOLEVEL_H
+
+#include "SyntroLib.h"
+
+//  Measures the RMS and peak level of each block of 16 bit PCM and runs a simple
+//  energy based voice activity detector against an adaptive noise floor.
+
+//  level reported for digital silence
+
+#define AUDIOLEVEL_MIN_DB               -96.0
+
+//  a block must be this far above the noise floor to count as activity
+
+#define AUDIOLEVEL_VAD_MARGIN_DB        10.0
+
+//  how fast the noise floor creeps up when the level stays high (it drops immediately)
+
+#define AUDIOLEVEL_FLOOR_RISE_DB_PER_SEC    1.0
+
+class AudioLevel
+{
+public:
+    AudioLevel();
+
+    void setFormat(int sampleRate, int channels);
+
+    //  threshold in dBFS that activity must also exceed
+
+    void setThreshold(double threshold) { m_threshold = threshold; }
+
+    //  measures a block of interleaved samples and returns true if it contains activity
+
+    bool process(const qint16 *samples, int count);
+
+    double getRMS() { return m_rms; }                       // dBFS of the last block
+    double getPeak() { return m_peak; }                     // dBFS of the last block
+    double getNoiseFloor() { return m_noiseFloor; }
+
+private:
+    int m_sampleRate;
+    int m_channels;
+    double m_threshold;
+
+    double m_rms;
+    double m_peak;
+    double m_noiseFloor;
+    bool m_floorValid;                                      // false until the first block sets the floor
+};
+
+#endif // AUDIOLEVEL_H
@@ -0,0 +1,261 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "AudioSource.h"
+
+#include <math.h>
+
+AudioSource *AudioSource::createSource(int type, const QString& path, int toneFrequency)
+{
+    switch (type) {
+    case AUDIO_SOURCE_FILE:
+        return new AudioFileSource(path);
+
+    case AUDIO_SOURCE_TONE:
+    case AUDIO_SOURCE_NOISE:
+        return new AudioSynthSource(type, toneFrequency);
+
+    default:
+        return NULL;
+    }
+}
+
+QString AudioSource::sourceName(int type)
+{
+    switch (type) {
+    case AUDIO_SOURCE_ALSA:
+        return "ALSA device";
+
+    case AUDIO_SOURCE_FILE:
+        return "File";
+
+    case AUDIO_SOURCE_TONE:
+        return "Tone";
+
+    case AUDIO_SOURCE_NOISE:
+        return "Noise";
+
+    default:
+        return "Unknown";
+    }
+}
+
+//----------------------------------------------------------
+//  AudioFileSource
+
+AudioFileSource::AudioFileSource(const QString& path)
+    : m_file(path)
+{
+    m_wav = false;
+    m_dataStart = 0;
+    m_dataEnd = 0;
+    m_bytesPerFrame = 2;
+}
+
+QString AudioFileSource::description()
+{
+    return m_file.fileName();
+}
+
+bool AudioFileSource::open(int& sampleRate, int& channels)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        appLogError(QString("Failed to open audio source file %1").arg(m_file.fileName()));
+        return false;
+    }
+
+    if (m_file.fileName().endsWith(".wav", Qt::CaseInsensitive)) {
+        if (!parseWav(sampleRate, channels)) {
+            m_file.close();
+            return false;
+        }
+        m_wav = true;
+    } else {
+        //  raw files are taken to be in the requested format
+
+        m_dataStart = 0;
+        m_dataEnd = m_file.size();
+    }
+
+    m_bytesPerFrame = channels * sizeof(qint16);
+    m_dataEnd -= (m_dataEnd - m_dataStart) % m_bytesPerFrame;
+
+    if (m_dataEnd <= m_dataStart) {
+        appLogError(QString("Audio source file %1 has no samples").arg(m_file.fileName()));
+        m_file.close();
+        return false;
+    }
+
+    m_file.seek(m_dataStart);
+    return true;
+}
+
+static quint32 getLE32(const char *data)
+{
+    const unsigned char *ptr = (const unsigned char *)data;
+
+    return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((quint32)ptr[3] << 24);
+}
+
+static quint16 getLE16(const char *data)
+{
+    const unsigned char *ptr = (const unsigned char *)data;
+
+    return ptr[0] | (ptr[1] << 8);
+}
+
+bool AudioFileSource::parseWav(int& sampleRate, int& channels)
+{
+    char header[12];
+    char chunk[8];
+    bool gotFormat = false;
+
+    if ((m_file.read(header, 12) != 12) || (memcmp(header, "RIFF", 4) != 0) || (memcmp(header + 8, "WAVE", 4) != 0)) {
+        appLogError(QString("Audio source file %1 is not a WAV file").arg(m_file.fileName()));
+        return false;
+    }
+
+    while (m_file.read(chunk, 8) == 8) {
+        quint32 length = getLE32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            QByteArray format = m_file.read(length);
+
+            if ((format.length() < 16) || (getLE16(format.constData()) != 1) || (getLE16(format.constData() + 14) != 16)) {
+                appLogError(QString("Audio source file %1 is not 16 bit PCM").arg(m_file.fileName()));
+                return false;
+            }
+
+            int fileChannels = getLE16(format.constData() + 2);
+            quint32 fileSampleRate = getLE32(format.constData() + 4);
+
+            if ((fileChannels <= 0) || (fileChannels > AUDIO_SOURCE_MAX_CHANNELS) ||
+                    (fileSampleRate == 0) || (fileSampleRate > AUDIO_SOURCE_MAX_SAMPLERATE)) {
+                appLogError(QString("Audio source file %1 has an unsupported format: %2 channels at %3Hz")
+                            .arg(m_file.fileName()).arg(fileChannels).arg(fileSampleRate));
+                return false;
+            }
+
+            channels = fileChannels;
+            sampleRate = fileSampleRate;
+            gotFormat = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!gotFormat)
+                break;
+
+            m_dataStart = m_file.pos();
+            m_dataEnd = qMin(m_dataStart + (qint64)length, m_file.size());
+            return true;
+        } else {
+            m_file.seek(m_file.pos() + length);
+        }
+
+        //  chunks are word aligned
+
+        if (length & 1)
+            m_file.seek(m_file.pos() + 1);
+    }
+
+    appLogError(QString("Audio source file %1 has no PCM data").arg(m_file.fileName()));
+    return false;
+}
+
+int AudioFileSource::read(char *data, int frames)
+{
+    int wanted = frames * m_bytesPerFrame;
+    int done = 0;
+
+    //  loop back to the start at the end of the data
+
+    while (done < wanted) {
+        qint64 available = m_dataEnd - m_file.pos();
+
+        if (available <= 0) {
+            m_file.seek(m_dataStart);
+            continue;
+        }
+
+        qint64 bytesRead = m_file.read(data + done, qMin((qint64)(wanted - done), available));
+
+        if (bytesRead <= 0)
+            break;
+
+        done += bytesRead;
+    }
+
+    return done / m_bytesPerFrame;
+}
+
+//----------------------------------------------------------
+//  AudioSynthSource
+
+AudioSynthSource::AudioSynthSource(int type, int toneFrequency)
+{
+    m_type = type;
+    m_toneFrequency = toneFrequency;
+    m_sampleRate = 8000;
+    m_channels = 1;
+    m_phase = 0;
+    m_noiseState = 1;
+}
+
+QString AudioSynthSource::description()
+{
+    if (m_type == AUDIO_SOURCE_TONE)
+        return QString("%1Hz tone").arg(m_toneFrequency);
+
+    return QString("Noise");
+}
+
+bool AudioSynthSource::open(int& sampleRate, int& channels)
+{
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_phase = 0;
+    m_noiseState = 1;
+    return true;
+}
+
+int AudioSynthSource::read(char *data, int frames)
+{
+    qint16 *samples = (qint16 *)data;
+
+    if (m_type == AUDIO_SOURCE_TONE) {
+        double step = 2.0 * M_PI * (double)m_toneFrequency / (double)m_sampleRate;
+
+        for (int i = 0; i < frames; i++) {
+            qint16 sample = (qint16)(AUDIO_SOURCE_SYNTH_AMPLITUDE * sin(m_phase));
+
+            for (int c = 0; c < m_channels; c++)
+                *samples++ = sample;
+
+            m_phase += step;
+            if (m_phase >= 2.0 * M_PI)
+                m_phase -= 2.0 * M_PI;
+        }
+    } else {
+        for (int i = 0; i < frames * m_channels; i++) {
+            m_noiseState = m_noiseState * 1664525 + 1013904223;
+            samples[i] = (qint16)(((qint32)(m_noiseState >> 16) - 32768) * AUDIO_SOURCE_SYNTH_AMPLITUDE / 32768);
+        }
+    }
+
+    return frames;
+}
@@ -0,0 +1,105 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef AUDIOSOURCE_H
+#define AUDIOSOURCE_H
+
+#include "SyntroLib.h"
+#include <qfile.h>
+
+//  Stand-in audio sources that replace the ALSA device so the audio path can be
+//  run without hardware. Samples are always 16 bit interleaved.
+
+#define AUDIO_SOURCE_ALSA               0                   // the real device
+#define AUDIO_SOURCE_FILE               1                   // WAV or raw PCM file, looped
+#define AUDIO_SOURCE_TONE               2                   // sine wave
+#define AUDIO_SOURCE_NOISE              3                   // white noise
+
+#define AUDIO_SOURCE_COUNT              4
+
+//  amplitude of the synthetic sources - -20dBFS
+
+#define AUDIO_SOURCE_SYNTH_AMPLITUDE    3277
+
+//  limits on the format of a WAV source file
+
+#define AUDIO_SOURCE_MAX_CHANNELS       8
+#define AUDIO_SOURCE_MAX_SAMPLERATE     192000
+
+class AudioSource
+{
+public:
+    virtual ~AudioSource() {}
+
+    //  returns an unopened source of the given type or NULL for AUDIO_SOURCE_ALSA
+
+    static AudioSource *createSource(int type, const QString& path, int toneFrequency);
+    static QString sourceName(int type);
+
+    //  sampleRate and channels are the requested format on entry and the actual format on exit
+
+    virtual bool open(int& sampleRate, int& channels) = 0;
+
+    //  fills data with frames frames and returns the number delivered
+
+    virtual int read(char *data, int frames) = 0;
+
+    virtual QString description() = 0;
+};
+
+class AudioFileSource : public AudioSource
+{
+public:
+    AudioFileSource(const QString& path);
+
+    bool open(int& sampleRate, int& channels);
+    int read(char *data, int frames);
+    QString description();
+
+private:
+    bool parseWav(int& sampleRate, int& channels);
+
+    QFile m_file;
+    bool m_wav;
+    qint64 m_dataStart;                                     // file offset of the first sample
+    qint64 m_dataEnd;                                       // file offset after the last sample
+    int m_bytesPerFrame;
+};
+
+class AudioSynthSource : public AudioSource
+{
+public:
+    AudioSynthSource(int type, int toneFrequency);
+
+    bool open(int& sampleRate, int& channels);
+    int read(char *data, int frames);
+    QString description();
+
+private:
+    int m_type;
+    int m_toneFrequency;
+    int m_sampleRate;
+    int m_channels;
+
+    double m_phase;                                         // tone phase in radians
+    quint32 m_noiseState;                                   // LCG state for noise
+};
+
+#endif // AUDIOSOURCE_H
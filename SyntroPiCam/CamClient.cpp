@@ -20,6 +20,7 @@
 #include "SyntroLib.h"
 #include "CamClient.h"
 #include "SyntroUtils.h"
+#include "AudioDriver.h"
 
 #include <qbuffer.h>
 #include <qdebug.h>
@@ -42,6 +43,9 @@ CamClient::CamClient(QObject *)
     m_frameCount = 0;
     m_audioSampleCount = 0;
     m_recordIndex = 0;
+    m_audioThreshold = 0;
+    m_audioHold = 0;
+    m_lastAudioEventTime = 0;
 
     QSettings *settings = SyntroUtils::getSettings();
 
@@ -96,6 +100,12 @@ CamClient::CamClient(QObject *)
     if (!settings->contains(CAMCLIENT_MOTION_POSTROLL))
         settings->setValue(CAMCLIENT_MOTION_POSTROLL, "2000");
 
+    if (!settings->contains(CAMCLIENT_MOTION_AUDIO_THRESHOLD))
+        settings->setValue(CAMCLIENT_MOTION_AUDIO_THRESHOLD, "0");
+
+    if (!settings->contains(CAMCLIENT_MOTION_AUDIO_HOLD))
+        settings->setValue(CAMCLIENT_MOTION_AUDIO_HOLD, "2000");
+
     settings->endGroup();
 
     delete settings;
@@ -127,6 +137,21 @@ int CamClient::getAudioSampleCount()
     return count;
 }
 
+double CamClient::getAudioEncodeCost()
+{
+    QMutexLocker lock(&m_audioQMutex);
+
+    return m_audioEncoder.getEncodeCost();
+}
+
+void CamClient::getAudioLevel(double& rms, double& peak)
+{
+    QMutexLocker lock(&m_audioLevelLock);
+
+    rms = m_audioLevel.getRMS();
+    peak = m_audioLevel.getPeak();
+}
+
 void CamClient::ageOutPrerollQueues(qint64 now)
 {
 	while (!m_videoPrerollQueue.empty()) {
@@ -195,7 +220,7 @@ void CamClient::processAVQueueMJPPCM()
 
             // now check for motion if it's time
 
-            if ((now - m_lastDeltaTime) > m_deltaInterval)
+            if ((m_deltaInterval != 0) && ((now - m_lastDeltaTime) > m_deltaInterval))
                 checkForMotion(now, jpeg);
             if (m_imageChanged) {
                 m_sequenceState = CAMCLIENT_STATE_PREROLL; // send the preroll frames
@@ -220,6 +245,23 @@ void CamClient::processAVQueueMJPPCM()
                 m_audioLowRatePrerollQueue.enqueue(preroll);
             }
         }
+
+        // a sound can start the sequence too
+
+        if (m_sequenceState == CAMCLIENT_STATE_IDLE) {
+            if (audioTriggered(now)) {
+                m_sequenceState = CAMCLIENT_STATE_PREROLL;
+                stateString = QString("STATE_PREROLL (audio): queue size %1").arg(m_audioPrerollQueue.size());
+                STATE_DEBUG(stateString);
+            } else if (!m_gotVideoFormat) {
+                // audio only so there are no video frames to drive the heartbeat
+
+                if (SyntroUtils::syntroTimerExpired(now, m_lastFrameTime, m_highRateNullInterval))
+                    sendNullFrameMJPPCM(now, true);
+                if (SyntroUtils::syntroTimerExpired(now, m_lastLowRateFrameTime, m_lowRateNullInterval))
+                    sendNullFrameMJPPCM(now, false);
+            }
+        }
         break;
 
         // sending the preroll queue
@@ -500,7 +542,10 @@ bool CamClient::sendAVMJPPCM(qint64 now, int param, bool checkMotion)
         }
     }
 
-    if ((highRateJpeg.size() > 0) && checkMotion) {
+    if (checkMotion && audioTriggered(now))
+        return true;                                        // still hearing something
+
+    if ((highRateJpeg.size() > 0) && checkMotion && (m_deltaInterval != 0)) {
         if ((now - m_lastDeltaTime) > m_deltaInterval)
             checkForMotion(now, highRateJpeg);
         return m_imageChanged;                              // image may have changed
@@ -580,6 +625,16 @@ void CamClient::checkForMotion(qint64 now, QByteArray& jpeg)
     m_lastDeltaTime = now;
 }
 
+bool CamClient::audioTriggered(qint64 now)
+{
+    if (m_audioThreshold == 0)
+        return false;
+
+    QMutexLocker lock(&m_audioLevelLock);
+
+    return (now - m_lastAudioEventTime) < m_audioHold;
+}
+
 void CamClient::halfRes(QByteArray& jpeg)
 {
 	QImage img;
@@ -636,6 +691,31 @@ bool CamClient::dequeueAudioFrame(QByteArray& audioData, qint64& timestamp)
     audioData = qd->data;
     timestamp = qd->timestamp;
     delete qd;
+
+    if (!m_audioFrameQ.empty()) {
+        // small blocks arrive faster than records are sent so batch everything queued into one frame
+
+        int totalLength = audioData.length();
+
+        for (int i = 0; i < m_audioFrameQ.count(); i++)
+            totalLength += m_audioFrameQ.at(i)->data.length();
+
+        QByteArray batch;
+        batch.reserve(totalLength);
+        batch.append(audioData);
+
+        while (!m_audioFrameQ.empty()) {
+            qd = m_audioFrameQ.dequeue();
+            batch.append(qd->data);
+            delete qd;
+        }
+
+        audioData = batch;
+    }
+
+    // encode after batching so that each record holds exactly one encoded block
+
+    audioData = m_audioEncoder.encode(audioData);
     return true;
 }
 
@@ -670,7 +750,7 @@ void CamClient::clearQueues()
     while (!m_audioLowRatePrerollQueue.empty())
         delete m_audioLowRatePrerollQueue.dequeue();
 
-     if (m_deltaInterval == 0) {
+     if ((m_deltaInterval == 0) && (m_audioThreshold == 0)) {
         m_sequenceState = CAMCLIENT_STATE_CONTINUOUS;    // motion detection inactive
         STATE_DEBUG("STATE_CONTINUOUS");
     } else {
@@ -697,16 +777,25 @@ void CamClient::newJPEG(QByteArray frame)
     m_frameCount++;
 }
 
-void CamClient::newAudio(QByteArray audioFrame)
+void CamClient::newAudio(QByteArray audioFrame, qint64 timestamp)
 {
-     m_audioQMutex.lock();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
 
-    if (m_audioFrameQ.count() > 5)
+    // level detection runs on the raw PCM before batching and encoding
+
+    m_audioLevelLock.lock();
+    if (m_audioLevel.process((const qint16 *)audioFrame.constData(), audioFrame.length() / sizeof(qint16)))
+        m_lastAudioEventTime = now;
+    m_audioLevelLock.unlock();
+
+    m_audioQMutex.lock();
+
+    while (!m_audioFrameQ.empty() && ((now - m_audioFrameQ.head()->timestamp) > CAMCLIENT_AUDIO_QUEUE_MAX_MS))
         delete m_audioFrameQ.dequeue();
 
     CLIENT_QUEUEDATA *qd = new CLIENT_QUEUEDATA;
     qd->data = audioFrame;
-    qd->timestamp = QDateTime::currentMSecsSinceEpoch();
+    qd->timestamp = timestamp;                              // capture time from the sample clock, not arrival
     m_audioFrameQ.enqueue(qd);
 
     m_audioQMutex.unlock();
@@ -763,6 +852,8 @@ void CamClient::newStream()
     m_deltaInterval = settings->value(CAMCLIENT_MOTION_DELTA_INTERVAL).toInt();
     m_preroll = settings->value(CAMCLIENT_MOTION_PREROLL).toInt();
     m_postroll = settings->value(CAMCLIENT_MOTION_POSTROLL).toInt();
+    m_audioThreshold = settings->value(CAMCLIENT_MOTION_AUDIO_THRESHOLD).toDouble();
+    m_audioHold = settings->value(CAMCLIENT_MOTION_AUDIO_HOLD).toInt();
 
     settings->endGroup();
 
@@ -773,6 +864,11 @@ void CamClient::newStream()
     m_cd.setTilesToSkip(m_tilesToSkip);
     m_cd.setIntervalsToSkip(m_intervalsToSkip);
 
+    m_audioLevelLock.lock();
+    m_audioLevel.setThreshold(m_audioThreshold);
+    m_lastAudioEventTime = 0;
+    m_audioLevelLock.unlock();
+
     qint64 now = QDateTime::currentMSecsSinceEpoch();
 
     m_lastFrameTime = now;
@@ -790,7 +886,9 @@ void CamClient::newStream()
 
     m_avParams.avmuxSubtype = SYNTRO_RECORD_TYPE_AVMUX_MJPPCM;
     m_avParams.videoSubtype = SYNTRO_RECORD_TYPE_VIDEO_MJPEG;
-    m_avParams.audioSubtype = SYNTRO_RECORD_TYPE_AUDIO_PCM;
+    m_audioQMutex.lock();
+    m_avParams.audioSubtype = m_audioEncoder.getSubtype();
+    m_audioQMutex.unlock();
 }
 
 void CamClient::videoFormat(int width, int height, int framerate)
@@ -803,6 +901,38 @@ void CamClient::videoFormat(int width, int height, int framerate)
 
 void CamClient::audioFormat(int sampleRate, int channels, int sampleSize)
 {
+    QSettings *settings = SyntroUtils::getSettings();
+
+    settings->beginGroup(AUDIO_GROUP);
+
+    if (!settings->contains(AUDIO_CODEC))
+        settings->setValue(AUDIO_CODEC, AUDIO_CODEC_PCM);
+
+    int codec = settings->value(AUDIO_CODEC).toInt();
+
+    settings->endGroup();
+
+    delete settings;
+
+    // anything queued is in the old format
+
+    clearAudioQueue();
+
+    while (!m_audioPrerollQueue.empty())
+        delete m_audioPrerollQueue.dequeue();
+
+    while (!m_audioLowRatePrerollQueue.empty())
+        delete m_audioLowRatePrerollQueue.dequeue();
+
+    m_audioLevelLock.lock();
+    m_audioLevel.setFormat(sampleRate, channels);
+    m_audioLevelLock.unlock();
+
+    m_audioQMutex.lock();
+    m_audioEncoder.setFormat(codec, sampleRate, channels);
+    m_avParams.audioSubtype = m_audioEncoder.getSubtype();
+    m_audioQMutex.unlock();
+
     m_avParams.audioSampleRate = sampleRate;
     m_avParams.audioChannels = channels;
     m_avParams.audioSampleSize = sampleSize;
@@ -21,6 +21,8 @@
 #define CAMCLIENT_H
 
 #include "ChangeDetector.h"
+#include "AudioEncoder.h"
+#include "AudioLevel.h"
 
 #include <qimage.h>
 #include <qmutex.h>
@@ -84,12 +86,24 @@
 
 #define CAMCLIENT_MOTION_POSTROLL        "MotionPostroll"
 
+// audio level in dBFS that counts as a motion event. 0 turns off the feature
+
+#define CAMCLIENT_MOTION_AUDIO_THRESHOLD "MotionAudioThreshold"
+
+// time in mS that an audio event keeps the sequence going after the sound stops
+
+#define CAMCLIENT_MOTION_AUDIO_HOLD      "MotionAudioHold"
+
 // maximum rate - 120 per second (allows for 4x rate during preroll send)
 
 #define	CAMERA_IMAGE_INTERVAL	((qint64)SYNTRO_CLOCKS_PER_SEC/120)
 
 #define CAMCLIENT_AV_TYPE_MJPPCM     0               // MJPEG + PCM
 
+// max age in mS of audio held in the audio queue. Queued blocks are batched into one record when sent
+
+#define CAMCLIENT_AUDIO_QUEUE_MAX_MS    600
+
 
 typedef struct
 {
@@ -122,11 +136,13 @@ public:
     virtual ~CamClient();
     int getFrameCount();
     int getAudioSampleCount();
+    double getAudioEncodeCost();
+    void getAudioLevel(double& rms, double& peak);
 
 public slots:
 	void newStream();
     void newJPEG(QByteArray);
-    void newAudio(QByteArray);
+    void newAudio(QByteArray, qint64 timestamp);
     void videoFormat(int width, int height, int framerate);
     void audioFormat(int sampleRate, int channels, int sampleSize);
 
@@ -151,6 +167,7 @@ private:
     bool m_lowRateHalfRes;
 
     void checkForMotion(qint64 now, QByteArray& jpeg);      // checks to see if a motion event has occured
+    bool audioTriggered(qint64 now);                        // true if an audio event is within its hold time
     bool dequeueVideoFrame(QByteArray& videoData, qint64& timestamp);
     bool dequeueAudioFrame(QByteArray& audioData, qint64& timestamp);
     void clearVideoQueue();
@@ -182,6 +199,9 @@ private:
     qint64 m_preroll;                                       // length in mS of preroll
     qint64 m_postroll;                                      // length in mS of postroll
 
+    double m_audioThreshold;                                // dBFS, 0 if audio doesn't trigger sequences
+    qint64 m_audioHold;                                     // length in mS of audio hold
+
     int m_tilesToSkip;                                      // number of tiles in an interval to skip
     int m_intervalsToSkip;                                  // number of intervals to skip
 
@@ -209,6 +229,12 @@ private:
     int m_audioSampleCount;
     QMutex m_audioSampleLock;
 
+    AudioEncoder m_audioEncoder;                            // encodes batched audio - protected by m_audioQMutex
+
+    AudioLevel m_audioLevel;                                // measures each raw block - protected by m_audioLevelLock
+    qint64 m_lastAudioEventTime;                            // last time the level detector saw activity
+    QMutex m_audioLevelLock;
+
     int m_recordIndex;                                      // increments for every avmux record constructed
 
     SYNTRO_AVPARAMS m_avParams;                             // used to hold stream parameters
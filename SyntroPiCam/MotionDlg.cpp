@@ -59,6 +59,16 @@ void MotionDlg::onOk()
 		changed = true;
 	}
 
+	if (m_audioThreshold->text() != settings->value(CAMCLIENT_MOTION_AUDIO_THRESHOLD).toString()) {
+		settings->setValue(CAMCLIENT_MOTION_AUDIO_THRESHOLD, m_audioThreshold->text());
+		changed = true;
+	}
+
+	if (m_audioHold->text() != settings->value(CAMCLIENT_MOTION_AUDIO_HOLD).toString()) {
+		settings->setValue(CAMCLIENT_MOTION_AUDIO_HOLD, m_audioHold->text());
+		changed = true;
+	}
+
 	settings->endGroup();
 
     delete settings;
@@ -115,6 +125,18 @@ void MotionDlg::layoutWindow()
 	m_postroll->setText(settings->value(CAMCLIENT_MOTION_POSTROLL).toString());
 	m_postroll->setValidator(new QIntValidator(200, 10000));
 
+	m_audioThreshold = new QLineEdit(this);
+	m_audioThreshold->setMaximumWidth(60);
+    formLayout->addRow(tr("Audio trigger level (dBFS) - 0 disables audio trigger"), m_audioThreshold);
+	m_audioThreshold->setText(settings->value(CAMCLIENT_MOTION_AUDIO_THRESHOLD).toString());
+	m_audioThreshold->setValidator(new QIntValidator(-90, 0));
+
+	m_audioHold = new QLineEdit(this);
+	m_audioHold->setMaximumWidth(60);
+	formLayout->addRow(tr("Audio hold time (mS)"), m_audioHold);
+	m_audioHold->setText(settings->value(CAMCLIENT_MOTION_AUDIO_HOLD).toString());
+	m_audioHold->setValidator(new QIntValidator(0, 60000));
+
 	centralLayout->addLayout(formLayout);
     centralLayout->addSpacerItem(new QSpacerItem(20, 20));
 
@@ -53,6 +53,8 @@ private:
 	QLineEdit *m_motionDelta;
 	QLineEdit *m_preroll;
 	QLineEdit *m_postroll;
+	QLineEdit *m_audioThreshold;
+	QLineEdit *m_audioHold;
 	QDialogButtonBox *m_buttons;
 
 };
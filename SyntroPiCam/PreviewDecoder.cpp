@@ -0,0 +1,84 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "PreviewDecoder.h"
+
+#include <qbuffer.h>
+#include <qimagereader.h>
+
+PreviewDecoder::PreviewDecoder() : SyntroThread("PreviewDecoder", "PreviewDecoder")
+{
+    m_decodePending = false;
+}
+
+void PreviewDecoder::setDisplaySize(QSize size)
+{
+    QMutexLocker lock(&m_lock);
+
+    m_displaySize = size;
+}
+
+void PreviewDecoder::newJPEG(QByteArray frame)
+{
+    QMutexLocker lock(&m_lock);
+
+    //  an older frame that hasn't been decoded yet is just replaced
+
+    m_frame = frame;
+
+    if (!m_decodePending) {
+        m_decodePending = true;
+        QMetaObject::invokeMethod(this, "decodeFrame", Qt::QueuedConnection);
+    }
+}
+
+void PreviewDecoder::decodeFrame()
+{
+    QByteArray frame;
+    QSize displaySize;
+
+    m_lock.lock();
+    frame = m_frame;
+    m_frame.clear();
+    displaySize = m_displaySize;
+    m_decodePending = false;
+    m_lock.unlock();
+
+    if (frame.isEmpty() || displaySize.isEmpty())
+        return;
+
+    QBuffer buffer(&frame);
+    QImageReader reader(&buffer, "JPEG");
+
+    //  the size comes from the header. Setting the scaled size lets the JPEG handler
+    //  decode at 1/2, 1/4 or 1/8 scale rather than decoding everything and scaling after.
+
+    QSize imageSize = reader.size();
+
+    if (imageSize.isValid()) {
+        imageSize.scale(displaySize, Qt::KeepAspectRatio);
+        reader.setScaledSize(imageSize);
+    }
+
+    QImage image = reader.read();
+
+    if (!image.isNull())
+        emit newImage(image);
+}
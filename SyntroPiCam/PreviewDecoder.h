@@ -0,0 +1,59 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef PREVIEWDECODER_H
+#define PREVIEWDECODER_H
+
+#include "SyntroLib.h"
+
+#include <qimage.h>
+#include <qmutex.h>
+#include <qsize.h>
+
+//  Decodes the local preview off the GUI thread. The JPEG decoder is asked for the display
+//  size so that it can use a reduced IDCT scale, so the cost depends on the preview
+//  size rather than the sensor size. Only the latest frame is kept.
+
+class PreviewDecoder : public SyntroThread
+{
+    Q_OBJECT
+
+public:
+    PreviewDecoder();
+
+    void setDisplaySize(QSize size);                        // an empty size stops decoding
+
+public slots:
+    void newJPEG(QByteArray frame);
+
+signals:
+    void newImage(QImage image);
+
+private slots:
+    void decodeFrame();
+
+private:
+    QMutex m_lock;
+    QByteArray m_frame;                                     // latest frame not yet decoded - protected by m_lock
+    bool m_decodePending;                                   // decodeFrame() has been queued
+    QSize m_displaySize;
+};
+
+#endif // PREVIEWDECODER_H
@@ -36,8 +36,8 @@ SyntroPiCam::SyntroPiCam()
 
 	m_frameCount = 0;
 	m_frameRateTimer = 0;
-	m_frameRefreshTimer = 0;
 	m_camera = NULL;
+	m_decoder = NULL;
     m_audio = NULL;
 
 	layoutStatusBar();
@@ -82,6 +82,10 @@ SyntroPiCam::SyntroPiCam()
 
 	m_frameRateTimer = startTimer(FRAME_RATE_TIMER_INTERVAL * 1000);
 
+	m_decoder = new PreviewDecoder();
+	connect(m_decoder, SIGNAL(newImage(QImage)), this, SLOT(newImage(QImage)), Qt::QueuedConnection);
+	m_decoder->resumeThread();
+
 	startVideo();
     startAudio();
 }
@@ -92,24 +96,21 @@ SyntroPiCam::~SyntroPiCam()
 		delete m_camera;
 		m_camera = NULL;
 	}
-
-	clearQueue();
 }
 
 void SyntroPiCam::closeEvent(QCloseEvent *)
 {
 	stopVideo();
 
-	clearQueue();
-
 	if (m_frameRateTimer) {
 		killTimer(m_frameRateTimer);
 		m_frameRateTimer = 0;
 	}
 
-	if (m_frameRefreshTimer) {
-		killTimer(m_frameRefreshTimer);
-		m_frameRefreshTimer = 0;
+	if (m_decoder) {
+		disconnect(m_decoder, SIGNAL(newImage(QImage)), this, SLOT(newImage(QImage)));
+		m_decoder->exitThread();
+		m_decoder = NULL;
 	}
 
     m_client->exitThread();
@@ -142,8 +143,6 @@ void SyntroPiCam::startVideo()
 		}
 	}
 
-	clearQueue();
-
     connect(this, SIGNAL(newCamera()), m_camera, SLOT(newCamera()));
 	connect(m_camera, SIGNAL(cameraState(QString)), this, SLOT(cameraState(QString)), Qt::DirectConnection);
     connect(m_camera, SIGNAL(videoFormat(int,int,int)), this, SLOT(videoFormat(int,int,int)));
@@ -154,7 +153,7 @@ void SyntroPiCam::startVideo()
 
     m_camera->resumeThread();
 	m_frameCount = 0;
-	m_frameRefreshTimer = startTimer(10);
+	updateDisplaySize();
 }
 
 void SyntroPiCam::stopVideo()
@@ -171,11 +170,6 @@ void SyntroPiCam::stopVideo()
         m_camera->exitThread();
 		m_camera = NULL;
 	}
-
-	if (m_frameRefreshTimer) {
-		killTimer(m_frameRefreshTimer);
-		m_frameRefreshTimer = 0;
-	}
 }
 
 void SyntroPiCam::startAudio()
@@ -183,7 +177,7 @@ void SyntroPiCam::startAudio()
     if (!m_audio) {
         m_audio = new AudioDriver();
         connect(this, SIGNAL(newAudioSrc()), m_audio, SLOT(newAudioSrc()));
-        connect(m_audio, SIGNAL(newAudio(QByteArray)), m_client, SLOT(newAudio(QByteArray)), Qt::DirectConnection);
+        connect(m_audio, SIGNAL(newAudio(QByteArray, qint64)), m_client, SLOT(newAudio(QByteArray, qint64)), Qt::DirectConnection);
         connect(m_audio, SIGNAL(audioFormat(int, int, int)), m_client, SLOT(audioFormat(int, int, int)), Qt::QueuedConnection);
 		connect(m_audio, SIGNAL(audioState(QString)), this, SLOT(audioState(QString)), Qt::DirectConnection);
         m_audio->resumeThread();
@@ -194,7 +188,7 @@ void SyntroPiCam::stopAudio()
 {
     if (m_audio) {
         disconnect(this, SIGNAL(newAudioSrc()), m_audio, SLOT(newAudioSrc()));
-        disconnect(m_audio, SIGNAL(newAudio(QByteArray)), m_client, SLOT(newAudio(QByteArray)));
+        disconnect(m_audio, SIGNAL(newAudio(QByteArray, qint64)), m_client, SLOT(newAudio(QByteArray, qint64)));
         disconnect(m_audio, SIGNAL(audioFormat(int, int, int)), m_client, SLOT(audioFormat(int, int, int)));
 		disconnect(m_audio, SIGNAL(audioState(QString)), this, SLOT(audioState(QString)));
         m_audio->exitThread();
@@ -222,12 +216,26 @@ void SyntroPiCam::newJPEG(QByteArray frame)
 {
 	m_frameCount++;
 
-	if (m_frameQMutex.tryLock()) {
-		if (m_jpegFrameQ.empty())
-			m_jpegFrameQ.enqueue(frame);
+	//  called from the camera thread. The decoder keeps only the latest frame.
 
-		m_frameQMutex.unlock();
-	}
+	m_decoder->newJPEG(frame);
+}
+
+void SyntroPiCam::newImage(QImage img)
+{
+	//  the decoder works to the size it was last given so keep it up to date
+
+	updateDisplaySize();
+
+	if (isMinimized() || img.isNull())
+		return;
+
+	m_cameraView->setPixmap(QPixmap::fromImage(img));
+}
+
+void SyntroPiCam::updateDisplaySize()
+{
+	m_decoder->setDisplaySize(isMinimized() ? QSize() : m_cameraView->size());
 }
 
 void SyntroPiCam::timerEvent(QTimerEvent *event)
@@ -243,57 +251,13 @@ void SyntroPiCam::timerEvent(QTimerEvent *event)
         } else {
 			m_frameRateStatus->setText(QString("Video: ") + m_cameraState);
 		}
-    } else {
-		processFrameQueue();
-	}
-}
 
-void SyntroPiCam::processFrameQueue()
-{
-	QByteArray frame;
-	QImage img;
-
-	m_frameQMutex.lock();
-
-	if (!m_jpegFrameQ.empty()) {
-		frame = m_jpegFrameQ.dequeue();
-	}
-
-	m_frameQMutex.unlock();
-
-	if (isMinimized())
-		return;
-
-    showJPEG(frame);
-}
+		//  picks up a restore from minimized when no frames are being decoded
 
-void SyntroPiCam::showJPEG(QByteArray frame)
-{  
-	if (frame.size() > 0) {
-		QImage img;
-		img.loadFromData(frame, "JPEG");
-		showImage(img);
+		updateDisplaySize();
 	}
 }
 
-void SyntroPiCam::showImage(QImage img)
-{
-	if (img.isNull())
-		return;
-
-	QImage scaledImg = img.scaled(m_cameraView->size(), Qt::KeepAspectRatio);
-
-	if (!scaledImg.isNull())
-		m_cameraView->setPixmap(QPixmap::fromImage(scaledImg));
-}
-
-void SyntroPiCam::clearQueue()
-{
-	m_frameQMutex.lock();
-	m_jpegFrameQ.clear();
-	m_frameQMutex.unlock();
-}
-
 void SyntroPiCam::layoutStatusBar()
 {
 	m_controlStatus = new QLabel(this);
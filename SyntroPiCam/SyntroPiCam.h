@@ -26,6 +26,7 @@
 #include "VideoDriver.h"
 #include "AudioDriver.h"
 #include "CamClient.h"
+#include "PreviewDecoder.h"
 
 
 #define PRODUCT_TYPE "SyntroPiCam"
@@ -56,6 +57,7 @@ public slots:
  	void audioState(QString state);
     void videoFormat(int width, int height, int frameRate);
 	void newJPEG(QByteArray);
+	void newImage(QImage);
 
 protected:
 	void timerEvent(QTimerEvent *event);
@@ -66,11 +68,8 @@ private:
 	void stopVideo();
     void startAudio();
     void stopAudio();
-	void processFrameQueue();
-	void showJPEG(QByteArray frame);
-	void showImage(QImage img);
 	bool createCamera();
-	void clearQueue();
+	void updateDisplaySize();
 	void layoutStatusBar();
 	void saveWindowState();
 	void restoreWindowState();
@@ -87,11 +86,9 @@ private:
     AudioDriver *m_audio;
 	QString m_cameraState;
 	QString m_audioState;
-	QMutex m_frameQMutex;
-	QQueue <QByteArray> m_jpegFrameQ;
+	PreviewDecoder *m_decoder;
 
 	int m_frameRateTimer;
-	int m_frameRefreshTimer;
 	int m_frameCount;
 	QSize m_imgSize;
 };
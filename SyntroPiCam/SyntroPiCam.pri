@@ -24,7 +24,13 @@ HEADERS += SyntroPiCam.h \
         SyntroPiCamConsole.h \
 	VideoDriver.h \
 	CamClient.h \	
+	PreviewDecoder.h \
 	AudioDriver.h \	
+	AudioEncoder.h \
+	AudioConverter.h \
+	AudioClock.h \
+	AudioLevel.h \
+	AudioSource.h \
 	StreamsDlg.h \
         CameraDlg.h \
         MotionDlg.h \
@@ -38,7 +44,13 @@ SOURCES += main.cpp \
         SyntroPiCamConsole.cpp \
 	VideoDriver.cpp \
 	CamClient.cpp \
+	PreviewDecoder.cpp \
   	AudioDriver.cpp \
+	AudioEncoder.cpp \
+	AudioConverter.cpp \
+	AudioClock.cpp \
+	AudioLevel.cpp \
+	AudioSource.cpp \
 	StreamsDlg.cpp \
         CameraDlg.cpp \
         MotionDlg.cpp \
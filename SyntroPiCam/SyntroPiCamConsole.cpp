@@ -41,6 +41,11 @@ SyntroPiCamConsole::SyntroPiCamConsole(bool daemonMode, QObject *parent)
 	m_daemonMode = daemonMode;
 
     m_computedFrameRate = 0.0;
+    m_audioSamplesPerSecond = 0.0;
+    m_audioEncodeCost = 0.0;
+    m_audioConvertCost = 0.0;
+    m_audioClockDrift = 0.0;
+    m_audioClockResyncs = 0;
 	m_frameCount = 0;
 	m_frameRateTimer = 0;
 	m_camera = NULL;
@@ -150,14 +155,14 @@ void SyntroPiCamConsole::stopVideo()
 void SyntroPiCamConsole::startAudio()
 {
     m_audio = new AudioDriver();
-    connect(m_audio, SIGNAL(newAudio(QByteArray)), m_client, SLOT(newAudio(QByteArray)), Qt::DirectConnection);
+    connect(m_audio, SIGNAL(newAudio(QByteArray, qint64)), m_client, SLOT(newAudio(QByteArray, qint64)), Qt::DirectConnection);
     connect(m_audio, SIGNAL(audioFormat(int, int, int)), m_client, SLOT(audioFormat(int, int, int)), Qt::QueuedConnection);
     m_audio->resumeThread();
 }
 
 void SyntroPiCamConsole::stopAudio()
 {
-    disconnect(m_audio, SIGNAL(newAudio(QByteArray)), m_client, SLOT(newAudio(QByteArray)));
+    disconnect(m_audio, SIGNAL(newAudio(QByteArray, qint64)), m_client, SLOT(newAudio(QByteArray, qint64)));
     disconnect(m_audio, SIGNAL(audioFormat(int, int, int)), m_client, SLOT(audioFormat(int, int, int)));
 
     m_audio->exitThread();
@@ -187,6 +192,13 @@ void SyntroPiCamConsole::timerEvent(QTimerEvent *)
 	m_frameCount = 0;
 
     m_audioSamplesPerSecond = (double)m_client->getAudioSampleCount() / (double)FRAME_RATE_TIMER_INTERVAL;;
+    m_audioEncodeCost = m_client->getAudioEncodeCost();
+
+    if (m_audio != NULL) {
+        m_audioConvertCost = m_audio->getConvertCost();
+        m_audioClockDrift = m_audio->getClockDrift();
+        m_audioClockResyncs = m_audio->getClockResyncs();
+    }
 }
 
 void SyntroPiCamConsole::showHelp()
@@ -209,6 +221,18 @@ void SyntroPiCamConsole::showStatus()
     printf("Frame size is    : %d x %d\n", m_width, m_height);
     printf("Frame rate is    : %d\n", m_framerate);
     printf("Audio byte rate is: %f\n", m_audioSamplesPerSecond);
+
+    printf("Audio encode cost is: %f uS per channel second\n", m_audioEncodeCost);
+
+    printf("Audio convert cost is: %f uS per second\n", m_audioConvertCost);
+    double rms, peak;
+    m_client->getAudioLevel(rms, peak);
+    printf("Audio level is: %.1f dBFS rms, %.1f dBFS peak\n", rms, peak);
+
+    printf("Audio clock drift is: %f ppm (%d resyncs)\n", m_audioClockDrift, m_audioClockResyncs);
+
+    if (m_audio != NULL)
+        printf("Audio overruns is: %d\n", m_audio->getXrunCount());
 }
 
 void SyntroPiCamConsole::run()
@@ -67,6 +67,10 @@ private:
 	int m_frameRateTimer;
     double m_computedFrameRate;
     double m_audioSamplesPerSecond;
+    double m_audioEncodeCost;
+    double m_audioConvertCost;
+    double m_audioClockDrift;
+    int m_audioClockResyncs;
 	bool m_daemonMode;
 	static volatile bool sigIntReceived;
 
@@ -50,6 +50,15 @@ static void needAudioSrcData (GstElement * /*appsrc*/, guint /*unused_size*/, gp
     ((AVMuxEncode *)user_data)->needAudioData();
 }
 
+//  GStreamer calls this with GST_BUFFER_MALLOCDATA when a buffer from wrapQueueData() is freed
+
+static void releaseWrappedData(gpointer data)
+{
+    AVMUX_QUEUEDATA *qd = (AVMUX_QUEUEDATA *)data;
+
+    qd->owner->releaseQueueData(qd);
+}
+
 #ifdef GSTBUSMSG
 static gboolean videoBusMessage(GstBus * /*bus*/, GstMessage *message, gpointer data)
 {
@@ -93,13 +102,32 @@ AVMuxEncode::AVMuxEncode(int slot) : SyntroThread("AVMuxEncode", "AVMuxEncode")
     m_appAudioSrc = NULL;
     m_appVideoSink = NULL;
     m_appAudioSrc = NULL;
-    m_videoCaps = NULL;
-    m_audioCaps = NULL;
+    m_capsChanged = false;
     m_videoBusWatch = -1;
     m_audioBusWatch = -1;
     m_audioTimestamp = -1;
     m_pipelinesActive = false;
     m_audioCompressionRate = 128000;
+    m_audioSrcCaps = NULL;
+    m_videoSrcStop = false;
+    m_videoLatencyTotal = 0;
+    m_videoLatencyCount = 0;
+    m_nativeVideo = false;
+    m_videoDropping = true;
+    m_videoIDRRequested = false;
+    m_lastIDRRequest = 0;
+    m_videoDropCount = 0;
+    m_resyncStart = -1;
+    m_timeToFirstPicture = -1;
+    m_audioSrcStop = false;
+    m_audioPacketTime = 0;
+    m_audioDTXLevel = 0;
+    m_audioHangover = 0;
+    m_audioSuppressedCount = 0;
+    m_audioFirstQueuedAt = -1;
+    m_audioLatencyTotal = 0;
+    m_audioLatencyCount = 0;
+    m_latencyClock.start();
 }
 
 
@@ -113,6 +141,11 @@ void AVMuxEncode::finishThread()
     killTimer(m_timer);
     m_pipelinesActive = false;
     deletePipelines();
+
+    m_poolLock.lock();
+    while (!m_pool.empty())
+        delete m_pool.takeFirst();
+    m_poolLock.unlock();
 }
 
 void AVMuxEncode::timerEvent(QTimerEvent * /*event*/)
@@ -120,68 +153,365 @@ void AVMuxEncode::timerEvent(QTimerEvent * /*event*/)
 
 }
 
-void AVMuxEncode::newVideoData(QByteArray videoData, qint64 timestamp, int param)
+AVMUX_QUEUEDATA *AVMuxEncode::allocQueueData()
 {
+    QMutexLocker lock(&m_poolLock);
+
+    if (!m_pool.empty())
+        return m_pool.takeLast();
+
     AVMUX_QUEUEDATA *qd = new AVMUX_QUEUEDATA;
-    qd->data = videoData;
-    qd->timestamp = timestamp;
-    qd->param = param;
+    qd->owner = this;
+    return qd;
+}
+
+void AVMuxEncode::releaseQueueData(AVMUX_QUEUEDATA *qd)
+{
+    //  drop the payload now so its memory goes back to the producer
+
+    qd->data.clear();
+
+    QMutexLocker lock(&m_poolLock);
+
+    if (m_pool.count() < AVMUX_QUEUEDATA_POOL_MAX)
+        m_pool.append(qd);
+    else
+        delete qd;
+}
+
+GstBuffer *AVMuxEncode::wrapQueueData(AVMUX_QUEUEDATA *qd)
+{
+    GstBuffer *buffer = gst_buffer_new();
+
+    //  the buffer points straight at the QByteArray's data. The entry holds a reference
+    //  to it until GStreamer frees the buffer and releaseWrappedData returns it to the pool
+
+    GST_BUFFER_DATA(buffer) = (guint8 *)qd->data.constData();
+    GST_BUFFER_SIZE(buffer) = qd->data.length();
+    GST_BUFFER_MALLOCDATA(buffer) = (guint8 *)qd;
+    GST_BUFFER_FREE_FUNC(buffer) = releaseWrappedData;
+    GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_READONLY);
+    return buffer;
+}
+
+bool AVMuxEncode::admitVideo(QByteArray& videoData)
+{
+    qint64 now = SyntroClock();
+    bool congested;
+    bool request = false;
+    int types = RTPH264Packetiser::nalTypes(videoData);
+
+    //  decoders can only restart cleanly at an IDR, which MMAL precedes with the SPS and PPS
+
+    bool keyStart = (types & ((1 << H264_NAL_SPS) | (1 << H264_NAL_IDR))) != 0;
+
+    if (types & ((1 << H264_NAL_SPS) | (1 << H264_NAL_PPS)))
+        cacheVideoHeaders(videoData);
+
+    m_videoSinkLock.lock();
+    congested = !m_videoSinkQ.empty() &&
+            ((m_latencyClock.nsecsElapsed() - m_videoSinkQ.head()->queuedAt) > (qint64)AVMUX_VIDEO_BACKLOG_MAX * 1000000);
+    m_videoSinkLock.unlock();
 
     m_videoSrcLock.lock();
-    m_videoSrcQ.enqueue(qd);
 
     if (m_videoSrcQ.count() >= AVMUX_VIDEO_QUEUE_MAX)
-        m_videoSrcQ.dequeue();
+        congested = true;
+
+    if (congested) {
+        //  anything up to the next IDR would only smear so drop the rest of the GOP
+
+        if (!m_videoDropping) {
+            m_videoDropping = true;
+            m_videoIDRRequested = false;
+        }
+        m_videoDropCount++;
+        m_videoSrcLock.unlock();
+        return false;
+    }
+
+    if (!m_videoDropping) {
+        m_videoSrcLock.unlock();
+        return true;
+    }
+
+    if (keyStart) {
+        m_videoDropping = false;
+
+        //  make sure the decoder has the parameter sets even if this IDR came without them
+
+        if (!(types & (1 << H264_NAL_SPS)))
+            videoData.prepend(m_videoSPS + m_videoPPS);
+
+        if (m_resyncStart != -1) {
+            m_timeToFirstPicture = (m_latencyClock.nsecsElapsed() - m_resyncStart) / 1000000;
+            m_resyncStart = -1;
+        }
+        m_videoSrcLock.unlock();
+        return true;
+    }
+
+    //  the link has recovered so ask for an IDR rather than wait for the end of the GOP
 
+    if (!m_videoIDRRequested || SyntroUtils::syntroTimerExpired(now, m_lastIDRRequest, AVMUX_IDR_REQUEST_INTERVAL)) {
+        m_videoIDRRequested = true;
+        m_lastIDRRequest = now;
+        request = true;
+    }
+    m_videoDropCount++;
     m_videoSrcLock.unlock();
+
+    if (request)
+        emit requestIDR();
+
+    return false;
 }
 
-void AVMuxEncode::newVideoData(QByteArray videoData)
+void AVMuxEncode::cacheVideoHeaders(const QByteArray& videoData)
 {
-    AVMUX_QUEUEDATA *qd = new AVMUX_QUEUEDATA;
+    const unsigned char *nal;
+    int nalLength;
+    int offset = 0;
+
+    QMutexLocker lock(&m_videoSrcLock);
+
+    while (RTPH264Packetiser::nextNAL((const unsigned char *)videoData.constData(), videoData.length(), offset, nal, nalLength)) {
+        switch (nal[0] & 0x1f) {
+        case H264_NAL_SPS:
+            m_videoSPS = QByteArray("\0\0\0\1", 4) + QByteArray((const char *)nal, nalLength);
+            break;
+
+        case H264_NAL_PPS:
+            m_videoPPS = QByteArray("\0\0\0\1", 4) + QByteArray((const char *)nal, nalLength);
+            break;
+        }
+    }
+}
+
+void AVMuxEncode::resyncVideo()
+{
+    m_videoSrcLock.lock();
+    m_videoDropping = true;
+    m_videoIDRRequested = true;
+    m_lastIDRRequest = SyntroClock();
+    m_resyncStart = m_latencyClock.nsecsElapsed();
+    m_videoSrcLock.unlock();
+
+    //  don't wait for the next segment to find out an IDR is needed
+
+    emit requestIDR();
+}
+
+int AVMuxEncode::getTimeToFirstPicture()
+{
+    QMutexLocker lock(&m_videoSrcLock);
+
+    return m_timeToFirstPicture;
+}
+
+QByteArray AVMuxEncode::getVideoCaps()
+{
+    QMutexLocker lock(&m_videoSinkLock);
+
+    return m_videoCaps;
+}
+
+QByteArray AVMuxEncode::getAudioCaps()
+{
+    QMutexLocker lock(&m_audioSinkLock);
+
+    return m_audioCaps;
+}
+
+bool AVMuxEncode::capsChanged()
+{
+    //  the video and audio sinks each set the flag under their own lock
+
+    QMutexLocker videoLock(&m_videoSinkLock);
+    QMutexLocker audioLock(&m_audioSinkLock);
+    bool changed = m_capsChanged;
+
+    m_capsChanged = false;
+    return changed;
+}
+
+int AVMuxEncode::getVideoDropCount()
+{
+    QMutexLocker lock(&m_videoSrcLock);
+    int count = m_videoDropCount;
+
+    m_videoDropCount = 0;
+    return count;
+}
+
+void AVMuxEncode::newVideoData(QByteArray videoData, qint64 timestamp, int param)
+{
+    if (!m_pipelinesActive || !admitVideo(videoData))
+        return;
+
+    if (m_nativeVideo) {
+        packetiseVideo(videoData, timestamp, param);
+        return;
+    }
+
+    AVMUX_QUEUEDATA *qd = allocQueueData();
     qd->data = videoData;
-    qd->timestamp = SyntroClock();
-    qd->param = SYNTRO_RECORDHEADER_PARAM_NORMAL;
+    qd->timestamp = timestamp;
+    qd->param = param;
+    qd->queuedAt = m_latencyClock.nsecsElapsed();
+
+    //  admitVideo() has already checked there is room
 
     m_videoSrcLock.lock();
     m_videoSrcQ.enqueue(qd);
+    m_videoSrcCond.wakeOne();
+    m_videoSrcLock.unlock();
+}
 
-    if (m_videoSrcQ.count() >= AVMUX_VIDEO_QUEUE_MAX)
-        m_videoSrcQ.dequeue();
+void AVMuxEncode::newVideoData(QByteArray videoData)
+{
+    newVideoData(videoData, SyntroClock(), SYNTRO_RECORDHEADER_PARAM_NORMAL);
+}
+
+void AVMuxEncode::packetiseVideo(const QByteArray& videoData, qint64 timestamp, int param)
+{
+    QList<QByteArray> packets;
+    qint64 start = m_latencyClock.nsecsElapsed();
+
+    //  RTP time runs from the monotonic clock at the H.264 rate. VideoDriver delivers whole access
+    //  units so every NAL of a picture, parameter sets included, shares the timestamp
+
+    quint32 rtpTimestamp = (quint32)((start * 9) / 100000);
+
+    m_videoSinkLock.lock();
+    int types = m_videoPacketiser.packetise(videoData, rtpTimestamp, packets);
+
+    for (int i = 0; i < packets.count(); i++) {
+        AVMUX_QUEUEDATA *qd = allocQueueData();
+        qd->data = packets.at(i);
+        qd->timestamp = timestamp;
+        qd->param = param;
+        qd->queuedAt = start;
+        m_videoSinkQ.enqueue(qd);
+    }
 
+    //  the caps carry the parameter sets so follow any change in them
+
+    if (types & ((1 << H264_NAL_SPS) | (1 << H264_NAL_PPS))) {
+        QByteArray caps = m_videoPacketiser.getCaps().toLatin1();
+
+        if (!caps.isEmpty() && (caps != m_videoCaps)) {
+            m_videoCaps = caps;
+            m_capsChanged = true;
+#ifdef GSTBUSMSG
+            qDebug() << "Video caps " << m_videoCaps;
+#endif
+        }
+    }
+    m_videoSinkLock.unlock();
+
+    //  comparable with the queue latency of the pipeline path
+
+    m_videoSrcLock.lock();
+    m_videoLatencyTotal += m_latencyClock.nsecsElapsed() - start;
+    m_videoLatencyCount++;
     m_videoSrcLock.unlock();
 }
 
 void AVMuxEncode::newAudioData(QByteArray audioData, qint64 timestamp, int param)
 {
-    AVMUX_QUEUEDATA *qd = new AVMUX_QUEUEDATA;
+    if (suppressAudio(audioData))
+        return;
+
+    AVMUX_QUEUEDATA *qd = allocQueueData();
     qd->data = audioData;
     qd->timestamp = timestamp;
     qd->param = param;
+    qd->queuedAt = m_latencyClock.nsecsElapsed();
 
     m_audioSrcLock.lock();
     m_audioSrcQ.enqueue(qd);
+    m_audioSrcCond.wakeOne();
 
     if (m_audioSrcQ.count() >= AVMUX_AUDIO_QUEUE_MAX)
-        m_audioSrcQ.dequeue();
+        releaseQueueData(m_audioSrcQ.dequeue());
 
     m_audioSrcLock.unlock();
 }
 
 void AVMuxEncode::newAudioData(QByteArray audioData)
 {
-    AVMUX_QUEUEDATA *qd = new AVMUX_QUEUEDATA;
-    qd->data = audioData;
-    qd->timestamp = SyntroClock();
-    qd->param = SYNTRO_RECORDHEADER_PARAM_NORMAL;
+    newAudioData(audioData, SyntroClock(), SYNTRO_RECORDHEADER_PARAM_NORMAL);
+}
 
-    m_audioSrcLock.lock();
-    m_audioSrcQ.enqueue(qd);
+bool AVMuxEncode::suppressAudio(const QByteArray& audioData)
+{
+    const qint16 *samples = (const qint16 *)audioData.constData();
+    int count = audioData.length() / 2;
+    int peak = 0;
+    int bytesPerSecond;
 
-    if (m_audioSrcQ.count() >= AVMUX_AUDIO_QUEUE_MAX)
-        m_audioSrcQ.dequeue();
+    //  the audio driver always delivers 16 bit samples
 
-    m_audioSrcLock.unlock();
+    if ((m_audioPacketTime == 0) || (m_audioDTXLevel == 0) || (m_avParams.audioSampleSize != 16))
+        return false;
+
+    for (int i = 0; i < count; i++) {
+        int level = qAbs((int)samples[i]);
+        if (level > peak)
+            peak = level;
+    }
+
+    if (peak >= m_audioDTXLevel) {
+        m_audioHangover = AVMUX_AUDIO_DTX_HANGOVER;
+        return false;
+    }
+
+    if (m_audioHangover > 0) {
+        bytesPerSecond = m_avParams.audioSampleRate * 2 * m_avParams.audioChannels;
+        if (bytesPerSecond > 0)
+            m_audioHangover -= (audioData.length() * 1000) / bytesPerSecond;
+        return false;
+    }
+
+    QMutexLocker lock(&m_audioSrcLock);
+    m_audioSuppressedCount++;
+    return true;
+}
+
+double AVMuxEncode::getAudioLatency()
+{
+    QMutexLocker lock(&m_audioSinkLock);
+    double latency = 0;
+
+    if (m_audioLatencyCount > 0)
+        latency = ((double)m_audioLatencyTotal / 1000000.0) / (double)m_audioLatencyCount;
+
+    m_audioLatencyTotal = 0;
+    m_audioLatencyCount = 0;
+    return latency;
+}
+
+int AVMuxEncode::getAudioSuppressedCount()
+{
+    QMutexLocker lock(&m_audioSrcLock);
+    int count = m_audioSuppressedCount;
+
+    m_audioSuppressedCount = 0;
+    return count;
+}
+
+double AVMuxEncode::getVideoQueueLatency()
+{
+    QMutexLocker lock(&m_videoSrcLock);
+    double latency = 0;
+
+    if (m_videoLatencyCount > 0)
+        latency = ((double)m_videoLatencyTotal / 1000.0) / (double)m_videoLatencyCount;
+
+    m_videoLatencyTotal = 0;
+    m_videoLatencyCount = 0;
+    return latency;
 }
 
 bool AVMuxEncode::getCompressedVideo(QByteArray& videoData, qint64& timestamp, int& param)
@@ -196,7 +526,7 @@ bool AVMuxEncode::getCompressedVideo(QByteArray& videoData, qint64& timestamp, i
     videoData = qd->data;
     timestamp = qd->timestamp;
     param = qd->param;
-    delete qd;
+    releaseQueueData(qd);
     return true;
 }
 
@@ -210,7 +540,7 @@ bool AVMuxEncode::getCompressedVideo(QByteArray& videoData)
 
     qd = m_videoSinkQ.dequeue();
     videoData = qd->data;
-    delete qd;
+    releaseQueueData(qd);
     return true;
 }
 
@@ -226,7 +556,7 @@ bool AVMuxEncode::getCompressedAudio(QByteArray& audioData, qint64& timestamp, i
     audioData = qd->data;
     timestamp = qd->timestamp;
     param = qd->param;
-    delete qd;
+    releaseQueueData(qd);
     return true;
 }
 
@@ -240,7 +570,7 @@ bool AVMuxEncode::getCompressedAudio(QByteArray& audioData)
 
     qd = m_audioSinkQ.dequeue();
     audioData = qd->data;
-    delete qd;
+    releaseQueueData(qd);
     return true;
 }
 
@@ -250,12 +580,16 @@ void AVMuxEncode::processVideoSinkData()
     AVMUX_QUEUEDATA *qd;
     m_videoSinkLock.lock();
     if ((buffer = gst_app_sink_pull_buffer((GstAppSink *)(m_appVideoSink))) != NULL) {
-        qd = new AVMUX_QUEUEDATA;
+        qd = allocQueueData();
         qd->data = QByteArray((const char *)GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer));
         qd->timestamp = m_lastQueuedVideoTimestamp;
         qd->param = m_lastQueuedVideoParam;
-        if (m_videoCaps == NULL) {
-            m_videoCaps = gst_caps_to_string(GST_BUFFER_CAPS(buffer));
+        qd->queuedAt = m_latencyClock.nsecsElapsed();
+        if (m_videoCaps.isEmpty()) {
+            gchar *caps = gst_caps_to_string(GST_BUFFER_CAPS(buffer));
+            m_videoCaps = caps;
+            g_free(caps);
+            m_capsChanged = true;
 #ifdef GSTBUSMSG
             qDebug() << "Video caps " << m_videoCaps;
 #endif
@@ -272,13 +606,24 @@ void AVMuxEncode::processAudioSinkData()
 
     m_audioSinkLock.lock();
     if ((buffer = gst_app_sink_pull_buffer((GstAppSink *)(m_appAudioSink))) != NULL) {
-        AVMUX_QUEUEDATA *qd = new AVMUX_QUEUEDATA;
+        AVMUX_QUEUEDATA *qd = allocQueueData();
         qd->data = QByteArray((const char *)GST_BUFFER_DATA(buffer), GST_BUFFER_SIZE(buffer));
         qd->timestamp = m_lastQueuedAudioTimestamp;
         qd->param = m_lastQueuedAudioParam;
         m_audioSinkQ.enqueue(qd);
-        if (m_audioCaps == NULL) {
-            m_audioCaps = gst_caps_to_string(GST_BUFFER_CAPS(buffer));
+
+        //  how long the oldest audio in this packet has been held since it was captured
+
+        if (m_audioFirstQueuedAt != -1) {
+            m_audioLatencyTotal += m_latencyClock.nsecsElapsed() - m_audioFirstQueuedAt;
+            m_audioLatencyCount++;
+            m_audioFirstQueuedAt = -1;
+        }
+        if (m_audioCaps.isEmpty()) {
+            gchar *caps = gst_caps_to_string(GST_BUFFER_CAPS(buffer));
+            m_audioCaps = caps;
+            g_free(caps);
+            m_capsChanged = true;
 #ifdef GSTBUSMSG
             qDebug() << "Audio caps " << m_audioCaps;
 #endif
@@ -301,27 +646,51 @@ bool AVMuxEncode::newPipelines(SYNTRO_AVPARAMS *avParams)
 
     m_avParams = *avParams;
 
+    //  a new pipeline has to start at an IDR
+
+    m_videoSrcLock.lock();
+    m_videoSrcStop = false;
+    m_videoDropping = true;
+    m_videoIDRRequested = false;
+    m_videoSPS.clear();
+    m_videoPPS.clear();
+    m_videoSrcLock.unlock();
+
+    m_audioSrcLock.lock();
+    m_audioSrcStop = false;
+    m_audioSrcLock.unlock();
+
 //    printf("width=%d, height=%d, rate=%d\n", avParams->videoWidth, avParams->videoHeight, avParams->videoFramerate);
 //    printf("channels=%d, rate=%d, size=%d\n", avParams->audioChannels, avParams->audioSampleRate, avParams->audioSampleSize);
 
-    //  Construct the pipelines
+    //  Construct the pipelines. Native video doesn't need one
 
-    videoLaunch = g_strdup_printf(" appsrc name=videoSrc%d ! rtph264pay pt=96 ! queue ! appsink name=videoSink%d"
-                , m_slot, m_slot);
+    if (m_nativeVideo) {
+        m_videoSinkLock.lock();
+        m_videoPacketiser.reset();
+        m_videoSinkLock.unlock();
+    } else {
+        videoLaunch = g_strdup_printf(" appsrc name=videoSrc%d ! rtph264pay pt=96 ! queue ! appsink name=videoSink%d"
+                    , m_slot, m_slot);
 
-    m_videoPipeline = gst_parse_launch(videoLaunch, &error);
-    g_free(videoLaunch);
+        m_videoPipeline = gst_parse_launch(videoLaunch, &error);
+        g_free(videoLaunch);
 
-    if (error != NULL) {
-        g_print ("could not construct video pipeline: %s\n", error->message);
-        g_error_free (error);
-        m_videoPipeline = NULL;
-        return false;
+        if (error != NULL) {
+            g_print ("could not construct video pipeline: %s\n", error->message);
+            g_error_free (error);
+            m_videoPipeline = NULL;
+            return false;
+        }
     }
 
+    //  low latency mode sends a packet every m_audioPacketTime rather than once a second
+
+    qint64 audioPacketTime = (m_audioPacketTime > 0) ? (qint64)m_audioPacketTime * 1000000 : (qint64)1000000000;
+
     audioLaunch = g_strdup_printf (
-         " appsrc name=audioSrc%d ! voaacenc bitrate=%d ! rtpmp4apay pt=97 min-ptime=1000000000 ! appsink name=audioSink%d "
-             , m_slot, m_audioCompressionRate, m_slot);
+         " appsrc name=audioSrc%d ! voaacenc bitrate=%d ! rtpmp4apay pt=97 min-ptime=%lld ! appsink name=audioSink%d "
+             , m_slot, m_audioCompressionRate, (long long)audioPacketTime, m_slot);
 
     m_audioPipeline = gst_parse_launch(audioLaunch, &error);
     g_free(audioLaunch);
@@ -329,7 +698,8 @@ bool AVMuxEncode::newPipelines(SYNTRO_AVPARAMS *avParams)
     if (error != NULL) {
         g_print ("could not construct audio pipeline: %s\n", error->message);
         g_error_free (error);
-        gst_object_unref(m_videoPipeline);
+        if (m_videoPipeline != NULL)
+            gst_object_unref(m_videoPipeline);
         m_videoPipeline = NULL;
         m_audioPipeline = NULL;
         return false;
@@ -337,23 +707,25 @@ bool AVMuxEncode::newPipelines(SYNTRO_AVPARAMS *avParams)
 
     //  find the appsrcs and appsinks
 
-    gchar *videoSink = g_strdup_printf("videoSink%d", m_slot);
-    if ((m_appVideoSink = gst_bin_get_by_name (GST_BIN (m_videoPipeline), videoSink)) == NULL) {
-        g_printerr("Unable to find video appsink\n");
+    if (!m_nativeVideo) {
+        gchar *videoSink = g_strdup_printf("videoSink%d", m_slot);
+        if ((m_appVideoSink = gst_bin_get_by_name (GST_BIN (m_videoPipeline), videoSink)) == NULL) {
+            g_printerr("Unable to find video appsink\n");
+            g_free(videoSink);
+            deletePipelines();
+            return false;
+        }
         g_free(videoSink);
-        deletePipelines();
-        return false;
-    }
-    g_free(videoSink);
 
-    gchar *videoSrc = g_strdup_printf("videoSrc%d", m_slot);
-    if ((m_appVideoSrc = gst_bin_get_by_name (GST_BIN (m_videoPipeline), videoSrc)) == NULL) {
+        gchar *videoSrc = g_strdup_printf("videoSrc%d", m_slot);
+        if ((m_appVideoSrc = gst_bin_get_by_name (GST_BIN (m_videoPipeline), videoSrc)) == NULL) {
             g_printerr("Unable to find video appsrc\n");
             g_free(videoSrc);
             deletePipelines();
             return false;
         }
-    g_free(videoSrc);
+        g_free(videoSrc);
+    }
 
     gchar *audioSink = g_strdup_printf("audioSink%d", m_slot);
     if ((m_appAudioSink = gst_bin_get_by_name (GST_BIN (m_audioPipeline), audioSink)) == NULL) {
@@ -373,46 +745,59 @@ bool AVMuxEncode::newPipelines(SYNTRO_AVPARAMS *avParams)
         }
     g_free(audioSrc);
 
-    g_signal_connect (m_appVideoSink, "new-buffer", G_CALLBACK (newVideoSinkData), this);
-    gst_app_sink_set_emit_signals((GstAppSink *)(m_appVideoSink), TRUE);
-
     g_signal_connect (m_appAudioSink, "new-buffer", G_CALLBACK (newAudioSinkData), this);
     gst_app_sink_set_emit_signals((GstAppSink *)(m_appAudioSink), TRUE);
 
-    gst_app_src_set_caps((GstAppSrc *) (m_appVideoSrc),
-             gst_caps_new_simple ("video/x-h264",
-             "width", G_TYPE_INT, m_avParams.videoWidth,
-             "height", G_TYPE_INT, m_avParams.videoHeight,
-             NULL));
-    gst_app_src_set_stream_type((GstAppSrc *)(m_appVideoSrc), GST_APP_STREAM_TYPE_STREAM);
-    g_signal_connect(m_appVideoSrc, "need-data", G_CALLBACK (needVideoSrcData), this);
+    if (!m_nativeVideo) {
+        g_signal_connect (m_appVideoSink, "new-buffer", G_CALLBACK (newVideoSinkData), this);
+        gst_app_sink_set_emit_signals((GstAppSink *)(m_appVideoSink), TRUE);
+
+        GstCaps *videoSrcCaps = gst_caps_new_simple ("video/x-h264",
+                 "width", G_TYPE_INT, m_avParams.videoWidth,
+                 "height", G_TYPE_INT, m_avParams.videoHeight,
+                 NULL);
+        gst_app_src_set_caps((GstAppSrc *) (m_appVideoSrc), videoSrcCaps);
+        gst_caps_unref(videoSrcCaps);
+        gst_app_src_set_stream_type((GstAppSrc *)(m_appVideoSrc), GST_APP_STREAM_TYPE_STREAM);
+        g_signal_connect(m_appVideoSrc, "need-data", G_CALLBACK (needVideoSrcData), this);
+    }
+
+    //  the same caps are attached to every audio buffer so build them once
 
-    gst_app_src_set_caps((GstAppSrc *) (m_appAudioSrc),
-            gst_caps_new_simple ("audio/x-raw-int",
+    m_audioSrcCaps = gst_caps_new_simple ("audio/x-raw-int",
                       "width", G_TYPE_INT, (gint)m_avParams.audioSampleSize,
                       "depth", G_TYPE_INT, (gint)m_avParams.audioSampleSize,
                       "channels" ,G_TYPE_INT, (gint)m_avParams.audioChannels,
                       "rate",G_TYPE_INT, m_avParams.audioSampleRate,
                       "endianness",G_TYPE_INT,(gint)1234,
                       "signed", G_TYPE_BOOLEAN, (gboolean)TRUE,
-                      NULL));
+                      NULL);
+    gst_app_src_set_caps((GstAppSrc *) (m_appAudioSrc), m_audioSrcCaps);
+
+    //  100mS of silence to push when there is no audio
+
+    m_silence = QByteArray((m_avParams.audioSampleRate * (m_avParams.audioSampleSize / 8) * m_avParams.audioChannels) / 10, 0);
 
     gst_app_src_set_stream_type((GstAppSrc *)(m_appAudioSrc), GST_APP_STREAM_TYPE_STREAM);
     g_signal_connect(m_appAudioSrc, "need-data", G_CALLBACK (needAudioSrcData), this);
 
-    ret = gst_element_set_state (m_videoPipeline, GST_STATE_PLAYING);
-    if (ret == GST_STATE_CHANGE_FAILURE) {
-        g_printerr ("Unable to set the video pipeline to the play state.\n");
-        deletePipelines();
-        return false;
+    if (m_videoPipeline != NULL) {
+        ret = gst_element_set_state (m_videoPipeline, GST_STATE_PLAYING);
+        if (ret == GST_STATE_CHANGE_FAILURE) {
+            g_printerr ("Unable to set the video pipeline to the play state.\n");
+            deletePipelines();
+            return false;
+        }
     }
 
 #ifdef GSTBUSMSG
     GstBus *bus;
 
-    bus = gst_pipeline_get_bus(GST_PIPELINE (m_videoPipeline));
-    m_videoBusWatch = gst_bus_add_watch (bus, videoBusMessage, this);
-    gst_object_unref (bus);
+    if (m_videoPipeline != NULL) {
+        bus = gst_pipeline_get_bus(GST_PIPELINE (m_videoPipeline));
+        m_videoBusWatch = gst_bus_add_watch (bus, videoBusMessage, this);
+        gst_object_unref (bus);
+    }
 
     bus = gst_pipeline_get_bus(GST_PIPELINE (m_audioPipeline));
     m_audioBusWatch = gst_bus_add_watch (bus, audioBusMessage, this);
@@ -432,6 +817,20 @@ bool AVMuxEncode::newPipelines(SYNTRO_AVPARAMS *avParams)
 
 void AVMuxEncode::deletePipelines()
 {
+    m_pipelinesActive = false;
+
+    //  the video streaming thread may be blocked in needVideoData - let it go before stopping
+
+    m_videoSrcLock.lock();
+    m_videoSrcStop = true;
+    m_videoSrcCond.wakeAll();
+    m_videoSrcLock.unlock();
+
+    m_audioSrcLock.lock();
+    m_audioSrcStop = true;
+    m_audioSrcCond.wakeAll();
+    m_audioSrcLock.unlock();
+
     if (m_videoPipeline != NULL) {
         gst_element_set_state (m_videoPipeline, GST_STATE_NULL);
         gst_object_unref(m_videoPipeline);
@@ -458,26 +857,37 @@ void AVMuxEncode::deletePipelines()
     }
 #endif
 
-    if (m_videoCaps != NULL)
-        g_free(m_videoCaps);
-    if (m_audioCaps != NULL)
-        g_free(m_audioCaps);
-    m_videoCaps = NULL;
-    m_audioCaps = NULL;
+    //  native video packetises on the caller's thread so lock against it
+
+    m_videoSinkLock.lock();
+    m_videoCaps.clear();
+    while (!m_videoSinkQ.empty())
+        releaseQueueData(m_videoSinkQ.dequeue());
+    m_videoSinkLock.unlock();
+
+    m_audioSinkLock.lock();
+    m_audioCaps.clear();
+    m_audioFirstQueuedAt = -1;
+    m_audioSinkLock.unlock();
 
     m_appAudioSink = NULL;
     m_appAudioSrc = NULL;
     m_appVideoSink = NULL;
     m_appAudioSrc = NULL;
 
+    //  the pipelines are stopped so no buffer still refers to these
+
+    if (m_audioSrcCaps != NULL)
+        gst_caps_unref(m_audioSrcCaps);
+    m_audioSrcCaps = NULL;
+    m_silence.clear();
+
     while (!m_videoSrcQ.empty())
-        delete m_videoSrcQ.dequeue();
+        releaseQueueData(m_videoSrcQ.dequeue());
     while (!m_audioSrcQ.empty())
-        delete m_audioSrcQ.dequeue();
-    while (!m_videoSinkQ.empty())
-        delete m_videoSinkQ.dequeue();
+        releaseQueueData(m_audioSrcQ.dequeue());
     while (!m_audioSinkQ.empty())
-        delete m_audioSinkQ.dequeue();
+        releaseQueueData(m_audioSinkQ.dequeue());
 
     m_audioTimestamp = -1;
 }
@@ -485,33 +895,33 @@ void AVMuxEncode::deletePipelines()
 void AVMuxEncode::needVideoData()
 {
     GstFlowReturn ret;
-    GstBuffer *buffer;
-
-//    qDebug() << "need video";
-    while(1) {
-        m_videoSrcLock.lock();
-        if (!m_videoSrcQ.empty()) {
+    AVMUX_QUEUEDATA *qd;
 
-            AVMUX_QUEUEDATA *qd = m_videoSrcQ.dequeue();
-            QByteArray frame = qd->data;
-            m_lastQueuedVideoTimestamp = qd->timestamp;
-            m_lastQueuedVideoParam = qd->param;
-            delete qd;
+    //  block the streaming thread until newVideoData() has something rather than polling
 
-//            qDebug() << "pushing " << frame.length();
-            buffer = gst_buffer_new_and_alloc(frame.length());
-            memcpy(GST_BUFFER_DATA(buffer), (unsigned char *)frame.data(), frame.length());
-            ret = gst_app_src_push_buffer((GstAppSrc *)(m_appVideoSrc), buffer);
+    m_videoSrcLock.lock();
 
-            if (ret != GST_FLOW_OK)
-                qDebug() << "video push error ";
+    while (m_videoSrcQ.empty()) {
+        if (m_videoSrcStop) {
             m_videoSrcLock.unlock();
             return;
-        } else {
-            m_videoSrcLock.unlock();
-            msleep(10);
         }
+        m_videoSrcCond.wait(&m_videoSrcLock, AVMUX_NEED_DATA_WAIT);
     }
+
+    qd = m_videoSrcQ.dequeue();
+    m_lastQueuedVideoTimestamp = qd->timestamp;
+    m_lastQueuedVideoParam = qd->param;
+    m_videoLatencyTotal += m_latencyClock.nsecsElapsed() - qd->queuedAt;
+    m_videoLatencyCount++;
+    m_videoSrcLock.unlock();
+
+    //  the buffer owns qd from here
+
+    ret = gst_app_src_push_buffer((GstAppSrc *)(m_appVideoSrc), wrapQueueData(qd));
+
+    if (ret != GST_FLOW_OK)
+        qDebug() << "video push error ";
 }
 
 void AVMuxEncode::needAudioData()
@@ -519,35 +929,48 @@ void AVMuxEncode::needAudioData()
     GstFlowReturn ret;
     GstBuffer *buffer;
     quint64 audioLength;
-    QByteArray audio;
     qint64 duration;
+    AVMUX_QUEUEDATA *qd = NULL;
 
     m_audioSrcLock.lock();
-    if (m_audioSrcQ.empty()) {
-//        qDebug() << "Using dummy audio";
 
-        audioLength = (m_avParams.audioSampleRate *
-                (m_avParams.audioSampleSize / 8) *
-                m_avParams.audioChannels) / 10;
+    //  in low latency mode silence is never encoded - wait for real audio like the video does
 
-        buffer = gst_buffer_new_and_alloc(audioLength);
-        guint8 *ad = GST_BUFFER_DATA(buffer);
-        for (unsigned int i = 0; i < audioLength; i++)
-            ad[i] = 0;
-    } else {
-//        qDebug() << "Queue " << m_audioSrcQ.count();
-        AVMUX_QUEUEDATA *qd = m_audioSrcQ.dequeue();
-        QByteArray audio = qd->data;
+    while ((m_audioPacketTime > 0) && m_audioSrcQ.empty()) {
+        if (m_audioSrcStop) {
+            m_audioSrcLock.unlock();
+            return;
+        }
+        m_audioSrcCond.wait(&m_audioSrcLock, AVMUX_NEED_DATA_WAIT);
+    }
+
+    if (!m_audioSrcQ.empty()) {
+        qd = m_audioSrcQ.dequeue();
         m_lastQueuedAudioTimestamp = qd->timestamp;
         m_lastQueuedAudioParam = qd->param;
-        delete qd;
-
-        audioLength = audio.length();
-        buffer = gst_buffer_new_and_alloc(audio.length());
-        memcpy(GST_BUFFER_DATA(buffer), (unsigned char *)audio.data(), audio.length());
     }
     m_audioSrcLock.unlock();
 
+    if (qd != NULL) {
+        m_audioSinkLock.lock();
+        if (m_audioFirstQueuedAt == -1)
+            m_audioFirstQueuedAt = qd->queuedAt;
+        m_audioSinkLock.unlock();
+    }
+
+    if (qd != NULL) {
+        buffer = wrapQueueData(qd);
+    } else {
+        //  no free function - m_silence outlives the pipeline's buffers
+
+        buffer = gst_buffer_new();
+        GST_BUFFER_DATA(buffer) = (guint8 *)m_silence.constData();
+        GST_BUFFER_SIZE(buffer) = m_silence.length();
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_READONLY);
+    }
+
+    audioLength = GST_BUFFER_SIZE(buffer);
+
     guint64 bytesPerSecond = m_avParams.audioSampleRate *
                             (m_avParams.audioSampleSize / 8) *
                             m_avParams.audioChannels;
@@ -559,17 +982,7 @@ void AVMuxEncode::needAudioData()
 //    GST_BUFFER_TIMESTAMP(buffer) = m_audioTimestamp;
     m_audioTimestamp += duration;
 
-    GstCaps *caps = gst_caps_new_simple(
-                "audio/x-raw-int",
-                "width", G_TYPE_INT, (gint)m_avParams.audioSampleSize,
-                "depth", G_TYPE_INT, (gint)m_avParams.audioSampleSize,
-                "channels" ,G_TYPE_INT, (gint)m_avParams.audioChannels,
-                "rate",G_TYPE_INT,m_avParams.audioSampleRate,
-                "endianness",G_TYPE_INT,(gint)1234,
-                "signed", G_TYPE_BOOLEAN, (gboolean)TRUE,
-                NULL);
-
-    GST_BUFFER_CAPS(buffer) = caps;
+    gst_buffer_set_caps(buffer, m_audioSrcCaps);
 
     ret = gst_app_src_push_buffer((GstAppSrc *)(m_appAudioSrc), buffer);
     if (ret != GST_FLOW_OK) {
@@ -582,3 +995,19 @@ void AVMuxEncode::setAudioCompressionRate(int audioCompressionRate)
     m_audioCompressionRate = audioCompressionRate;
 }
 
+void AVMuxEncode::setAudioLowLatency(int packetTime, int dtxLevel)
+{
+    //  takes effect when the pipelines are next created
+
+    m_audioPacketTime = packetTime;
+    m_audioDTXLevel = dtxLevel;
+    m_audioHangover = 0;
+}
+
+void AVMuxEncode::setNativeVideo(bool nativeVideo)
+{
+    //  takes effect when the pipelines are next created
+
+    m_nativeVideo = nativeVideo;
+}
+
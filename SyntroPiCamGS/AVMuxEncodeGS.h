@@ -28,17 +28,46 @@
 #include <gst/app/gstappsrc.h>
 
 #include <qmutex.h>
+#include <qwaitcondition.h>
+#include <qelapsedtimer.h>
+
+#include "RTPPacketiser.h"
 
 #define AVMUXENCODE_INTERVAL  (SYNTRO_CLOCKS_PER_SEC / 50)
 
 #define AVMUX_VIDEO_QUEUE_MAX       2
 #define AVMUX_AUDIO_QUEUE_MAX       2
 
+//  max time in mS that need-data blocks before checking for pipeline shutdown
+
+#define AVMUX_NEED_DATA_WAIT        100
+
+//  max age in mS of the oldest compressed video waiting to be sent before the link counts as congested
+
+#define AVMUX_VIDEO_BACKLOG_MAX     500
+
+//  min interval in mS between IDR requests while waiting to resume
+
+#define AVMUX_IDR_REQUEST_INTERVAL  1000
+
+//  time in mS that quiet audio is still sent after speech so that word endings aren't clipped
+//  and the encoder is flushed with silence before audio is suppressed
+
+#define AVMUX_AUDIO_DTX_HANGOVER    300
+
+//  max number of free AVMUX_QUEUEDATA entries kept for reuse
+
+#define AVMUX_QUEUEDATA_POOL_MAX    16
+
+class AVMuxEncode;
+
 typedef struct
 {
     QByteArray data;
     qint64 timestamp;
     int param;
+    qint64 queuedAt;                                        // monotonic nS when queued - used to measure latency
+    AVMuxEncode *owner;                                     // pool to return to when a wrapping GstBuffer is freed
 } AVMUX_QUEUEDATA;
 
 class AVMuxEncode : public SyntroThread
@@ -48,12 +77,15 @@ class AVMuxEncode : public SyntroThread
 public:
     AVMuxEncode(int slot);
     void setAudioCompressionRate(int audioCompressionRate);
+    void setNativeVideo(bool nativeVideo);                  // packetise video here rather than with rtph264pay
+    void setAudioLowLatency(int packetTime, int dtxLevel);  // packetTime in mS, 0 for the original 1 second packets
 
     bool newPipelines(SYNTRO_AVPARAMS *avParams);
     bool pipelinesActive() { return m_pipelinesActive; }
     void deletePipelines();
-    gchar *getVideoCaps() { return m_videoCaps; }
-    gchar *getAudioCaps() { return m_audioCaps; }
+    QByteArray getVideoCaps();                              // empty until known
+    QByteArray getAudioCaps();
+    bool capsChanged();                                     // true once after either caps string changes
 
     void newVideoData(QByteArray videoData, qint64 timestamp, int param);
     void newAudioData(QByteArray audioData, qint64 timestamp, int param);
@@ -65,18 +97,27 @@ public:
     bool getCompressedVideo(QByteArray& videoData);
     bool getCompressedAudio(QByteArray& audioData);
 
+    double getVideoQueueLatency();                          // average uS from newVideoData to push since last call
+    int getVideoDropCount();                                // segments dropped since last call
+    void resyncVideo();                                     // drop until the next IDR and ask for one now
+    int getTimeToFirstPicture();                            // mS from the last resync to its IDR, -1 if none yet
+    double getAudioLatency();                               // average mS from newAudioData to RTP since last call
+    int getAudioSuppressedCount();                          // audio blocks suppressed by DTX since last call
+
     // gstreamer callbacks
 
     void processVideoSinkData();
     void processAudioSinkData();
     void needVideoData();
     void needAudioData();
+    void releaseQueueData(AVMUX_QUEUEDATA *qd);             // returns an entry to the pool
     GstElement *m_videoPipeline;
     GstElement *m_audioPipeline;
 
 public slots:
 
 signals:
+    void requestIDR();                                      // the encoder should send an IDR as soon as possible
 
 protected:
     void initThread();
@@ -84,6 +125,13 @@ protected:
     void finishThread();
 
 private:
+    AVMUX_QUEUEDATA *allocQueueData();
+    GstBuffer *wrapQueueData(AVMUX_QUEUEDATA *qd);
+    bool admitVideo(QByteArray& videoData);
+    void cacheVideoHeaders(const QByteArray& videoData);
+    void packetiseVideo(const QByteArray& videoData, qint64 timestamp, int param);
+    bool suppressAudio(const QByteArray& audioData);
+
     int m_timer;
 
     int m_slot;
@@ -104,18 +152,55 @@ private:
 
     QMutex m_videoSrcLock;
     QQueue <AVMUX_QUEUEDATA *> m_videoSrcQ;
+    QWaitCondition m_videoSrcCond;                          // signalled when m_videoSrcQ gets data
+    bool m_videoSrcStop;                                    // releases needVideoData when pipelines are deleted
+
+    QElapsedTimer m_latencyClock;
+    qint64 m_videoLatencyTotal;                             // nS, protected by m_videoSrcLock
+    int m_videoLatencyCount;
+
+    bool m_videoDropping;                                   // true if discarding until the next IDR - protected by m_videoSrcLock
+    bool m_videoIDRRequested;
+    qint64 m_lastIDRRequest;
+    int m_videoDropCount;
+    qint64 m_resyncStart;                                   // monotonic nS of the last resync, -1 once resolved
+    int m_timeToFirstPicture;
+
+    QByteArray m_videoSPS;                                  // latest SPS with start code - protected by m_videoSrcLock
+    QByteArray m_videoPPS;                                  // latest PPS with start code - protected by m_videoSrcLock
 
     QMutex m_audioSrcLock;
     QQueue <AVMUX_QUEUEDATA *> m_audioSrcQ;
+    QWaitCondition m_audioSrcCond;                          // signalled when m_audioSrcQ gets data in low latency mode
+    bool m_audioSrcStop;
+
+    int m_audioPacketTime;                                  // mS, 0 if not in low latency mode
+    int m_audioDTXLevel;                                    // peak sample level below which audio is silent, 0 for no DTX
+    int m_audioHangover;                                    // mS of quiet audio left to send before suppressing
+    int m_audioSuppressedCount;                             // protected by m_audioSrcLock
+    qint64 m_audioFirstQueuedAt;                            // queuedAt of the oldest audio not yet out of the pipeline,
+                                                            // -1 if none. Protected by m_audioSinkLock
+    qint64 m_audioLatencyTotal;                             // nS, protected by m_audioSinkLock
+    int m_audioLatencyCount;
 
     QMutex m_videoSinkLock;
     QQueue <AVMUX_QUEUEDATA *> m_videoSinkQ;
 
+    bool m_nativeVideo;                                     // true if m_videoPacketiser replaces the video pipeline
+    RTPH264Packetiser m_videoPacketiser;                    // protected by m_videoSinkLock
+
     QMutex m_audioSinkLock;
     QQueue <AVMUX_QUEUEDATA *> m_audioSinkQ;
 
-    gchar *m_videoCaps;
-    gchar *m_audioCaps;
+    QMutex m_poolLock;
+    QList<AVMUX_QUEUEDATA *> m_pool;                        // free entries
+
+    QByteArray m_videoCaps;                                 // protected by m_videoSinkLock
+    QByteArray m_audioCaps;                                 // protected by m_audioSinkLock
+    bool m_capsChanged;                                     // protected by m_videoSinkLock and m_audioSinkLock
+
+    GstCaps *m_audioSrcCaps;                                // attached to every audio buffer pushed
+    QByteArray m_silence;                                   // pushed when there is no audio
 
     gint m_videoBusWatch;
     gint m_audioBusWatch;
@@ -122,9 +122,23 @@ bool AudioDriver::loadSettings()
 
     emit audioFormat(m_audioSampleRate, m_audioChannels, AUDIO_FIXED_SIZE);
 
-    //  Make blocks last 100mS
+    settings->endGroup();
+
+    //  Make blocks last 100mS unless the stream wants short audio packets
+
+    settings->beginGroup(CAMCLIENT_STREAM_GROUP);
+
+    int blockTime = 100;
+
+    if (settings->value(CAMCLIENT_GS_AUDIO_LOW_LATENCY).toBool()) {
+        blockTime = settings->value(CAMCLIENT_GS_AUDIO_PACKET_TIME).toInt();
+        if (blockTime < 10)
+            blockTime = 10;
+        if (blockTime > 100)
+            blockTime = 100;
+    }
 
-    m_audioFramesPerBlock = m_audioSampleRate / 10;
+    m_audioFramesPerBlock = (m_audioSampleRate * blockTime) / 1000;
 
     m_bytesPerBlock = m_audioChannels * (AUDIO_FIXED_SIZE / 8) * m_audioFramesPerBlock;
 
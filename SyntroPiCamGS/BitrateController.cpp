@@ -0,0 +1,89 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "BitrateController.h"
+
+#include <qglobal.h>
+
+BitrateController::BitrateController()
+{
+    m_minRate = 250000;
+    m_maxRate = 1000000;
+    reset(m_maxRate);
+}
+
+void BitrateController::setLimits(int minRate, int maxRate)
+{
+    m_minRate = minRate;
+    m_maxRate = qMax(minRate, maxRate);
+    m_rate = qBound(m_minRate, m_rate, m_maxRate);
+}
+
+void BitrateController::reset(int rate)
+{
+    m_rate = qBound(m_minRate, rate, m_maxRate);
+    m_clearIntervals = 0;
+}
+
+bool BitrateController::update(int intervalMs, int bytesSent, int sendAttempts, int stalls, int drops)
+{
+    double stallFraction = 0;
+    double newRate = m_rate;
+
+    if (intervalMs <= 0)
+        return false;
+
+    if (sendAttempts > 0)
+        stallFraction = (double)stalls / (double)sendAttempts;
+
+    if ((drops > 0) || (stallFraction > BITRATE_STALL_CONGESTED)) {
+        //  aim under what actually got through, and always back off by at least the decrease factor
+
+        double achieved = ((double)bytesSent * 8.0 * 1000.0) / (double)intervalMs;
+
+        newRate = m_rate * BITRATE_DECREASE_FACTOR;
+        if ((achieved > 0) && ((achieved * BITRATE_HEADROOM) < newRate))
+            newRate = achieved * BITRATE_HEADROOM;
+        m_clearIntervals = 0;
+    } else if (stallFraction < BITRATE_STALL_CLEAR) {
+        if (++m_clearIntervals >= BITRATE_CLEAR_INTERVALS) {
+            newRate = m_rate * BITRATE_INCREASE_FACTOR;
+            m_clearIntervals = 0;
+        }
+    } else {
+        //  in between - hold where we are
+
+        m_clearIntervals = 0;
+    }
+
+    newRate = qBound((double)m_minRate, newRate, (double)m_maxRate);
+
+    //  hysteresis - ignore small changes unless they reach a limit
+
+    if ((qAbs(newRate - m_rate) < (m_rate * BITRATE_MIN_CHANGE)) &&
+            ((int)newRate != m_minRate) && ((int)newRate != m_maxRate))
+        return false;
+
+    if ((int)newRate == m_rate)
+        return false;
+
+    m_rate = (int)newRate;
+    return true;
+}
@@ -0,0 +1,68 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef BITRATECONTROLLER_H
+#define BITRATECONTROLLER_H
+
+//  Chooses the H.264 target bitrate from what the link actually achieved over each interval.
+//  Backs off quickly when congested and creeps back up only after the link has stayed clear
+//  for a while so that the encoder isn't retuned on every small fluctuation.
+
+//  fraction of sends blocked by clear to send above which the link counts as congested
+
+#define BITRATE_STALL_CONGESTED         0.2
+
+//  and below which it counts as clear
+
+#define BITRATE_STALL_CLEAR             0.05
+
+//  number of consecutive clear intervals before the rate is raised
+
+#define BITRATE_CLEAR_INTERVALS         5
+
+#define BITRATE_DECREASE_FACTOR         0.75            // multiplicative decrease when congested
+#define BITRATE_INCREASE_FACTOR         1.1             // step up when clear
+#define BITRATE_HEADROOM                0.9             // fraction of achieved throughput to aim for
+#define BITRATE_MIN_CHANGE              0.05            // changes smaller than this fraction aren't made
+
+class BitrateController
+{
+public:
+    BitrateController();
+
+    void setLimits(int minRate, int maxRate);
+    void reset(int rate);
+
+    //  called once per interval with the video bytes sent, how many sends were attempted and
+    //  how many of those were blocked, and the number of segments the encoder queue dropped.
+    //  Returns true if the target rate has changed
+
+    bool update(int intervalMs, int bytesSent, int sendAttempts, int stalls, int drops);
+
+    int getRate() { return m_rate; }
+
+private:
+    int m_minRate;
+    int m_maxRate;
+    int m_rate;
+    int m_clearIntervals;                                   // consecutive intervals without congestion
+};
+
+#endif // BITRATECONTROLLER_H
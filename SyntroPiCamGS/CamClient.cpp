@@ -21,6 +21,9 @@
 #include "CamClient.h"
 #include "SyntroUtils.h"
 #include "AVMuxEncodeGS.h"
+#include "MP4Recorder.h"
+
+#include <qdir.h>
 
 #include <qdebug.h>
 
@@ -31,9 +34,40 @@ CamClient::CamClient(QObject *)
     m_avmuxPort = -1;
     m_recordIndex = 0;
     m_encoder = NULL;
+    m_recorder = NULL;
     m_lastCapsSend = 0;
     m_videoByteCount = 0;
     m_audioByteCount = 0;
+    m_serviceActive = false;
+    m_capsPending = true;
+    m_encoderControl = NULL;
+    m_lastBitrateUpdate = 0;
+    m_rateBytes = 0;
+    m_rateSendAttempts = 0;
+    m_rateStalls = 0;
+    m_videoDropCount = 0;
+    m_motionEnabled = false;
+    m_sequenceState = CAMCLIENT_STATE_CONTINUOUS;
+    m_postrollStart = 0;
+    m_lastMotionTime = 0;
+    m_videoPrerollKeyStarts = 0;
+    m_lastPrerollNALType = -1;
+    m_generateLowRate = false;
+    m_avmuxPortLowRate = -1;
+    m_lowRateInterval = 0;
+    m_lastLowRateSend = 0;
+    m_lowRateActive = false;
+    m_lowRateCollecting = false;
+    m_lowRateHasIDR = false;
+    m_lowRateTimestamp = 0;
+    m_lastLowRateCapsSend = 0;
+    m_lowRateCapsPending = true;
+    m_pendingVideoBytes = 0;
+    m_generateMJPEG = false;
+    m_avmuxPortMJPEG = -1;
+    m_mjpegActive = false;
+    m_jpegTimestamp = 0;
+    memset(&m_mjpegParams, 0, sizeof(SYNTRO_AVPARAMS));
 
 
     QSettings *settings = SyntroUtils::getSettings();
@@ -46,6 +80,77 @@ CamClient::CamClient(QObject *)
     if (!settings->contains(CAMCLIENT_GS_AUDIO_RATE))
         settings->setValue(CAMCLIENT_GS_AUDIO_RATE, "64000");
 
+    if (!settings->contains(CAMCLIENT_GS_AUDIO_LOW_LATENCY))
+        settings->setValue(CAMCLIENT_GS_AUDIO_LOW_LATENCY, false);
+
+    if (!settings->contains(CAMCLIENT_GS_AUDIO_PACKET_TIME))
+        settings->setValue(CAMCLIENT_GS_AUDIO_PACKET_TIME, "40");
+
+    if (!settings->contains(CAMCLIENT_GS_AUDIO_DTX_LEVEL))
+        settings->setValue(CAMCLIENT_GS_AUDIO_DTX_LEVEL, "300");
+
+    if (!settings->contains(CAMCLIENT_GS_ADAPTIVE_RATE))
+        settings->setValue(CAMCLIENT_GS_ADAPTIVE_RATE, true);
+
+    if (!settings->contains(CAMCLIENT_GS_VIDEO_RATE_MIN))
+        settings->setValue(CAMCLIENT_GS_VIDEO_RATE_MIN, "250000");
+
+    if (!settings->contains(CAMCLIENT_GS_NATIVE_RTP))
+        settings->setValue(CAMCLIENT_GS_NATIVE_RTP, true);
+
+    if (!settings->contains(CAMCLIENT_GS_INTRAPERIOD))
+        settings->setValue(CAMCLIENT_GS_INTRAPERIOD, "0");
+
+    if (!settings->contains(CAMCLIENT_GENERATE_LOWRATE))
+        settings->setValue(CAMCLIENT_GENERATE_LOWRATE, false);
+
+    if (!settings->contains(CAMCLIENT_LOWRATE_INTERVAL))
+        settings->setValue(CAMCLIENT_LOWRATE_INTERVAL, "5000");
+
+    if (!settings->contains(CAMCLIENT_GENERATE_MJPEG))
+        settings->setValue(CAMCLIENT_GENERATE_MJPEG, false);
+
+    if (!settings->contains(CAMCLIENT_MJPEG_INTERVAL))
+        settings->setValue(CAMCLIENT_MJPEG_INTERVAL, "100");
+
+    if (!settings->contains(CAMCLIENT_MJPEG_QUALITY))
+        settings->setValue(CAMCLIENT_MJPEG_QUALITY, "85");
+
+    settings->endGroup();
+
+    settings->beginGroup(MP4RECORDER_GROUP);
+
+    if (!settings->contains(MP4RECORDER_ENABLE))
+        settings->setValue(MP4RECORDER_ENABLE, false);
+
+    if (!settings->contains(MP4RECORDER_DIRECTORY))
+        settings->setValue(MP4RECORDER_DIRECTORY, QDir::homePath() + "/recordings");
+
+    if (!settings->contains(MP4RECORDER_SEGMENT_LENGTH))
+        settings->setValue(MP4RECORDER_SEGMENT_LENGTH, "60");
+
+    if (!settings->contains(MP4RECORDER_MAX_SIZE))
+        settings->setValue(MP4RECORDER_MAX_SIZE, "2048");
+
+    settings->endGroup();
+
+    settings->beginGroup(CAMCLIENT_MOTION_GROUP);
+
+    if (!settings->contains(CAMCLIENT_MOTION_VECTORS))
+        settings->setValue(CAMCLIENT_MOTION_VECTORS, false);
+
+    if (!settings->contains(CAMCLIENT_MOTION_MIN_NOISE))
+        settings->setValue(CAMCLIENT_MOTION_MIN_NOISE, "2");
+
+    if (!settings->contains(CAMCLIENT_MOTION_MIN_DELTA))
+        settings->setValue(CAMCLIENT_MOTION_MIN_DELTA, "10");
+
+    if (!settings->contains(CAMCLIENT_MOTION_PREROLL))
+        settings->setValue(CAMCLIENT_MOTION_PREROLL, "4000");
+
+    if (!settings->contains(CAMCLIENT_MOTION_POSTROLL))
+        settings->setValue(CAMCLIENT_MOTION_POSTROLL, "2000");
+
     settings->endGroup();
 
     delete settings;
@@ -63,11 +168,16 @@ void CamClient::appClientInit()
 void CamClient::appClientExit()
 {
     m_encoder->exitThread();
+
+    if (m_recorder != NULL)
+        m_recorder->exitThread();
+    m_recorder = NULL;
 }
 
 void CamClient::appClientBackground()
 {
     processAVQueue();
+    processMJPEG();
 }
 
 void CamClient::appClientConnected()
@@ -76,16 +186,97 @@ void CamClient::appClientConnected()
 
 void CamClient::newVideo(QByteArray data)
 {
+    if (m_recorder != NULL)
+        m_recorder->newVideo(data, SyntroClock());
+
     if (m_encoder != NULL)
         m_encoder->newVideoData(data);
 }
 
+void CamClient::newMotionVectors(QByteArray data)
+{
+    //  called from the encoder callback once per frame - cheap enough to do here
+
+    QMutexLocker lock(&m_motionLock);
+
+    if (m_motionAnalyser.process((const unsigned char *)data.constData(), data.length()))
+        m_lastMotionTime = SyntroClock();
+}
+
+void CamClient::newJPEG(QByteArray data)
+{
+    //  only the latest frame is worth sending
+
+    QMutexLocker lock(&m_jpegLock);
+
+    m_jpegFrame = data;
+    m_jpegTimestamp = SyntroClock();
+}
+
 void CamClient::newAudio(QByteArray data)
 {
     if (m_encoder != NULL)
         m_encoder->newAudioData(data);
 }
 
+void CamClient::setEncoderControl(EncoderControl *encoderControl)
+{
+    QMutexLocker lock(&m_encoderControlLock);
+
+    m_encoderControl = encoderControl;
+}
+
+void CamClient::encoderRequestIDR()
+{
+    QMutexLocker lock(&m_encoderControlLock);
+
+    if (m_encoderControl != NULL)
+        m_encoderControl->requestIDR();
+}
+
+int CamClient::getTimeToFirstPicture()
+{
+    if (m_encoder == NULL)
+        return -1;
+
+    return m_encoder->getTimeToFirstPicture();
+}
+
+int CamClient::getVideoDropCount()
+{
+    int count;
+
+    QMutexLocker lock(&m_videoDropCountLock);
+
+    count = m_videoDropCount;
+    m_videoDropCount = 0;
+    return count;
+}
+
+double CamClient::getVideoQueueLatency()
+{
+    if (m_encoder == NULL)
+        return 0;
+
+    return m_encoder->getVideoQueueLatency();
+}
+
+double CamClient::getAudioLatency()
+{
+    if (m_encoder == NULL)
+        return 0;
+
+    return m_encoder->getAudioLatency();
+}
+
+int CamClient::getAudioSuppressedCount()
+{
+    if (m_encoder == NULL)
+        return 0;
+
+    return m_encoder->getAudioSuppressedCount();
+}
+
 int CamClient::getVideoByteCount()
 {
     int count;
@@ -112,90 +303,564 @@ int CamClient::getAudioByteCount()
 void CamClient::processAVQueue()
 {
     QByteArray data;
-
-    int videoLength, audioLength;
-    SYNTRO_UC4 lengthData;
-    QByteArray videoArray;
-    QByteArray audioArray;
-    int totalLength;
-    unsigned char *ptr;
+    qint64 timestamp;
+    QList<QByteArray> videoSegments;
+    QList<QByteArray> audioSegments;
     qint64 videoTimestamp;
     qint64 audioTimestamp;
-    int videoParam;
-    int audioParam;
+    int space;
+    qint64 now = SyntroClock();
 
     if (m_avmuxPort == -1)
         return;
 
+    processLowRate();
+
     if (!clientIsServiceActive(m_avmuxPort)) {             // just discard encoder queue
-        while (m_encoder->getCompressedVideo(data, videoTimestamp, videoParam))
+        m_serviceActive = false;
+        m_lastBitrateUpdate = 0;
+        while (dequeueVideoFrame(data, timestamp))
             ;
-        while (m_encoder->getCompressedAudio(data, audioTimestamp, audioParam))
+        while (dequeueAudioFrame(data, timestamp))
             ;
+        clearPending();
+        clearPreroll();
+
+        //  the MJPEG stream shares the motion sequence so it has to keep running. There's
+        //  no preroll to send so a sequence goes straight into motion.
+
+        if (m_mjpegActive) {
+            updateSequenceState(now);
+            if (m_sequenceState == CAMCLIENT_STATE_PREROLL)
+                m_sequenceState = CAMCLIENT_STATE_INSEQUENCE;
+        }
         return;
     }
 
     if (!m_encoder->pipelinesActive())
         return;
 
-    if (SyntroUtils::syntroTimerExpired(QDateTime::currentMSecsSinceEpoch(), m_lastCapsSend, CAMCLIENT_CAPS_INTERVAL)) {
-        sendCaps();
+    //  a new subscriber can't decode until it has the caps and an IDR so get both to it
+    //  now rather than at the next caps interval and intra period
+
+    if (!m_serviceActive) {
+        m_serviceActive = true;
+        m_capsPending = true;
+        m_encoder->resyncVideo();
+    }
+
+    if (m_encoder->capsChanged())
+        m_capsPending = true;
+
+    if (m_capsPending || SyntroUtils::syntroTimerExpired(QDateTime::currentMSecsSinceEpoch(), m_lastCapsSend, CAMCLIENT_CAPS_INTERVAL)) {
+        if (sendCaps(m_avmuxPort, true))
+            m_capsPending = false;
         m_lastCapsSend = QDateTime::currentMSecsSinceEpoch();
     }
 
-    if (clientClearToSend(m_avmuxPort)) {
+    m_rateSendAttempts++;
+    updateBitrate(now);
 
-        while (m_encoder->getCompressedVideo(data, videoTimestamp, videoParam)) {
-            SyntroUtils::convertIntToUC4(data.length(), lengthData);
-            videoArray.append((const char *)lengthData, 4);
-            videoArray.append(data);
-        }
-        videoLength = videoArray.length();
+    updateSequenceState(now);
+
+    //  nothing goes out while idle but the preroll has to keep up with the encoder.
+    //  Anything left pending is the tail of the postroll and no longer wanted.
+
+    if (m_sequenceState == CAMCLIENT_STATE_IDLE) {
+        clearPending();
+        bufferPreroll();
+        return;
+    }
+
+    if (!clientClearToSend(m_avmuxPort)) {
+        m_rateStalls++;
+        return;
+    }
+
+    if (m_sequenceState == CAMCLIENT_STATE_PREROLL) {
+        bufferPreroll();
+        sendPreroll();
+        return;
+    }
+
+    //  a burst is split into records of at most CAMCLIENT_AVMUX_RECORD_MAX bytes. Audio is
+    //  small and goes first so that it's never held up behind a large IDR.
+
+    do {
+        fillPending();
+
+        if (m_pendingVideo.empty() && m_pendingAudio.empty())
+            break;
+
+        videoSegments.clear();
+        audioSegments.clear();
+        videoTimestamp = -1;
+        audioTimestamp = -1;
+        space = CAMCLIENT_AVMUX_RECORD_MAX;
+
+        takeSegments(m_pendingAudio, audioSegments, space, audioTimestamp);
+        m_pendingVideoBytes -= takeSegments(m_pendingVideo, videoSegments, space, videoTimestamp);
+
+        sendAVRecord(m_avmuxPort, videoSegments, audioSegments, (videoTimestamp == -1) ? audioTimestamp : videoTimestamp,
+                     (m_sequenceState == CAMCLIENT_STATE_POSTROLL) ? SYNTRO_RECORDHEADER_PARAM_POSTROLL : SYNTRO_RECORDHEADER_PARAM_NORMAL);
+    } while (clientClearToSend(m_avmuxPort));
+}
+
+void CamClient::fillPending()
+{
+    CLIENT_QUEUEDATA qd;
+
+    //  only take what the next record can hold so that the rest of the backlog stays
+    //  in the encoder where it counts towards congestion
+
+    while ((m_pendingVideoBytes < CAMCLIENT_AVMUX_RECORD_MAX) && dequeueVideoFrame(qd.data, qd.timestamp)) {
+        m_pendingVideoBytes += qd.data.length() + 4;
+        m_pendingVideo.enqueue(qd);
+    }
+
+    while (dequeueAudioFrame(qd.data, qd.timestamp))
+        m_pendingAudio.enqueue(qd);
+}
+
+int CamClient::takeSegments(QQueue<CLIENT_QUEUEDATA>& queue, QList<QByteArray>& segments, int& space, qint64& timestamp)
+{
+    int taken = 0;
+
+    while (!queue.empty()) {
+        int length = queue.head().data.length() + 4;
+
+        //  a segment bigger than a whole record still has to go, just on its own
+
+        if ((length > space) && (space < CAMCLIENT_AVMUX_RECORD_MAX))
+            break;
+
+        CLIENT_QUEUEDATA qd = queue.dequeue();
+        segments.append(qd.data);
+        timestamp = qd.timestamp;
+        space -= length;
+        taken += length;
+    }
+    return taken;
+}
+
+void CamClient::clearPending()
+{
+    m_pendingVideo.clear();
+    m_pendingAudio.clear();
+    m_pendingVideoBytes = 0;
+}
+
+void CamClient::sendAVRecord(int servicePort, const QList<QByteArray>& videoSegments, const QList<QByteArray>& audioSegments,
+                             qint64 timestamp, int param)
+{
+    int videoLength = 0;
+    int audioLength = 0;
+    int totalLength;
+    unsigned char *ptr;
+
+    //  size everything first so the message is allocated once and the segments are
+    //  copied once, straight into it
+
+    for (int i = 0; i < videoSegments.count(); i++)
+        videoLength += videoSegments.at(i).length() + 4;
+
+    for (int i = 0; i < audioSegments.count(); i++)
+        audioLength += audioSegments.at(i).length() + 4;
+
+    totalLength = videoLength + audioLength;
+
+    if (totalLength == 0)
+        return;
+
+    SYNTRO_EHEAD *multiCast = clientBuildMessage(servicePort, sizeof(SYNTRO_RECORD_AVMUX) + totalLength);
+    SYNTRO_RECORD_AVMUX *avmux = (SYNTRO_RECORD_AVMUX *)(multiCast + 1);
+    SyntroUtils::avmuxHeaderInit(avmux, &m_avParams, param, m_recordIndex++, 0, videoLength, audioLength);
+    SyntroUtils::convertInt64ToUC8(timestamp, avmux->recordHeader.timestamp);
+
+    ptr = (unsigned char *)(avmux + 1);
+
+    for (int i = 0; i < videoSegments.count(); i++) {
+        const QByteArray& segment = videoSegments.at(i);
+        SyntroUtils::convertIntToUC4(segment.length(), ptr);
+        memcpy(ptr + 4, segment.constData(), segment.length());
+        ptr += segment.length() + 4;
+    }
+
+    for (int i = 0; i < audioSegments.count(); i++) {
+        const QByteArray& segment = audioSegments.at(i);
+        SyntroUtils::convertIntToUC4(segment.length(), ptr);
+        memcpy(ptr + 4, segment.constData(), segment.length());
+        ptr += segment.length() + 4;
+    }
+    clientSendMessage(servicePort, multiCast, sizeof(SYNTRO_RECORD_AVMUX) + totalLength, SYNTROLINK_MEDPRI);
+
+    //  the statistics and bitrate control are for the main stream
+
+    if (servicePort != m_avmuxPort)
+        return;
+
+    m_videoByteCountLock.lock();
+    m_videoByteCount += videoLength;
+    m_videoByteCountLock.unlock();
+    m_audioByteCountLock.lock();
+    m_audioByteCount += audioLength;
+    m_audioByteCountLock.unlock();
+
+    m_rateBytes += videoLength;
+}
+
+void CamClient::updateSequenceState(qint64 now)
+{
+    bool motion;
+
+    m_motionLock.lock();
+    motion = (m_lastMotionTime != 0) && !SyntroUtils::syntroTimerExpired(now, m_lastMotionTime, CAMCLIENT_MOTION_HOLD);
+    m_motionLock.unlock();
 
-        while (m_encoder->getCompressedAudio(data, audioTimestamp, audioParam)) {
-            SyntroUtils::convertIntToUC4(data.length(), lengthData);
-            audioArray.append((const char *)lengthData, 4);
-            audioArray.append(data);
+    switch (m_sequenceState) {
+    case CAMCLIENT_STATE_IDLE:
+        if (!motion)
+            break;
+
+        //  with nothing buffered the sequence has to wait for an IDR so ask for one now
+
+        if (m_videoPrerollQueue.empty())
+            m_encoder->resyncVideo();
+        m_sequenceState = CAMCLIENT_STATE_PREROLL;
+        break;
+
+    case CAMCLIENT_STATE_PREROLL:
+        //  sendPreroll() moves on to CAMCLIENT_STATE_INSEQUENCE when the queues are empty
+        break;
+
+    case CAMCLIENT_STATE_INSEQUENCE:
+        if (!motion) {
+            m_postrollStart = now;
+            m_sequenceState = CAMCLIENT_STATE_POSTROLL;
+        }
+        break;
+
+    case CAMCLIENT_STATE_POSTROLL:
+        if (motion) {
+            m_sequenceState = CAMCLIENT_STATE_INSEQUENCE;
+        } else if (SyntroUtils::syntroTimerExpired(now, m_postrollStart, m_postroll)) {
+            clearPreroll();
+            m_sequenceState = CAMCLIENT_STATE_IDLE;
         }
-        audioLength = audioArray.length();
+        break;
 
-        totalLength = videoLength + audioLength;
+    case CAMCLIENT_STATE_CONTINUOUS:
+        break;
+    }
+}
 
-        if (totalLength > 0) {
-            SYNTRO_EHEAD *multiCast = clientBuildMessage(m_avmuxPort, sizeof(SYNTRO_RECORD_AVMUX) + totalLength);
-            SYNTRO_RECORD_AVMUX *avmux = (SYNTRO_RECORD_AVMUX *)(multiCast + 1);
-            SyntroUtils::avmuxHeaderInit(avmux, &m_avParams, SYNTRO_RECORDHEADER_PARAM_NORMAL, m_recordIndex++, 0, videoLength, audioLength);
+void CamClient::bufferPreroll()
+{
+    QByteArray data;
+    qint64 timestamp;
+    bool start;
+    PREROLL *preroll;
 
-            if ((audioLength > 0) && (videoLength == 0)) {
-                SyntroUtils::convertInt64ToUC8(audioTimestamp, avmux->recordHeader.timestamp);
-            SyntroUtils::convertIntToUC2(audioParam, avmux->recordHeader.param);
-            } else {
-                SyntroUtils::convertInt64ToUC8(videoTimestamp, avmux->recordHeader.timestamp);
-                SyntroUtils::convertIntToUC2(videoParam, avmux->recordHeader.param);
-            }
+    while (dequeueVideoFrame(data, timestamp)) {
+        int type = RTPH264Packetiser::packetNALType(data, start);
 
-            ptr = (unsigned char *)(avmux + 1);
+        //  MMAL puts the SPS and PPS in front of every IDR so normally a GOP starts at the SPS
 
-            if (videoLength > 0) {
-                memcpy(ptr, videoArray.constData(), videoLength);
-                ptr += videoLength;
-            }
+        bool keyStart = start && ((type == H264_NAL_SPS) ||
+                                  ((type == H264_NAL_IDR) && (m_lastPrerollNALType != H264_NAL_PPS)));
+
+        if (start)
+            m_lastPrerollNALType = type;
+
+        //  the queue must start where a decoder can
+
+        if (m_videoPrerollQueue.empty() && !keyStart)
+            continue;
+
+        preroll = new PREROLL;
+        preroll->data = data;
+        preroll->timestamp = timestamp;
+        preroll->keyStart = keyStart;
+        m_videoPrerollQueue.enqueue(preroll);
+
+        if (!keyStart)
+            continue;
+
+        //  drop whole GOPs from the front while the next one still covers the preroll
+
+        m_videoPrerollKeyStarts++;
+
+        while (m_videoPrerollKeyStarts > 1) {
+            int next;
 
-            if (audioLength > 0) {
-                memcpy(ptr, audioArray.constData(), audioLength);
-                ptr += audioLength;
+            for (next = 1; next < m_videoPrerollQueue.count(); next++) {
+                if (m_videoPrerollQueue.at(next)->keyStart)
+                    break;
             }
-            clientSendMessage(m_avmuxPort, multiCast, sizeof(SYNTRO_RECORD_AVMUX) + totalLength, SYNTROLINK_MEDPRI);
 
-            m_videoByteCountLock.lock();
-            m_videoByteCount += videoLength;
-            m_videoByteCountLock.unlock();
-            m_audioByteCountLock.lock();
-            m_audioByteCount += audioLength;
-            m_audioByteCountLock.unlock();
+            if ((timestamp - m_videoPrerollQueue.at(next)->timestamp) < m_preroll)
+                break;
+
+            while (next-- > 0)
+                delete m_videoPrerollQueue.dequeue();
+            m_videoPrerollKeyStarts--;
+        }
+    }
+
+    while (dequeueAudioFrame(data, timestamp)) {
+        preroll = new PREROLL;
+        preroll->data = data;
+        preroll->timestamp = timestamp;
+        preroll->keyStart = true;
+        m_audioPrerollQueue.enqueue(preroll);
+    }
+
+    //  audio from before the first video is no use
+
+    if (!m_videoPrerollQueue.empty()) {
+        timestamp = m_videoPrerollQueue.head()->timestamp;
+        while (!m_audioPrerollQueue.empty() && (m_audioPrerollQueue.head()->timestamp < timestamp))
+            delete m_audioPrerollQueue.dequeue();
+    } else if (m_sequenceState == CAMCLIENT_STATE_IDLE) {
+        while (!m_audioPrerollQueue.empty())
+            delete m_audioPrerollQueue.dequeue();
+    }
+}
+
+void CamClient::sendPreroll()
+{
+    QList<QByteArray> videoSegments;
+    QList<QByteArray> audioSegments;
+    int videoLength = 0;
+    qint64 timestamp;
+    qint64 lastVideoTimestamp = 0;
+    PREROLL *preroll;
+
+    //  still waiting for the first IDR
+
+    if (m_videoPrerollQueue.empty())
+        return;
+
+    timestamp = m_videoPrerollQueue.head()->timestamp;
+
+    while (!m_videoPrerollQueue.empty() && (videoLength < CAMCLIENT_PREROLL_RECORD_MAX)) {
+        preroll = m_videoPrerollQueue.dequeue();
+        if (preroll->keyStart)
+            m_videoPrerollKeyStarts--;
+        videoSegments.append(preroll->data);
+        videoLength += preroll->data.length() + 4;
+        lastVideoTimestamp = preroll->timestamp;
+        delete preroll;
+    }
+
+    //  keep the audio in step with the video
+
+    while (!m_audioPrerollQueue.empty() &&
+           (m_videoPrerollQueue.empty() || (m_audioPrerollQueue.head()->timestamp <= lastVideoTimestamp))) {
+        preroll = m_audioPrerollQueue.dequeue();
+        audioSegments.append(preroll->data);
+        delete preroll;
+    }
+
+    sendAVRecord(m_avmuxPort, videoSegments, audioSegments, timestamp, SYNTRO_RECORDHEADER_PARAM_PREROLL);
+
+    if (m_videoPrerollQueue.empty())
+        m_sequenceState = CAMCLIENT_STATE_INSEQUENCE;
+}
+
+bool CamClient::dequeueVideoFrame(QByteArray& videoData, qint64& timestamp)
+{
+    int param;
+
+    if (!m_encoder->getCompressedVideo(videoData, timestamp, param))
+        return false;
+
+    //  every packet passes through here whatever happens to it on the main stream
+
+    if (m_generateLowRate)
+        selectLowRate(videoData, timestamp);
+    return true;
+}
+
+bool CamClient::dequeueAudioFrame(QByteArray& audioData, qint64& timestamp)
+{
+    int param;
+
+    if (!m_encoder->getCompressedAudio(audioData, timestamp, param))
+        return false;
+
+    if (m_recorder != NULL)
+        m_recorder->newAudio(audioData, timestamp);
+    return true;
+}
+
+void CamClient::selectLowRate(const QByteArray& packet, qint64 timestamp)
+{
+    bool start;
+    int type = RTPH264Packetiser::packetNALType(packet, start);
+    bool marker = (packet.length() > 1) && ((unsigned char)packet.at(1) & 0x80);
 
+    if (!m_lowRateActive)
+        return;
+
+    if (start) {
+        switch (type) {
+        case H264_NAL_SPS:
+            //  an IDR is coming - only take it if it's time for another
+
+            m_lowRateCollecting = SyntroUtils::syntroTimerExpired(timestamp, m_lastLowRateSend, m_lowRateInterval);
+            m_lowRateHasIDR = false;
+            m_lowRateAU.clear();
+            m_lowRateTimestamp = timestamp;
+            break;
+
+        case H264_NAL_IDR:
+            m_lowRateHasIDR = true;
+            break;
+
+        case H264_NAL_PPS:
+        case H264_NAL_SEI:
+            break;
+
+        default:
+            //  anything else after the IDR starts the next picture
+
+            if (m_lowRateCollecting && m_lowRateHasIDR)
+                sendLowRate();
+            m_lowRateCollecting = false;
+            break;
         }
     }
+
+    if (!m_lowRateCollecting)
+        return;
+
+    m_lowRateAU.append(packet);
+
+    //  the marker ends the picture so there is no need to wait for the next one
+
+    if (m_lowRateHasIDR && marker) {
+        sendLowRate();
+        m_lowRateCollecting = false;
+    }
+}
+
+void CamClient::sendLowRate()
+{
+    //  if the link can't take it just wait for the next IDR
+
+    if (clientClearToSend(m_avmuxPortLowRate)) {
+        sendAVRecord(m_avmuxPortLowRate, m_lowRateAU, QList<QByteArray>(), m_lowRateTimestamp, SYNTRO_RECORDHEADER_PARAM_NORMAL);
+        m_lastLowRateSend = m_lowRateTimestamp;
+    }
+    m_lowRateAU.clear();
+}
+
+void CamClient::processLowRate()
+{
+    if (!m_generateLowRate || (m_avmuxPortLowRate == -1))
+        return;
+
+    if (!clientIsServiceActive(m_avmuxPortLowRate)) {
+        m_lowRateActive = false;
+        m_lowRateCollecting = false;
+        m_lowRateAU.clear();
+        return;
+    }
+
+    //  a new subscriber gets the caps and the next IDR straight away
+
+    if (!m_lowRateActive) {
+        m_lowRateActive = true;
+        m_lowRateCapsPending = true;
+        m_lastLowRateSend = 0;
+        encoderRequestIDR();
+    }
+
+    if (m_lowRateCapsPending || SyntroUtils::syntroTimerExpired(QDateTime::currentMSecsSinceEpoch(), m_lastLowRateCapsSend, CAMCLIENT_CAPS_INTERVAL)) {
+        if (sendCaps(m_avmuxPortLowRate, false))
+            m_lowRateCapsPending = false;
+        m_lastLowRateCapsSend = QDateTime::currentMSecsSinceEpoch();
+    }
+}
+
+void CamClient::processMJPEG()
+{
+    QByteArray jpeg;
+    qint64 timestamp;
+
+    if (m_avmuxPortMJPEG == -1)
+        return;
+
+    m_jpegLock.lock();
+    jpeg = m_jpegFrame;
+    timestamp = m_jpegTimestamp;
+    m_jpegFrame.clear();
+    m_jpegLock.unlock();
+
+    m_mjpegActive = clientIsServiceActive(m_avmuxPortMJPEG);
+
+    if (!m_mjpegActive || jpeg.isEmpty() || (m_mjpegParams.videoWidth == 0))
+        return;
+
+    //  the motion sequence is shared with the H.264 stream. There's no MJPEG preroll so
+    //  frames only go once the sequence has started.
+
+    if (m_sequenceState == CAMCLIENT_STATE_IDLE)
+        return;
+
+    if (!clientClearToSend(m_avmuxPortMJPEG))
+        return;
+
+    int param = (m_sequenceState == CAMCLIENT_STATE_POSTROLL) ? SYNTRO_RECORDHEADER_PARAM_POSTROLL : SYNTRO_RECORDHEADER_PARAM_NORMAL;
+
+    SYNTRO_EHEAD *multiCast = clientBuildMessage(m_avmuxPortMJPEG, sizeof(SYNTRO_RECORD_AVMUX) + jpeg.size());
+    SYNTRO_RECORD_AVMUX *avHead = (SYNTRO_RECORD_AVMUX *)(multiCast + 1);
+    SyntroUtils::avmuxHeaderInit(avHead, &m_mjpegParams, param, m_recordIndex++, 0, jpeg.size(), 0);
+    SyntroUtils::convertInt64ToUC8(timestamp, avHead->recordHeader.timestamp);
+    memcpy((unsigned char *)(avHead + 1), jpeg.constData(), jpeg.size());
+    clientSendMessage(m_avmuxPortMJPEG, multiCast, sizeof(SYNTRO_RECORD_AVMUX) + jpeg.size(), SYNTROLINK_MEDPRI);
+}
+
+void CamClient::clearPreroll()
+{
+    while (!m_videoPrerollQueue.empty())
+        delete m_videoPrerollQueue.dequeue();
+
+    while (!m_audioPrerollQueue.empty())
+        delete m_audioPrerollQueue.dequeue();
+
+    m_videoPrerollKeyStarts = 0;
+    m_lastPrerollNALType = -1;
+}
+
+void CamClient::updateBitrate(qint64 now)
+{
+    qint64 interval = now - m_lastBitrateUpdate;
+
+    if (interval < CAMCLIENT_BITRATE_INTERVAL)
+        return;
+
+    int drops = m_encoder->getVideoDropCount();
+
+    m_videoDropCountLock.lock();
+    m_videoDropCount += drops;
+    m_videoDropCountLock.unlock();
+
+    //  the first interval after going active has no history to go on
+
+    if (m_adaptiveRate && (m_lastBitrateUpdate != 0) &&
+            m_bitrateController.update(interval, m_rateBytes, m_rateSendAttempts, m_rateStalls, drops)) {
+        QMutexLocker lock(&m_encoderControlLock);
+
+        if (m_encoderControl != NULL)
+            m_encoderControl->setBitrate(m_bitrateController.getRate());
+    }
+
+    m_lastBitrateUpdate = now;
+    m_rateBytes = 0;
+    m_rateSendAttempts = 0;
+    m_rateStalls = 0;
 }
 
 
@@ -207,10 +872,22 @@ void CamClient::newStream()
         clientRemoveService(m_avmuxPort);
     m_avmuxPort = -1;
 
+    if (m_avmuxPortLowRate != -1)
+        clientRemoveService(m_avmuxPortLowRate);
+    m_avmuxPortLowRate = -1;
+
+    if (m_avmuxPortMJPEG != -1)
+        clientRemoveService(m_avmuxPortMJPEG);
+    m_avmuxPortMJPEG = -1;
+
     if (m_encoder != NULL)
         m_encoder->exitThread();
     m_encoder = NULL;
 
+    if (m_recorder != NULL)
+        m_recorder->exitThread();
+    m_recorder = NULL;
+
     // and start the new streams
 
     QSettings *settings = SyntroUtils::getSettings();
@@ -219,19 +896,66 @@ void CamClient::newStream()
 
     m_compressedVideoRate = settings->value(CAMCLIENT_GS_VIDEO_RATE).toInt();
     m_compressedAudioRate = settings->value(CAMCLIENT_GS_AUDIO_RATE).toInt();
+    m_nativeRTP = settings->value(CAMCLIENT_GS_NATIVE_RTP).toBool();
+    m_audioLowLatency = settings->value(CAMCLIENT_GS_AUDIO_LOW_LATENCY).toBool();
+    m_audioPacketTime = settings->value(CAMCLIENT_GS_AUDIO_PACKET_TIME).toInt();
+    m_audioDTXLevel = settings->value(CAMCLIENT_GS_AUDIO_DTX_LEVEL).toInt();
+    m_adaptiveRate = settings->value(CAMCLIENT_GS_ADAPTIVE_RATE).toBool();
+    m_bitrateController.setLimits(settings->value(CAMCLIENT_GS_VIDEO_RATE_MIN).toInt(), m_compressedVideoRate);
     m_avmuxPort = clientAddService(SYNTRO_STREAMNAME_AVMUX, SERVICETYPE_MULTICAST, true);
 
+    m_generateLowRate = settings->value(CAMCLIENT_GENERATE_LOWRATE).toBool();
+    m_lowRateInterval = settings->value(CAMCLIENT_LOWRATE_INTERVAL).toInt();
+    if (m_generateLowRate)
+        m_avmuxPortLowRate = clientAddService(SYNTRO_STREAMNAME_AVMUXLR, SERVICETYPE_MULTICAST, true);
+    m_lowRateActive = false;
+    m_lowRateCollecting = false;
+
+    //  the camera driver reads the same setting to decide whether to add the JPEG encoder
+
+    m_generateMJPEG = settings->value(CAMCLIENT_GENERATE_MJPEG).toBool();
+    if (m_generateMJPEG)
+        m_avmuxPortMJPEG = clientAddService(CAMCLIENT_STREAMNAME_MJPEG, SERVICETYPE_MULTICAST, true);
+    m_mjpegActive = false;
+
     settings->endGroup();
 
     m_gotAudioFormat = false;
     m_gotVideoFormat = false;
 
+    settings->beginGroup(CAMCLIENT_MOTION_GROUP);
+
+    m_motionEnabled = settings->value(CAMCLIENT_MOTION_VECTORS).toBool();
+    m_preroll = settings->value(CAMCLIENT_MOTION_PREROLL).toInt();
+    m_postroll = settings->value(CAMCLIENT_MOTION_POSTROLL).toInt();
+
+    m_motionLock.lock();
+    m_motionAnalyser.setThresholds(settings->value(CAMCLIENT_MOTION_MIN_NOISE).toInt(),
+                                   settings->value(CAMCLIENT_MOTION_MIN_DELTA).toInt());
+    m_lastMotionTime = 0;
+    m_motionLock.unlock();
+
+    settings->endGroup();
+
+    settings->beginGroup(MP4RECORDER_GROUP);
+
+    if (settings->value(MP4RECORDER_ENABLE).toBool()) {
+        m_recorder = new MP4Recorder();
+        m_recorder->resumeThread();
+    }
+
+    settings->endGroup();
+
     delete settings;
 
+    clearPreroll();
+    m_sequenceState = m_motionEnabled ? CAMCLIENT_STATE_IDLE : CAMCLIENT_STATE_CONTINUOUS;
+
     m_avParams.avmuxSubtype = SYNTRO_RECORD_TYPE_AVMUX_RTP;
     m_avParams.videoSubtype = SYNTRO_RECORD_TYPE_VIDEO_RTPH264;
     m_avParams.audioSubtype = SYNTRO_RECORD_TYPE_AUDIO_RTPAAC;
     m_encoder = new AVMuxEncode(0);
+    connect(m_encoder, SIGNAL(requestIDR()), this, SLOT(encoderRequestIDR()), Qt::DirectConnection);
     m_encoder->resumeThread();
 }
 
@@ -241,6 +965,16 @@ void CamClient::videoFormat(int width, int height, int framerate)
     m_avParams.videoHeight = height;
     m_avParams.videoFramerate = framerate;
     m_gotVideoFormat = true;
+
+    m_mjpegParams = m_avParams;
+    m_mjpegParams.avmuxSubtype = SYNTRO_RECORD_TYPE_AVMUX_MJPPCM;
+    m_mjpegParams.videoSubtype = SYNTRO_RECORD_TYPE_VIDEO_MJPEG;
+    m_mjpegParams.audioSubtype = SYNTRO_RECORD_TYPE_AUDIO_PCM;
+
+    m_motionLock.lock();
+    m_motionAnalyser.setFrameSize(width, height);
+    m_motionLock.unlock();
+
     establishPipelines();
 }
 
@@ -259,34 +993,49 @@ void CamClient::establishPipelines()
         return;
     m_encoder->deletePipelines();
     m_encoder->setAudioCompressionRate(m_compressedAudioRate);
+    m_encoder->setNativeVideo(m_nativeRTP);
+    m_encoder->setAudioLowLatency(m_audioLowLatency ? m_audioPacketTime : 0, m_audioDTXLevel);
+
+    //  the camera has just been (re)opened at the configured rate
+
+    m_bitrateController.reset(m_compressedVideoRate);
     m_encoder->newPipelines(&m_avParams);
+
+    if (m_recorder != NULL)
+        m_recorder->setFormat(m_avParams.videoWidth, m_avParams.videoHeight,
+                              m_avParams.audioSampleRate, m_avParams.audioChannels);
 }
 
 
-void CamClient::sendCaps()
+bool CamClient::sendCaps(int servicePort, bool withAudio)
 {
-    if (!clientIsServiceActive(m_avmuxPort) || !clientClearToSend(m_avmuxPort))
-        return;
+    if (!clientIsServiceActive(servicePort) || !clientClearToSend(servicePort))
+        return false;
 
-    gchar *videoCaps = m_encoder->getVideoCaps();
-    gchar *audioCaps = m_encoder->getAudioCaps();
+    QByteArray videoCaps = m_encoder->getVideoCaps();
+    QByteArray audioCaps;
+
+    if (withAudio)
+        audioCaps = m_encoder->getAudioCaps();
 
     int videoLength = 0;
     int audioLength = 0;
     int totalLength = 0;
 
-    if (videoCaps != NULL)
-        videoLength = strlen(videoCaps) + 1;
+    //  the caps strings are sent with their terminating zeros
+
+    if (!videoCaps.isEmpty())
+        videoLength = videoCaps.length() + 1;
 
-    if (audioCaps != NULL)
-        audioLength = strlen(audioCaps) + 1;
+    if (!audioCaps.isEmpty())
+        audioLength = audioCaps.length() + 1;
 
     totalLength = videoLength + audioLength;
 
     if (totalLength == 0)
-        return;
+        return false;
 
-    SYNTRO_EHEAD *multiCast = clientBuildMessage(m_avmuxPort, sizeof(SYNTRO_RECORD_AVMUX) + totalLength);
+    SYNTRO_EHEAD *multiCast = clientBuildMessage(servicePort, sizeof(SYNTRO_RECORD_AVMUX) + totalLength);
     SYNTRO_RECORD_AVMUX *avmux = (SYNTRO_RECORD_AVMUX *)(multiCast + 1);
     SyntroUtils::avmuxHeaderInit(avmux, &m_avParams, SYNTRO_RECORDHEADER_PARAM_NORMAL, m_recordIndex++, 0, videoLength, audioLength);
     avmux->videoSubtype = SYNTRO_RECORD_TYPE_VIDEO_RTPCAPS;
@@ -295,16 +1044,17 @@ void CamClient::sendCaps()
     unsigned char *ptr = (unsigned char *)(avmux + 1);
 
     if (videoLength > 0) {
-        memcpy(ptr, videoCaps, videoLength);
+        memcpy(ptr, videoCaps.constData(), videoLength);
         ptr += videoLength;
     }
 
     if (audioLength > 0) {
-        memcpy(ptr, audioCaps, audioLength);
+        memcpy(ptr, audioCaps.constData(), audioLength);
         ptr += audioLength;
     }
 
-    clientSendMessage(m_avmuxPort, multiCast, sizeof(SYNTRO_RECORD_AVMUX) + totalLength, SYNTROLINK_MEDPRI);
- }
+    clientSendMessage(servicePort, multiCast, sizeof(SYNTRO_RECORD_AVMUX) + totalLength, SYNTROLINK_MEDPRI);
+    return videoLength > 0;
+}
 
 
@@ -23,6 +23,9 @@
 #include <qmutex.h>
 
 #include "SyntroLib.h"
+#include "EncoderControl.h"
+#include "BitrateController.h"
+#include "MotionVectorAnalyser.h"
 
 
 //  Settings keys
@@ -52,8 +55,109 @@
 #define CAMCLIENT_GS_VIDEO_RATE           "GSVideoRate"
 #define CAMCLIENT_GS_AUDIO_RATE           "GSAudioRate"
 
+// true for short audio packets and no encoded silence, for intercom use
+
+#define CAMCLIENT_GS_AUDIO_LOW_LATENCY    "GSAudioLowLatency"
+
+// audio packet time in mS in low latency mode. The audio driver block size matches it
+
+#define CAMCLIENT_GS_AUDIO_PACKET_TIME    "GSAudioPacketTime"
+
+// peak 16 bit sample level below which audio is suppressed in low latency mode. 0 sends everything
+
+#define CAMCLIENT_GS_AUDIO_DTX_LEVEL      "GSAudioDTXLevel"
+
+// true to adjust the video bitrate to the link. GSVideoRate is the ceiling
+
+#define CAMCLIENT_GS_ADAPTIVE_RATE        "GSAdaptiveRate"
+
+// lowest video bitrate the adaptive control will go to
+
+#define CAMCLIENT_GS_VIDEO_RATE_MIN       "GSVideoRateMin"
+
+#define CAMCLIENT_BITRATE_INTERVAL        1000              // interval between bitrate adjustments
+
+// frames between IDRs. 0 leaves it to the encoder
+
+#define CAMCLIENT_GS_INTRAPERIOD          "GSIntraPeriod"
+
+// true to publish a low rate stream made of IDR pictures picked from the main stream
+
+#define CAMCLIENT_GENERATE_LOWRATE        "GenerateLowRate"
+
+// min interval in mS between IDRs on the low rate stream
+
+#define CAMCLIENT_LOWRATE_INTERVAL        "LowRateInterval"
+
+// true to packetise H.264 directly rather than with a GStreamer rtph264pay pipeline
+
+#define CAMCLIENT_GS_NATIVE_RTP           "GSNativeRTP"
+
+// true to publish an MJPEG stream from a JPEG encoder sharing the camera with the H.264 encoder
+
+#define CAMCLIENT_GENERATE_MJPEG          "GenerateMJPEG"
+
+// min interval in mS between MJPEG frames. Frames in between never reach the JPEG encoder
+
+#define CAMCLIENT_MJPEG_INTERVAL          "MJPEGInterval"
+
+// JPEG quality factor (1 - 100) for the MJPEG stream
+
+#define CAMCLIENT_MJPEG_QUALITY           "MJPEGQuality"
+
+// service name for the MJPEG stream
+
+#define CAMCLIENT_STREAMNAME_MJPEG        "avmuxmjpeg"
+
 #define CAMCLIENT_CAPS_INTERVAL           5000              // interval between caps sends
 
+//----------------------------------------------------------
+//	Motion group
+
+// group name for motion detection entries
+
+#define	CAMCLIENT_MOTION_GROUP            "MotionGroup"
+
+// true to gate the stream on the encoder's motion vectors. false means always send
+
+#define CAMCLIENT_MOTION_VECTORS          "MotionVectors"
+
+// vector length in pixels that counts a macroblock as moving
+
+#define	CAMCLIENT_MOTION_MIN_NOISE        "MotionMinNoise"
+
+// number of moving macroblocks that counts as motion
+
+#define	CAMCLIENT_MOTION_MIN_DELTA        "MotionMinDelta"
+
+//  length of preroll in mS. The preroll always starts on an IDR so may be up to a GOP longer
+
+#define CAMCLIENT_MOTION_PREROLL          "MotionPreroll"
+
+// length of postroll in mS
+
+#define CAMCLIENT_MOTION_POSTROLL         "MotionPostroll"
+
+// time in mS after the last frame with motion that a sequence is still considered in motion
+
+#define CAMCLIENT_MOTION_HOLD             250
+
+// max bytes of video and audio in one avmux record so a burst is split rather than sent as one huge message
+
+#define CAMCLIENT_AVMUX_RECORD_MAX        (128 * 1024)
+
+// max bytes of preroll sent in one record so the catch up doesn't starve everything else
+
+#define CAMCLIENT_PREROLL_RECORD_MAX      65536
+
+// These defines are for the motion sequence state machine
+
+#define CAMCLIENT_STATE_IDLE         0               // waiting for a motion event
+#define CAMCLIENT_STATE_PREROLL      1               // sending preroll saved frames from the queue
+#define CAMCLIENT_STATE_INSEQUENCE   2               // sending frames as normal during motion sequence
+#define CAMCLIENT_STATE_POSTROLL     3               // sending the postroll frames
+#define CAMCLIENT_STATE_CONTINUOUS   4               // no motion detect so continuous sending
+
 
 #define	CAMERA_IMAGE_INTERVAL	((qint64)SYNTRO_CLOCKS_PER_SEC/40)
 
@@ -64,7 +168,15 @@ typedef struct
     qint64 timestamp;                                       // the timestamp
 } CLIENT_QUEUEDATA;
 
+typedef struct
+{
+    QByteArray data;                                        // an RTP packet
+    qint64 timestamp;                                       // the timestamp
+    bool keyStart;                                          // true if a decoder can start here
+} PREROLL;
+
 class AVMuxEncode;
+class MP4Recorder;
 
 class CamClient : public Endpoint
 {
@@ -75,14 +187,25 @@ public:
     virtual ~CamClient();
     int getVideoByteCount();
     int getAudioByteCount();
+    double getVideoQueueLatency();
+    int getVideoDropCount();
+    int getTimeToFirstPicture();
+    double getAudioLatency();
+    int getAudioSuppressedCount();
+    void setEncoderControl(EncoderControl *encoderControl);
 
 public slots:
 	void newStream();
     void newVideo(QByteArray);
+    void newMotionVectors(QByteArray);
+    void newJPEG(QByteArray);
     void newAudio(QByteArray);
     void videoFormat(int width, int height, int framerate);
     void audioFormat(int sampleRate, int channels, int sampleSize);
 
+private slots:
+    void encoderRequestIDR();
+
 protected:
 	void appClientInit();
 	void appClientExit();
@@ -92,10 +215,28 @@ protected:
 
 private:
     void processAVQueue();                                  // processes the compressed video and audio data
+    void sendAVRecord(int servicePort, const QList<QByteArray>& videoSegments, const QList<QByteArray>& audioSegments,
+                      qint64 timestamp, int param);         // sends the segments length prefixed as one record
+    void fillPending();                                     // tops up the pending queues from the encoder
+    int takeSegments(QQueue<CLIENT_QUEUEDATA>& queue, QList<QByteArray>& segments,
+                     int& space, qint64& timestamp);        // moves as many segments as fit, returns bytes taken
+    void clearPending();
+    void selectLowRate(const QByteArray& packet, qint64 timestamp); // picks IDRs out for the low rate stream
+    void processLowRate();
+    void sendLowRate();
+    void processMJPEG();                                    // sends the latest JPEG on the MJPEG stream
+    void updateSequenceState(qint64 now);                   // runs the motion sequence state machine
+    void bufferPreroll();                                   // moves the encoder output to the preroll queues
+    void sendPreroll();                                     // sends the next part of the preroll
+    void clearPreroll();
 
     bool dequeueVideoFrame(QByteArray& videoData, qint64& timestamp);
     bool dequeueAudioFrame(QByteArray& audioData, qint64& timestamp);
 
+    QQueue<CLIENT_QUEUEDATA> m_pendingVideo;                // taken from the encoder but not yet sent
+    QQueue<CLIENT_QUEUEDATA> m_pendingAudio;
+    int m_pendingVideoBytes;                                // length of m_pendingVideo including prefixes
+
     int m_videoByteCount;
     QMutex m_videoByteCountLock;
 
@@ -111,13 +252,70 @@ private:
 
     int m_compressedVideoRate;
     int m_compressedAudioRate;
+    bool m_nativeRTP;
+    bool m_audioLowLatency;
+    int m_audioPacketTime;
+    int m_audioDTXLevel;
+
+    bool m_adaptiveRate;
+    BitrateController m_bitrateController;
+    qint64 m_lastBitrateUpdate;
+    int m_rateBytes;                                        // video bytes sent in this bitrate interval
+    int m_rateSendAttempts;                                 // passes with the service active
+    int m_rateStalls;                                       // passes blocked by clear to send
+
+    int m_videoDropCount;
+    QMutex m_videoDropCountLock;
+
+    bool m_serviceActive;                                   // the avmux service had subscribers at the last check
+
+    bool m_motionEnabled;
+    qint64 m_preroll;                                       // length in mS of preroll
+    qint64 m_postroll;                                      // length in mS of postroll
+    int m_sequenceState;                                    // the state of the motion sequence state machine
+    qint64 m_postrollStart;                                 // time that the postroll started
+
+    MotionVectorAnalyser m_motionAnalyser;                  // protected by m_motionLock
+    qint64 m_lastMotionTime;                                // last frame with motion
+    QMutex m_motionLock;
+
+    QQueue<PREROLL *> m_videoPrerollQueue;                  // always starts at a key start
+    QQueue<PREROLL *> m_audioPrerollQueue;
+    int m_videoPrerollKeyStarts;                            // number of key starts in m_videoPrerollQueue
+    int m_lastPrerollNALType;
+
+    EncoderControl *m_encoderControl;
+    QMutex m_encoderControlLock;
 
     AVMuxEncode *m_encoder;
+    MP4Recorder *m_recorder;                                // NULL unless recording locally
 
     void establishPipelines();
-    void sendCaps();
+    bool sendCaps(int servicePort, bool withAudio);         // returns true if the video caps were sent
+    void updateBitrate(qint64 now);                         // feeds the link statistics to the bitrate controller
 
     qint64 m_lastCapsSend;
+    bool m_capsPending;                                     // send caps as soon as they are available
+
+    bool m_generateLowRate;
+    int m_avmuxPortLowRate;                                 // the local port assigned to the low rate service
+    qint64 m_lowRateInterval;
+    qint64 m_lastLowRateSend;                               // when the last IDR was sent on the low rate stream
+    bool m_lowRateActive;                                   // the low rate service had subscribers at the last check
+    bool m_lowRateCollecting;                               // m_lowRateAU is being filled
+    bool m_lowRateHasIDR;
+    QList<QByteArray> m_lowRateAU;                          // packets of the access unit
+    qint64 m_lowRateTimestamp;
+    qint64 m_lastLowRateCapsSend;
+    bool m_lowRateCapsPending;
+
+    bool m_generateMJPEG;
+    int m_avmuxPortMJPEG;                                   // the local port assigned to the MJPEG service
+    bool m_mjpegActive;                                     // the MJPEG service had subscribers at the last check
+    SYNTRO_AVPARAMS m_mjpegParams;                          // m_avParams with the MJPPCM subtypes
+    QByteArray m_jpegFrame;                                 // latest JPEG not yet sent - protected by m_jpegLock
+    qint64 m_jpegTimestamp;
+    QMutex m_jpegLock;
 
 };
 
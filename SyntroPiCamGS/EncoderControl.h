@@ -0,0 +1,36 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef ENCODERCONTROL_H
+#define ENCODERCONTROL_H
+
+//  Requests from the streaming side to whatever is producing the H.264. VideoDriver implements
+//  this for the MMAL encoder. Implementations must be safe to call from any thread.
+
+class EncoderControl
+{
+public:
+    virtual ~EncoderControl() {}
+
+    virtual void requestIDR() = 0;                          // make the next picture an IDR
+    virtual void setBitrate(int bitrate) = 0;               // change the target bitrate in bits per second
+};
+
+#endif // ENCODERCONTROL_H
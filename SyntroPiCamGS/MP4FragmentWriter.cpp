@@ -0,0 +1,518 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "MP4FragmentWriter.h"
+
+//  trun sample flags for sync and non sync samples
+
+#define MP4_SAMPLE_FLAGS_SYNC           0x02000000
+#define MP4_SAMPLE_FLAGS_NON_SYNC       0x01010000
+
+//  tfhd default-base-is-moof and the trun fields used here
+
+#define MP4_TFHD_BASE_IS_MOOF           0x020000
+#define MP4_TRUN_DATA_OFFSET            0x000001
+#define MP4_TRUN_DURATION               0x000100
+#define MP4_TRUN_SIZE                   0x000200
+#define MP4_TRUN_FLAGS                  0x000400
+
+static const int aacSampleRates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000,
+                                     22050, 16000, 12000, 11025, 8000, 7350, 0};
+
+static void put8(QByteArray& out, int value)
+{
+    out.append((char)value);
+}
+
+static void put16(QByteArray& out, int value)
+{
+    out.append((char)(value >> 8));
+    out.append((char)value);
+}
+
+static void put32(QByteArray& out, quint32 value)
+{
+    out.append((char)(value >> 24));
+    out.append((char)(value >> 16));
+    out.append((char)(value >> 8));
+    out.append((char)value);
+}
+
+static void put64(QByteArray& out, quint64 value)
+{
+    put32(out, (quint32)(value >> 32));
+    put32(out, (quint32)value);
+}
+
+static void patch32(QByteArray& out, int pos, quint32 value)
+{
+    out[pos] = (char)(value >> 24);
+    out[pos + 1] = (char)(value >> 16);
+    out[pos + 2] = (char)(value >> 8);
+    out[pos + 3] = (char)value;
+}
+
+static void putZeros(QByteArray& out, int count)
+{
+    out.append(QByteArray(count, 0));
+}
+
+//  starts a box and returns its position so that endBox() can fill in the size
+
+static int beginBox(QByteArray& out, const char *type)
+{
+    int pos = out.length();
+
+    put32(out, 0);
+    out.append(type, 4);
+    return pos;
+}
+
+static int beginFullBox(QByteArray& out, const char *type, int version, quint32 flags)
+{
+    int pos = beginBox(out, type);
+
+    put32(out, ((quint32)version << 24) | flags);
+    return pos;
+}
+
+static void endBox(QByteArray& out, int pos)
+{
+    patch32(out, pos, out.length() - pos);
+}
+
+static void putMatrix(QByteArray& out)
+{
+    put32(out, 0x00010000); put32(out, 0); put32(out, 0);
+    put32(out, 0); put32(out, 0x00010000); put32(out, 0);
+    put32(out, 0); put32(out, 0); put32(out, 0x40000000);
+}
+
+MP4FragmentWriter::MP4FragmentWriter()
+{
+    m_width = 0;
+    m_height = 0;
+    m_sampleRate = 0;
+    m_channels = 0;
+    m_sequence = 0;
+    m_videoDecodeTime = 0;
+    m_audioDecodeTime = 0;
+    m_pendingAudioDuration = 0;
+    m_audioStarted = false;
+    m_pendingVideoDuration = 0;
+}
+
+void MP4FragmentWriter::setVideoFormat(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+}
+
+void MP4FragmentWriter::setAudioFormat(int sampleRate, int channels)
+{
+    m_sampleRate = 0;
+    m_channels = channels;
+
+    //  only rates AAC can signal directly get an audio track
+
+    for (int i = 0; aacSampleRates[i] != 0; i++) {
+        if (aacSampleRates[i] == sampleRate)
+            m_sampleRate = sampleRate;
+    }
+}
+
+bool MP4FragmentWriter::setParameterSets(const QByteArray& sps, const QByteArray& pps)
+{
+    if ((sps == m_sps) && (pps == m_pps))
+        return false;
+
+    m_sps = sps;
+    m_pps = pps;
+    return true;
+}
+
+void MP4FragmentWriter::writeInitSegment(QByteArray& out)
+{
+    int ftyp = beginBox(out, "ftyp");
+    out.append("isom", 4);
+    put32(out, 0x200);
+    out.append("isom", 4);
+    out.append("iso5", 4);
+    out.append("avc1", 4);
+    out.append("mp41", 4);
+    endBox(out, ftyp);
+
+    int moov = beginBox(out, "moov");
+
+    int mvhd = beginFullBox(out, "mvhd", 0, 0);
+    put32(out, 0);                                          // creation time
+    put32(out, 0);                                          // modification time
+    put32(out, 1000);                                       // timescale
+    put32(out, 0);                                          // duration - unknown when fragmented
+    put32(out, 0x00010000);                                 // rate
+    put16(out, 0x0100);                                     // volume
+    putZeros(out, 10);
+    putMatrix(out);
+    putZeros(out, 24);
+    put32(out, MP4_AUDIO_TRACK_ID + 1);                     // next track ID
+    endBox(out, mvhd);
+
+    writeTrak(out, true);
+    if (m_sampleRate != 0)
+        writeTrak(out, false);
+
+    int mvex = beginBox(out, "mvex");
+    for (int track = MP4_VIDEO_TRACK_ID; track <= ((m_sampleRate != 0) ? MP4_AUDIO_TRACK_ID : MP4_VIDEO_TRACK_ID); track++) {
+        int trex = beginFullBox(out, "trex", 0, 0);
+        put32(out, track);
+        put32(out, 1);                                      // sample description index
+        put32(out, 0);
+        put32(out, 0);
+        put32(out, 0);
+        endBox(out, trex);
+    }
+    endBox(out, mvex);
+
+    endBox(out, moov);
+
+    //  a new file starts its timeline from zero
+
+    m_videoDecodeTime = 0;
+    m_audioDecodeTime = 0;
+    m_pendingAudioDuration = 0;
+    m_audioStarted = false;
+    m_videoSamples.clear();
+    m_audioSamples.clear();
+    m_videoData.clear();
+    m_audioData.clear();
+    m_pendingVideoDuration = 0;
+}
+
+void MP4FragmentWriter::writeTrak(QByteArray& out, bool video)
+{
+    int trak = beginBox(out, "trak");
+
+    int tkhd = beginFullBox(out, "tkhd", 0, 3);             // enabled and in movie
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, video ? MP4_VIDEO_TRACK_ID : MP4_AUDIO_TRACK_ID);
+    put32(out, 0);
+    put32(out, 0);                                          // duration
+    putZeros(out, 8);
+    put16(out, 0);                                          // layer
+    put16(out, video ? 0 : 1);                              // alternate group
+    put16(out, video ? 0 : 0x0100);                         // volume
+    put16(out, 0);
+    putMatrix(out);
+    put32(out, video ? (quint32)m_width << 16 : 0);
+    put32(out, video ? (quint32)m_height << 16 : 0);
+    endBox(out, tkhd);
+
+    int mdia = beginBox(out, "mdia");
+
+    int mdhd = beginFullBox(out, "mdhd", 0, 0);
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, video ? MP4_VIDEO_TIMESCALE : m_sampleRate);
+    put32(out, 0);
+    put16(out, 0x55c4);                                     // 'und'
+    put16(out, 0);
+    endBox(out, mdhd);
+
+    int hdlr = beginFullBox(out, "hdlr", 0, 0);
+    put32(out, 0);
+    out.append(video ? "vide" : "soun", 4);
+    putZeros(out, 12);
+    out.append(video ? "VideoHandler" : "SoundHandler");
+    put8(out, 0);
+    endBox(out, hdlr);
+
+    int minf = beginBox(out, "minf");
+
+    if (video) {
+        int vmhd = beginFullBox(out, "vmhd", 0, 1);
+        putZeros(out, 8);
+        endBox(out, vmhd);
+    } else {
+        int smhd = beginFullBox(out, "smhd", 0, 0);
+        putZeros(out, 4);
+        endBox(out, smhd);
+    }
+
+    int dinf = beginBox(out, "dinf");
+    int dref = beginFullBox(out, "dref", 0, 0);
+    put32(out, 1);
+    int url = beginFullBox(out, "url ", 0, 1);              // media is in this file
+    endBox(out, url);
+    endBox(out, dref);
+    endBox(out, dinf);
+
+    int stbl = beginBox(out, "stbl");
+
+    int stsd = beginFullBox(out, "stsd", 0, 0);
+    put32(out, 1);
+
+    if (video) {
+        int avc1 = beginBox(out, "avc1");
+        putZeros(out, 6);
+        put16(out, 1);                                      // data reference index
+        putZeros(out, 16);
+        put16(out, m_width);
+        put16(out, m_height);
+        put32(out, 0x00480000);                             // 72 dpi
+        put32(out, 0x00480000);
+        put32(out, 0);
+        put16(out, 1);                                      // frame count
+        putZeros(out, 32);                                  // compressor name
+        put16(out, 0x0018);                                 // depth
+        put16(out, 0xffff);
+        writeAVCC(out);
+        endBox(out, avc1);
+    } else {
+        int mp4a = beginBox(out, "mp4a");
+        putZeros(out, 6);
+        put16(out, 1);
+        putZeros(out, 8);
+        put16(out, m_channels);
+        put16(out, 16);                                     // sample size
+        putZeros(out, 4);
+        put32(out, (quint32)m_sampleRate << 16);
+        writeESDS(out);
+        endBox(out, mp4a);
+    }
+    endBox(out, stsd);
+
+    //  the sample tables are empty - the samples are all in the fragments
+
+    int stts = beginFullBox(out, "stts", 0, 0);
+    put32(out, 0);
+    endBox(out, stts);
+
+    int stsc = beginFullBox(out, "stsc", 0, 0);
+    put32(out, 0);
+    endBox(out, stsc);
+
+    int stsz = beginFullBox(out, "stsz", 0, 0);
+    put32(out, 0);
+    put32(out, 0);
+    endBox(out, stsz);
+
+    int stco = beginFullBox(out, "stco", 0, 0);
+    put32(out, 0);
+    endBox(out, stco);
+
+    endBox(out, stbl);
+    endBox(out, minf);
+    endBox(out, mdia);
+    endBox(out, trak);
+}
+
+void MP4FragmentWriter::writeAVCC(QByteArray& out)
+{
+    int avcC = beginBox(out, "avcC");
+
+    put8(out, 1);                                           // configuration version
+    put8(out, (m_sps.length() > 3) ? (unsigned char)m_sps[1] : 0x42);  // profile
+    put8(out, (m_sps.length() > 3) ? (unsigned char)m_sps[2] : 0);     // compatibility
+    put8(out, (m_sps.length() > 3) ? (unsigned char)m_sps[3] : 0x1f);  // level
+    put8(out, 0xff);                                        // 4 byte NAL lengths
+    put8(out, 0xe1);                                        // one SPS
+    put16(out, m_sps.length());
+    out.append(m_sps);
+    put8(out, 1);                                           // one PPS
+    put16(out, m_pps.length());
+    out.append(m_pps);
+
+    endBox(out, avcC);
+}
+
+void MP4FragmentWriter::writeESDS(QByteArray& out)
+{
+    int index;
+
+    for (index = 0; aacSampleRates[index] != 0; index++) {
+        if (aacSampleRates[index] == m_sampleRate)
+            break;
+    }
+
+    int esds = beginFullBox(out, "esds", 0, 0);
+
+    //  all the descriptors are short enough for one byte lengths
+
+    put8(out, 0x03);                                        // ES descriptor
+    put8(out, 3 + 2 + 13 + 2 + 2 + 2 + 1);
+    put16(out, MP4_AUDIO_TRACK_ID);
+    put8(out, 0);
+
+    put8(out, 0x04);                                        // decoder config descriptor
+    put8(out, 13 + 2 + 2);
+    put8(out, 0x40);                                        // MPEG-4 audio
+    put8(out, 0x15);                                        // audio stream
+    putZeros(out, 3);                                       // buffer size
+    put32(out, 0);                                          // max bitrate
+    put32(out, 0);                                          // average bitrate
+
+    put8(out, 0x05);                                        // AudioSpecificConfig - AAC LC
+    put8(out, 2);
+    put16(out, (2 << 11) | (index << 7) | (m_channels << 3));
+
+    put8(out, 0x06);                                        // SL config descriptor
+    put8(out, 1);
+    put8(out, 0x02);
+
+    endBox(out, esds);
+}
+
+void MP4FragmentWriter::addVideoSample(const QList<QByteArray>& nals, quint32 duration, bool sync)
+{
+    MP4_SAMPLE sample;
+    int start = m_videoData.length();
+
+    for (int i = 0; i < nals.count(); i++) {
+        put32(m_videoData, nals.at(i).length());
+        m_videoData.append(nals.at(i));
+    }
+
+    sample.size = m_videoData.length() - start;
+    sample.duration = duration;
+    sample.sync = sync;
+    m_videoSamples.append(sample);
+    m_pendingVideoDuration += duration;
+}
+
+void MP4FragmentWriter::addAudioSample(const QByteArray& frame, quint64 startOffset)
+{
+    MP4_SAMPLE sample;
+
+    if (m_sampleRate == 0)
+        return;
+
+    if (!m_audioStarted) {
+        m_audioDecodeTime = startOffset;
+        m_audioStarted = true;
+    } else {
+        //  audio has gaps - silence suppression and drops under load - which would otherwise
+        //  pull everything after them early. Timestamp jitter within a frame is ignored
+
+        qint64 drift = (qint64)startOffset - (qint64)(m_audioDecodeTime + m_pendingAudioDuration);
+
+        if (drift > MP4_AAC_FRAME_SAMPLES) {
+            if (m_audioSamples.isEmpty()) {
+                m_audioDecodeTime += drift;                 // the next fragment's tfdt
+            } else {
+                m_audioSamples.last().duration += drift;
+                m_pendingAudioDuration += drift;
+            }
+        } else if (drift < -MP4_AAC_FRAME_SAMPLES) {
+            return;                                         // the decode time can't go back
+        }
+    }
+
+    m_audioData.append(frame);
+    sample.size = frame.length();
+    sample.duration = MP4_AAC_FRAME_SAMPLES;
+    sample.sync = true;
+    m_audioSamples.append(sample);
+    m_pendingAudioDuration += MP4_AAC_FRAME_SAMPLES;
+}
+
+void MP4FragmentWriter::writeFragment(QByteArray& out)
+{
+    int videoOffsetPos = -1;
+    int audioOffsetPos = -1;
+    int start = out.length();
+
+    if (!fragmentPending())
+        return;
+
+    int moof = beginBox(out, "moof");
+
+    int mfhd = beginFullBox(out, "mfhd", 0, 0);
+    put32(out, ++m_sequence);
+    endBox(out, mfhd);
+
+    if (!m_videoSamples.isEmpty())
+        writeTraf(out, MP4_VIDEO_TRACK_ID, m_videoDecodeTime, m_videoSamples, true, videoOffsetPos);
+    if (!m_audioSamples.isEmpty())
+        writeTraf(out, MP4_AUDIO_TRACK_ID, m_audioDecodeTime, m_audioSamples, false, audioOffsetPos);
+
+    endBox(out, moof);
+
+    //  data offsets are from the start of the moof to the track's data in the mdat
+
+    int moofSize = out.length() - start;
+
+    if (videoOffsetPos != -1)
+        patch32(out, videoOffsetPos, moofSize + 8);
+    if (audioOffsetPos != -1)
+        patch32(out, audioOffsetPos, moofSize + 8 + m_videoData.length());
+
+    put32(out, 8 + m_videoData.length() + m_audioData.length());
+    out.append("mdat", 4);
+    out.append(m_videoData);
+    out.append(m_audioData);
+
+    for (int i = 0; i < m_videoSamples.count(); i++)
+        m_videoDecodeTime += m_videoSamples.at(i).duration;
+    m_audioDecodeTime += m_pendingAudioDuration;
+
+    m_videoSamples.clear();
+    m_audioSamples.clear();
+    m_videoData.clear();
+    m_audioData.clear();
+    m_pendingVideoDuration = 0;
+    m_pendingAudioDuration = 0;
+}
+
+void MP4FragmentWriter::writeTraf(QByteArray& out, int trackID, quint64 decodeTime,
+                                  const QList<MP4_SAMPLE>& samples, bool video, int& dataOffsetPos)
+{
+    quint32 flags = MP4_TRUN_DATA_OFFSET | MP4_TRUN_DURATION | MP4_TRUN_SIZE;
+
+    if (video)
+        flags |= MP4_TRUN_FLAGS;
+
+    int traf = beginBox(out, "traf");
+
+    int tfhd = beginFullBox(out, "tfhd", 0, MP4_TFHD_BASE_IS_MOOF);
+    put32(out, trackID);
+    endBox(out, tfhd);
+
+    int tfdt = beginFullBox(out, "tfdt", 1, 0);
+    put64(out, decodeTime);
+    endBox(out, tfdt);
+
+    int trun = beginFullBox(out, "trun", 0, flags);
+    put32(out, samples.count());
+    dataOffsetPos = out.length();
+    put32(out, 0);                                          // filled in once the moof size is known
+
+    for (int i = 0; i < samples.count(); i++) {
+        const MP4_SAMPLE& sample = samples.at(i);
+
+        put32(out, sample.duration);
+        put32(out, sample.size);
+        if (video)
+            put32(out, sample.sync ? MP4_SAMPLE_FLAGS_SYNC : MP4_SAMPLE_FLAGS_NON_SYNC);
+    }
+    endBox(out, trun);
+
+    endBox(out, traf);
+}
@@ -0,0 +1,108 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef MP4FRAGMENTWRITER_H
+#define MP4FRAGMENTWRITER_H
+
+#include "SyntroLib.h"
+
+//  Builds ISO BMFF fragmented MP4 - an init segment (ftyp + moov) followed by any number of
+//  moof + mdat fragments - from H.264 access units and raw AAC frames. Nothing is re-encoded,
+//  the samples are just given length prefixes in place of start codes.
+
+#define MP4_VIDEO_TIMESCALE             90000
+#define MP4_AAC_FRAME_SAMPLES           1024
+
+#define MP4_VIDEO_TRACK_ID              1
+#define MP4_AUDIO_TRACK_ID              2
+
+typedef struct
+{
+    quint32 size;
+    quint32 duration;
+    bool sync;
+} MP4_SAMPLE;
+
+class MP4FragmentWriter
+{
+public:
+    MP4FragmentWriter();
+
+    void setVideoFormat(int width, int height);
+    void setAudioFormat(int sampleRate, int channels);      // sampleRate 0 for no audio track
+
+    //  SPS and PPS without start codes. Returns true if they are different from the last ones
+    //  in which case a new init segment is needed
+
+    bool setParameterSets(const QByteArray& sps, const QByteArray& pps);
+    bool haveParameterSets() { return !m_sps.isEmpty() && !m_pps.isEmpty(); }
+
+    //  appends ftyp + moov to out and restarts the decode times for a new file
+
+    void writeInitSegment(QByteArray& out);
+
+    //  nals are the NAL units of one access unit without start codes. duration is in
+    //  MP4_VIDEO_TIMESCALE units
+
+    void addVideoSample(const QList<QByteArray>& nals, quint32 duration, bool sync);
+
+    //  one raw AAC frame placed startOffset samples after the start of the video. Frames
+    //  normally follow on from each other, but one more than a frame from where its timestamp
+    //  puts it is moved there, by stretching the previous frame over a gap or dropping it if early
+
+    void addAudioSample(const QByteArray& frame, quint64 startOffset);
+
+    //  appends moof + mdat for everything added since the last call to out
+
+    void writeFragment(QByteArray& out);
+
+    int getPendingBytes() { return m_videoData.length() + m_audioData.length(); }
+    quint64 getPendingDuration() { return m_pendingVideoDuration; }  // in MP4_VIDEO_TIMESCALE units
+    bool fragmentPending() { return !m_videoSamples.isEmpty() || !m_audioSamples.isEmpty(); }
+
+private:
+    void writeTrak(QByteArray& out, bool video);
+    void writeAVCC(QByteArray& out);
+    void writeESDS(QByteArray& out);
+    void writeTraf(QByteArray& out, int trackID, quint64 decodeTime,
+                   const QList<MP4_SAMPLE>& samples, bool video, int& dataOffsetPos);
+
+    int m_width;
+    int m_height;
+    int m_sampleRate;
+    int m_channels;
+
+    QByteArray m_sps;
+    QByteArray m_pps;
+
+    quint32 m_sequence;                                     // fragment sequence number
+    quint64 m_videoDecodeTime;                              // decode time of the first pending sample
+    quint64 m_audioDecodeTime;
+    quint64 m_pendingAudioDuration;                         // in audio samples
+    bool m_audioStarted;                                    // false until the first audio frame in a file
+
+    QList<MP4_SAMPLE> m_videoSamples;
+    QList<MP4_SAMPLE> m_audioSamples;
+    QByteArray m_videoData;                                 // length prefixed NALs
+    QByteArray m_audioData;
+    quint64 m_pendingVideoDuration;
+};
+
+#endif // MP4FRAGMENTWRITER_H
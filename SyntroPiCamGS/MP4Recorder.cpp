@@ -0,0 +1,469 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "MP4Recorder.h"
+#include "RTPPacketiser.h"
+
+#include <qdir.h>
+#include <qdatetime.h>
+
+#define H264_NAL_AUD                    9
+
+MP4Recorder::MP4Recorder() : SyntroThread("MP4Recorder", "MP4Recorder")
+{
+    m_timer = 0;
+    m_inputBytes = 0;
+    m_inputDropping = false;
+    m_videoResync = false;
+    m_dropCount = 0;
+    m_width = 0;
+    m_height = 0;
+    m_sampleRate = 0;
+    m_channels = 0;
+    m_formatChanged = false;
+    m_fileStart = 0;
+    m_videoCarryTimestamp = 0;
+    m_auTimestamp = 0;
+    m_auHasVCL = false;
+    m_auSync = false;
+    m_lastTimestamp = 0;
+    m_lastSync = false;
+    m_lastDuration = MP4_VIDEO_TIMESCALE / 30;
+
+    //  the write buffer never has to grow past a chunk plus the biggest fragment
+
+    m_writeBuffer.reserve(MP4RECORDER_WRITE_CHUNK + MP4RECORDER_FRAGMENT_MAX);
+
+    loadSettings();
+}
+
+void MP4Recorder::loadSettings()
+{
+    QSettings *settings = SyntroUtils::getSettings();
+
+    settings->beginGroup(MP4RECORDER_GROUP);
+
+    m_directory = settings->value(MP4RECORDER_DIRECTORY).toString();
+    m_segmentLength = (qint64)settings->value(MP4RECORDER_SEGMENT_LENGTH).toInt() * 1000;
+    m_maxSize = (qint64)settings->value(MP4RECORDER_MAX_SIZE).toInt() * 1024 * 1024;
+
+    settings->endGroup();
+
+    delete settings;
+}
+
+void MP4Recorder::setFormat(int width, int height, int sampleRate, int channels)
+{
+    QMutexLocker lock(&m_inputLock);
+
+    m_width = width;
+    m_height = height;
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_formatChanged = true;
+}
+
+void MP4Recorder::newVideo(const QByteArray& segment, qint64 timestamp)
+{
+    MP4RECORDER_INPUT input;
+
+    QMutexLocker lock(&m_inputLock);
+
+    //  after an overflow there's no point queuing anything that can't be decoded
+
+    if (m_inputDropping) {
+        if ((m_inputBytes > (MP4RECORDER_QUEUE_MAX / 2)) ||
+                ((RTPH264Packetiser::nalTypes(segment) & ((1 << H264_NAL_SPS) | (1 << H264_NAL_IDR))) == 0)) {
+            m_dropCount++;
+            m_videoResync = true;
+            return;
+        }
+        m_inputDropping = false;
+    }
+
+    if ((m_inputBytes + segment.length()) > MP4RECORDER_QUEUE_MAX) {
+        m_inputDropping = true;
+        m_dropCount++;
+        m_videoResync = true;
+        return;
+    }
+
+    input.data = segment;
+    input.timestamp = timestamp;
+    input.audio = false;
+    input.resync = m_videoResync;
+    m_videoResync = false;
+    m_inputQ.enqueue(input);
+    m_inputBytes += segment.length();
+}
+
+void MP4Recorder::newAudio(const QByteArray& packet, qint64 timestamp)
+{
+    MP4RECORDER_INPUT input;
+
+    QMutexLocker lock(&m_inputLock);
+
+    if (m_inputDropping || ((m_inputBytes + packet.length()) > MP4RECORDER_QUEUE_MAX))
+        return;
+
+    input.data = packet;
+    input.timestamp = timestamp;
+    input.audio = true;
+    input.resync = false;
+    m_inputQ.enqueue(input);
+    m_inputBytes += packet.length();
+}
+
+int MP4Recorder::getDropCount()
+{
+    QMutexLocker lock(&m_inputLock);
+    int count = m_dropCount;
+
+    m_dropCount = 0;
+    return count;
+}
+
+void MP4Recorder::initThread()
+{
+    m_timer = startTimer(MP4RECORDER_INTERVAL);
+}
+
+void MP4Recorder::finishThread()
+{
+    killTimer(m_timer);
+    closeFile();
+}
+
+void MP4Recorder::timerEvent(QTimerEvent * /* event */)
+{
+    MP4RECORDER_INPUT input;
+
+    while (true) {
+        m_inputLock.lock();
+
+        //  a format change needs a new init segment and so a new file
+
+        if (m_formatChanged) {
+            m_formatChanged = false;
+            closeFile();
+            m_writer.setVideoFormat(m_width, m_height);
+            m_writer.setAudioFormat(m_sampleRate, m_channels);
+        }
+
+        if (m_inputQ.empty()) {
+            m_inputLock.unlock();
+            break;
+        }
+
+        input = m_inputQ.dequeue();
+        m_inputBytes -= input.data.length();
+        m_inputLock.unlock();
+
+        if (input.audio)
+            processAudio(input.data, input.timestamp);
+        else
+            processVideo(input.data, input.timestamp, input.resync);
+    }
+}
+
+void MP4Recorder::processVideo(const QByteArray& segment, qint64 timestamp, bool resync)
+{
+    const unsigned char *nal;
+    const unsigned char *nextNal;
+    int nalLength;
+    int nextLength;
+    int offset = 0;
+
+    //  a partial NAL from before a gap can't be completed
+
+    if (resync)
+        m_videoCarry.clear();
+
+    //  VideoDriver normally delivers whole access units but passes on a picture that reaches
+    //  its size limit as it is, so the last NAL of a segment may continue in the next one. It
+    //  is held back until the following start code turns up, which costs nothing as an access
+    //  unit isn't written until the next one starts anyway
+
+    bool carried = !m_videoCarry.isEmpty();
+    QByteArray buffer = carried ? m_videoCarry + segment : segment;
+    const unsigned char *data = (const unsigned char *)buffer.constData();
+
+    m_videoCarry.clear();
+
+    //  with no whole start code yet, a tail that might be the start of one has to be kept
+
+    if (!RTPH264Packetiser::nextNAL(data, buffer.length(), offset, nal, nalLength)) {
+        m_videoCarry = (carried && (buffer.length() <= MP4RECORDER_FRAGMENT_MAX)) ? buffer : buffer.right(3);
+        if (!carried)
+            m_videoCarryTimestamp = timestamp;
+        return;
+    }
+
+    while (RTPH264Packetiser::nextNAL(data, buffer.length(), offset, nextNal, nextLength)) {
+        processNAL(nal, nalLength, carried ? m_videoCarryTimestamp : timestamp);
+        carried = false;
+        nal = nextNal;
+        nalLength = nextLength;
+    }
+
+    //  a NAL with no start code after it this size has to be broken
+
+    if (nalLength > MP4RECORDER_FRAGMENT_MAX)
+        return;
+
+    m_videoCarry = buffer.mid(nal - 3 - data);
+
+    if (!carried)
+        m_videoCarryTimestamp = timestamp;
+}
+
+void MP4Recorder::processNAL(const unsigned char *nal, int nalLength, qint64 timestamp)
+{
+    int type = nal[0] & 0x1f;
+
+    //  anything but a slice after a slice belongs to the next access unit as does a
+    //  slice with first_mb_in_slice of zero
+
+    if (m_auHasVCL) {
+        if ((type == H264_NAL_SLICE) || (type == H264_NAL_IDR)) {
+            if ((nalLength > 1) && (nal[1] & 0x80))
+                finishAccessUnit();
+        } else {
+            finishAccessUnit();
+        }
+    }
+
+    if (m_auNALs.isEmpty() && !m_auHasVCL)
+        m_auTimestamp = timestamp;
+
+    switch (type) {
+    case H264_NAL_SPS:
+        m_sps = QByteArray((const char *)nal, nalLength);
+        break;
+
+    case H264_NAL_PPS:
+        m_pps = QByteArray((const char *)nal, nalLength);
+        break;
+
+    case H264_NAL_AUD:
+        break;
+
+    case H264_NAL_IDR:
+        m_auSync = true;
+        // fall through
+
+    case H264_NAL_SLICE:
+        m_auHasVCL = true;
+        // fall through
+
+    default:
+        m_auNALs.append(QByteArray((const char *)nal, nalLength));
+        break;
+    }
+}
+
+void MP4Recorder::finishAccessUnit()
+{
+    //  the previous access unit's duration is only known now that this one has started
+
+    if (!m_lastNALs.isEmpty()) {
+        qint64 duration = ((m_auTimestamp - m_lastTimestamp) * MP4_VIDEO_TIMESCALE) / 1000;
+
+        if (duration <= 0)
+            duration = m_lastDuration;
+        m_lastDuration = (quint32)duration;
+
+        if (m_file.isOpen()) {
+            if ((m_writer.getPendingDuration() >= MP4RECORDER_FRAGMENT_DURATION) ||
+                    (m_writer.getPendingBytes() >= MP4RECORDER_FRAGMENT_MAX))
+                flushFragment();
+
+            m_writer.addVideoSample(m_lastNALs, m_lastDuration, m_lastSync);
+        }
+    }
+
+    //  files and fragments start at IDRs. A file is only started once the parameter sets are known
+
+    if (m_auSync && !m_sps.isEmpty() && !m_pps.isEmpty()) {
+        bool newParameterSets = m_writer.setParameterSets(m_sps, m_pps);
+
+        if (!m_file.isOpen() || newParameterSets || ((m_auTimestamp - m_fileStart) >= m_segmentLength)) {
+            closeFile();
+            openFile();
+            m_fileStart = m_auTimestamp;
+        } else {
+            flushFragment();
+        }
+    }
+
+    m_lastNALs = m_auNALs;
+    m_lastTimestamp = m_auTimestamp;
+    m_lastSync = m_auSync;
+
+    m_auNALs.clear();
+    m_auHasVCL = false;
+    m_auSync = false;
+}
+
+void MP4Recorder::processAudio(const QByteArray& packet, qint64 timestamp)
+{
+    const unsigned char *payload;
+    int length;
+    int offset = 0;
+    int frameIndex = 0;
+
+    if (!m_file.isOpen() || (packet.length() <= RTP_HEADER_LENGTH)) {
+        m_latm.clear();
+        return;
+    }
+
+    m_latm.append(packet.constData() + RTP_HEADER_LENGTH, packet.length() - RTP_HEADER_LENGTH);
+
+    //  a frame too big for one packet continues until the marker
+
+    if (((unsigned char)packet.at(1) & 0x80) == 0)
+        return;
+
+    //  audio from before the first picture in the file has nowhere to go
+
+    if (timestamp < m_fileStart) {
+        m_latm.clear();
+        return;
+    }
+
+    payload = (const unsigned char *)m_latm.constData();
+    length = m_latm.length();
+
+    //  each frame is a PayloadLengthInfo (a run of 0xff bytes ending in a smaller one) and
+    //  the frame itself. The config isn't in band so there's nothing else
+
+    while (offset < length) {
+        int frameLength = 0;
+        int lengthByte;
+
+        do {
+            lengthByte = payload[offset++];
+            frameLength += lengthByte;
+        } while ((lengthByte == 0xff) && (offset < length));
+
+        if ((frameLength == 0) || ((offset + frameLength) > length))
+            break;
+
+        //  the frames of a packet follow on from its timestamp. Whatever fixed offset the
+        //  timestamp has from the audio cancels out as the first frame in a file sets the base
+
+        m_writer.addAudioSample(QByteArray((const char *)payload + offset, frameLength),
+                                ((timestamp - m_fileStart) * m_sampleRate) / 1000 + frameIndex * MP4_AAC_FRAME_SAMPLES);
+        offset += frameLength;
+        frameIndex++;
+    }
+
+    m_latm.clear();
+}
+
+void MP4Recorder::openFile()
+{
+    QDir dir;
+
+    if (!dir.mkpath(m_directory)) {
+        appLogError(QString("Unable to create recording directory %1").arg(m_directory));
+        return;
+    }
+
+    enforceRetention();
+
+    m_file.setFileName(m_directory + "/" + QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss") + ".mp4");
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        appLogError(QString("Unable to open recording file %1").arg(m_file.fileName()));
+        return;
+    }
+
+    m_writeBuffer.resize(0);
+    m_writer.writeInitSegment(m_writeBuffer);
+}
+
+void MP4Recorder::closeFile()
+{
+    if (!m_file.isOpen())
+        return;
+
+    flushFragment();
+    writeOut(true);
+    m_file.close();
+}
+
+void MP4Recorder::flushFragment()
+{
+    if (!m_file.isOpen())
+        return;
+
+    m_writer.writeFragment(m_writeBuffer);
+    writeOut(false);
+}
+
+void MP4Recorder::writeOut(bool all)
+{
+    int written = 0;
+    int length = m_writeBuffer.length();
+    bool ok = true;
+
+    //  whole chunks keep every write aligned. The remainder waits unless the file is closing
+
+    while (ok && ((length - written) >= MP4RECORDER_WRITE_CHUNK)) {
+        ok = m_file.write(m_writeBuffer.constData() + written, MP4RECORDER_WRITE_CHUNK) == MP4RECORDER_WRITE_CHUNK;
+        written += MP4RECORDER_WRITE_CHUNK;
+    }
+
+    if (ok && all && (written < length)) {
+        ok = m_file.write(m_writeBuffer.constData() + written, length - written) == (length - written);
+        written = length;
+    }
+
+    if (!ok) {
+        appLogError(QString("Write to recording file %1 failed").arg(m_file.fileName()));
+        m_file.close();
+        m_writeBuffer.resize(0);
+        return;
+    }
+
+    m_writeBuffer.remove(0, written);
+}
+
+void MP4Recorder::enforceRetention()
+{
+    QDir dir(m_directory);
+    QFileInfoList files = dir.entryInfoList(QStringList("*.mp4"), QDir::Files, QDir::Name);
+    qint64 total = 0;
+    qint64 largest = 0;
+
+    for (int i = 0; i < files.count(); i++) {
+        total += files.at(i).size();
+        largest = qMax(largest, files.at(i).size());
+    }
+
+    //  names sort oldest first. Room is left for the file about to be started, assumed to be
+    //  no bigger than the biggest so far
+
+    for (int i = 0; (i < files.count()) && ((total + largest) > m_maxSize); i++) {
+        if (QFile::remove(files.at(i).absoluteFilePath()))
+            total -= files.at(i).size();
+    }
+}
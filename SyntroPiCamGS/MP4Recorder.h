@@ -0,0 +1,155 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef MP4RECORDER_H
+#define MP4RECORDER_H
+
+#include "SyntroLib.h"
+#include "MP4FragmentWriter.h"
+
+#include <qfile.h>
+#include <qmutex.h>
+
+//  group name for recorder settings
+
+#define MP4RECORDER_GROUP               "RecorderGroup"
+
+//  true to record to local storage
+
+#define MP4RECORDER_ENABLE              "RecordEnable"
+
+//  directory the segment files go in
+
+#define MP4RECORDER_DIRECTORY           "RecordDirectory"
+
+//  seconds of video in each file. A file always starts at an IDR so may be a GOP longer
+
+#define MP4RECORDER_SEGMENT_LENGTH      "RecordSegmentLength"
+
+//  max MB used by all the files in the directory. The oldest are deleted to stay under it
+
+#define MP4RECORDER_MAX_SIZE            "RecordMaxSize"
+
+#define MP4RECORDER_INTERVAL            (SYNTRO_CLOCKS_PER_SEC / 50)
+
+//  max bytes of input waiting for the recorder thread. Beyond that video is dropped to the
+//  next IDR so a slow card costs a gap in the recording rather than unbounded memory
+
+#define MP4RECORDER_QUEUE_MAX           (8 * 1024 * 1024)
+
+//  files are written in chunks of this size, a multiple of the flash erase block
+
+#define MP4RECORDER_WRITE_CHUNK         (1024 * 1024)
+
+//  a fragment is closed at an IDR or when it reaches either of these
+
+#define MP4RECORDER_FRAGMENT_DURATION   (2 * MP4_VIDEO_TIMESCALE)
+#define MP4RECORDER_FRAGMENT_MAX        (4 * 1024 * 1024)
+
+typedef struct
+{
+    QByteArray data;
+    qint64 timestamp;
+    bool audio;
+    bool resync;                                            // video was dropped before this segment
+} MP4RECORDER_INPUT;
+
+class MP4Recorder : public SyntroThread
+{
+    Q_OBJECT
+
+public:
+    MP4Recorder();
+
+    void setFormat(int width, int height, int sampleRate, int channels);
+
+    //  an Annex B access unit from VideoDriver. Only a picture over its size limit is split,
+    //  possibly mid NAL
+
+    void newVideo(const QByteArray& segment, qint64 timestamp);
+
+    //  an RTP MP4A-LATM packet from the audio pipeline
+
+    void newAudio(const QByteArray& packet, qint64 timestamp);
+
+    int getDropCount();                                     // video segments dropped since last call
+
+protected:
+    void initThread();
+    void timerEvent(QTimerEvent *event);
+    void finishThread();
+
+private:
+    void loadSettings();
+    void processVideo(const QByteArray& segment, qint64 timestamp, bool resync);
+    void processNAL(const unsigned char *nal, int nalLength, qint64 timestamp);
+    void processAudio(const QByteArray& packet, qint64 timestamp);
+    void finishAccessUnit();
+    void openFile();
+    void closeFile();
+    void flushFragment();
+    void writeOut(bool all);
+    void enforceRetention();
+
+    int m_timer;
+
+    QString m_directory;
+    qint64 m_segmentLength;                                 // mS
+    qint64 m_maxSize;                                       // bytes
+
+    QMutex m_inputLock;
+    QQueue<MP4RECORDER_INPUT> m_inputQ;
+    int m_inputBytes;                                       // protected by m_inputLock
+    bool m_inputDropping;                                   // discarding video until the next IDR
+    bool m_videoResync;                                     // video has been dropped since the last queued segment
+    int m_dropCount;
+
+    int m_width;                                            // protected by m_inputLock
+    int m_height;
+    int m_sampleRate;
+    int m_channels;
+    bool m_formatChanged;
+
+    MP4FragmentWriter m_writer;
+
+    QFile m_file;
+    qint64 m_fileStart;                                     // timestamp of the first video sample in the file
+    QByteArray m_writeBuffer;                               // written to the file in MP4RECORDER_WRITE_CHUNK pieces
+
+    QByteArray m_sps;                                       // latest SPS and PPS seen in the stream
+    QByteArray m_pps;
+
+    QByteArray m_videoCarry;                                // last NAL of the previous segment with its start code
+    qint64 m_videoCarryTimestamp;
+
+    QList<QByteArray> m_auNALs;                             // the access unit being collected
+    qint64 m_auTimestamp;
+    bool m_auHasVCL;
+    bool m_auSync;
+
+    QList<QByteArray> m_lastNALs;                           // the previous access unit, waiting for its duration
+    qint64 m_lastTimestamp;
+    bool m_lastSync;
+    quint32 m_lastDuration;
+
+    QByteArray m_latm;                                      // LATM payload collected until the RTP marker
+};
+
+#endif // MP4RECORDER_H
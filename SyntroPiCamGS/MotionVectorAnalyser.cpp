@@ -0,0 +1,83 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "MotionVectorAnalyser.h"
+
+MotionVectorAnalyser::MotionVectorAnalyser()
+{
+    m_columns = 0;
+    m_rows = 0;
+    m_activeBlocks = 0;
+    setThresholds(2, 10);
+}
+
+void MotionVectorAnalyser::setFrameSize(int width, int height)
+{
+    m_columns = (width + 15) / 16 + 1;
+    m_rows = (height + 15) / 16;
+    m_moving.fill(0, m_columns * m_rows);
+}
+
+void MotionVectorAnalyser::setThresholds(int minMagnitude, int minBlocks)
+{
+    m_minMagnitudeSquared = minMagnitude * minMagnitude;
+    m_minBlocks = minBlocks;
+}
+
+bool MotionVectorAnalyser::process(const unsigned char *vectors, int length)
+{
+    const MOTION_VECTOR *mv = (const MOTION_VECTOR *)vectors;
+    unsigned char *moving = m_moving.data();
+    int columns = m_columns - 1;
+    int x, y;
+
+    m_activeBlocks = 0;
+
+    if ((m_rows == 0) || (length != getFrameLength()))
+        return false;
+
+    //  mark the moving macroblocks. The extra column is never set so it also guards the row ends
+
+    for (y = 0; y < m_rows; y++) {
+        for (x = 0; x < m_columns; x++, mv++) {
+            if (x == columns)
+                moving[y * m_columns + x] = 0;
+            else
+                moving[y * m_columns + x] = (mv->x * mv->x + mv->y * mv->y) >= m_minMagnitudeSquared;
+        }
+    }
+
+    //  sensor noise gives isolated vectors while real movement is spread over neighbouring blocks
+
+    for (y = 0; y < m_rows; y++) {
+        for (x = 0; x < columns; x++) {
+            int i = y * m_columns + x;
+
+            if (!moving[i])
+                continue;
+
+            if (((x > 0) && moving[i - 1]) || moving[i + 1] ||
+                    ((y > 0) && moving[i - m_columns]) || ((y < m_rows - 1) && moving[i + m_columns]))
+                m_activeBlocks++;
+        }
+    }
+
+    return m_activeBlocks >= m_minBlocks;
+}
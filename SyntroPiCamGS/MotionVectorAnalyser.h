@@ -0,0 +1,68 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef MOTIONVECTORANALYSER_H
+#define MOTIONVECTORANALYSER_H
+
+#include <qvector.h>
+
+//  Decides whether a frame has motion from the encoder's inline motion vectors. The input is
+//  the raw MMAL side info buffer - the same layout raspivid -x writes - so recorded dumps can
+//  be fed straight in.
+
+//  one entry per 16x16 macroblock, with one extra column on the right of each row
+
+typedef struct
+{
+    signed char x;
+    signed char y;
+    unsigned short sad;
+} MOTION_VECTOR;
+
+class MotionVectorAnalyser
+{
+public:
+    MotionVectorAnalyser();
+
+    void setFrameSize(int width, int height);
+
+    //  minMagnitude is the vector length a macroblock needs to count as moving and minBlocks the
+    //  number of moving macroblocks (each with at least one moving neighbour) that is motion
+
+    void setThresholds(int minMagnitude, int minBlocks);
+
+    //  returns true if the frame has motion. Buffers that don't match the frame size are ignored
+
+    bool process(const unsigned char *vectors, int length);
+
+    int getActiveBlocks() { return m_activeBlocks; }        // result of the last process()
+    int getFrameLength() { return m_columns * m_rows * sizeof(MOTION_VECTOR); }
+
+private:
+    int m_columns;                                          // includes the extra column
+    int m_rows;
+    int m_minMagnitudeSquared;
+    int m_minBlocks;
+    int m_activeBlocks;
+
+    QVector<unsigned char> m_moving;                        // per macroblock flags for the current frame
+};
+
+#endif // MOTIONVECTORANALYSER_H
@@ -0,0 +1,246 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "RTPPacketiser.h"
+
+RTPH264Packetiser::RTPH264Packetiser()
+{
+    m_mtu = RTP_DEFAULT_MTU;
+    reset();
+}
+
+void RTPH264Packetiser::reset()
+{
+    //  random starting points as RFC 3550 recommends
+
+    m_ssrc = ((quint32)qrand() << 16) ^ (quint32)qrand();
+    m_timestampBase = ((quint32)qrand() << 16) ^ (quint32)qrand();
+    m_seqBase = m_seq = (quint16)qrand();
+
+    m_sps.clear();
+    m_pps.clear();
+}
+
+bool RTPH264Packetiser::nextNAL(const unsigned char *data, int length, int& offset, const unsigned char *& nal, int& nalLength)
+{
+    int i = offset;
+
+    //  find the start code
+
+    while ((i + 3) <= length) {
+        if ((data[i] == 0) && (data[i + 1] == 0) && (data[i + 2] == 1))
+            break;
+        i++;
+    }
+
+    if ((i + 3) > length)
+        return false;
+
+    nal = data + i + 3;
+    i += 3;
+
+    //  the NAL runs to the next start code (the zero before a 4 byte start code is trailing) or the end
+
+    int end = length;
+
+    while ((i + 3) <= length) {
+        if ((data[i] == 0) && (data[i + 1] == 0) && ((data[i + 2] == 1) || (data[i + 2] == 0))) {
+            end = i;
+            break;
+        }
+        i++;
+    }
+
+    //  a 00 00 00 sequence can only be trailing zeros or the start of the next start code
+
+    offset = end;
+    nalLength = end - (nal - data);
+    return nalLength > 0;
+}
+
+int RTPH264Packetiser::nalTypes(const QByteArray& segment)
+{
+    const unsigned char *nal;
+    int nalLength;
+    int offset = 0;
+    int types = 0;
+
+    while (nextNAL((const unsigned char *)segment.constData(), segment.length(), offset, nal, nalLength))
+        types |= 1 << (nal[0] & 0x1f);
+
+    return types;
+}
+
+int RTPH264Packetiser::packetNALType(const QByteArray& packet, bool& start)
+{
+    const unsigned char *payload = (const unsigned char *)packet.constData() + RTP_HEADER_LENGTH;
+
+    start = false;
+
+    if (packet.length() <= RTP_HEADER_LENGTH)
+        return -1;
+
+    if ((payload[0] & 0x1f) != H264_NAL_FUA) {
+        start = true;
+        return payload[0] & 0x1f;
+    }
+
+    if (packet.length() <= RTP_HEADER_LENGTH + 1)
+        return -1;
+
+    start = (payload[1] & 0x80) != 0;
+    return payload[1] & 0x1f;
+}
+
+int RTPH264Packetiser::packetise(const QByteArray& segment, quint32 rtpTimestamp, QList<QByteArray>& packets)
+{
+    const unsigned char *data = (const unsigned char *)segment.constData();
+    const unsigned char *nal;
+    const unsigned char *nextNal;
+    int nalLength;
+    int nextLength;
+    int offset = 0;
+    int types = 0;
+
+    if (!nextNAL(data, segment.length(), offset, nal, nalLength))
+        return 0;
+
+    //  look one NAL ahead so that the last one in the segment can carry the marker
+
+    while (true) {
+        bool more = nextNAL(data, segment.length(), offset, nextNal, nextLength);
+
+        types |= 1 << (nal[0] & 0x1f);
+
+        switch (nal[0] & 0x1f) {
+        case H264_NAL_SPS:
+            m_sps = QByteArray((const char *)nal, nalLength);
+            break;
+
+        case H264_NAL_PPS:
+            m_pps = QByteArray((const char *)nal, nalLength);
+            break;
+        }
+
+        packetiseNAL(nal, nalLength, !more, rtpTimestamp, packets);
+
+        if (!more)
+            break;
+
+        nal = nextNal;
+        nalLength = nextLength;
+    }
+    return types;
+}
+
+void RTPH264Packetiser::packetiseNAL(const unsigned char *nal, int length, bool last, quint32 rtpTimestamp, QList<QByteArray>& packets)
+{
+    int maxPayload = m_mtu - RTP_HEADER_LENGTH;
+    int type = nal[0] & 0x1f;
+
+    //  the segment ends with the picture so the marker goes on its last VCL packet
+
+    bool marker = last && (type >= H264_NAL_SLICE) && (type <= H264_NAL_IDR);
+
+    if (length <= maxPayload) {
+        //  single NAL unit packet
+
+        QByteArray packet(RTP_HEADER_LENGTH + length, 0);
+        unsigned char *ptr = (unsigned char *)packet.data();
+
+        writeHeader(ptr, marker, rtpTimestamp);
+        memcpy(ptr + RTP_HEADER_LENGTH, nal, length);
+        packets.append(packet);
+        return;
+    }
+
+    //  FU-A - the NAL header is replaced by the FU indicator and header
+
+    unsigned char indicator = (nal[0] & 0xe0) | H264_NAL_FUA;
+    unsigned char header = nal[0] & 0x1f;
+    const unsigned char *ptr = nal + 1;
+    int remaining = length - 1;
+    bool first = true;
+
+    maxPayload -= 2;
+
+    while (remaining > 0) {
+        int chunk = qMin(remaining, maxPayload);
+        bool end = (chunk == remaining);
+
+        QByteArray packet(RTP_HEADER_LENGTH + 2 + chunk, 0);
+        unsigned char *out = (unsigned char *)packet.data();
+
+        writeHeader(out, marker && end, rtpTimestamp);
+        out[RTP_HEADER_LENGTH] = indicator;
+        out[RTP_HEADER_LENGTH + 1] = header | (first ? 0x80 : 0) | (end ? 0x40 : 0);
+        memcpy(out + RTP_HEADER_LENGTH + 2, ptr, chunk);
+        packets.append(packet);
+
+        ptr += chunk;
+        remaining -= chunk;
+        first = false;
+    }
+}
+
+void RTPH264Packetiser::writeHeader(unsigned char *packet, bool marker, quint32 rtpTimestamp)
+{
+    quint32 timestamp = m_timestampBase + rtpTimestamp;
+
+    packet[0] = 0x80;                                       // version 2, no padding, extension or CSRCs
+    packet[1] = (marker ? 0x80 : 0) | RTP_H264_PAYLOAD_TYPE;
+    packet[2] = m_seq >> 8;
+    packet[3] = m_seq & 0xff;
+    packet[4] = timestamp >> 24;
+    packet[5] = (timestamp >> 16) & 0xff;
+    packet[6] = (timestamp >> 8) & 0xff;
+    packet[7] = timestamp & 0xff;
+    packet[8] = m_ssrc >> 24;
+    packet[9] = (m_ssrc >> 16) & 0xff;
+    packet[10] = (m_ssrc >> 8) & 0xff;
+    packet[11] = m_ssrc & 0xff;
+
+    m_seq++;
+}
+
+QString RTPH264Packetiser::getCaps()
+{
+    if ((m_sps.length() < 4) || m_pps.isEmpty())
+        return QString();
+
+    //  same fields rtph264pay puts in its caps
+
+    QString profileLevel;
+
+    profileLevel.sprintf("%02x%02x%02x", (unsigned char)m_sps[1], (unsigned char)m_sps[2], (unsigned char)m_sps[3]);
+
+    return QString("application/x-rtp, media=(string)video, clock-rate=(int)%1, encoding-name=(string)H264, "
+                   "packetization-mode=(string)1, profile-level-id=(string)%2, "
+                   "sprop-parameter-sets=(string)\"%3\\,%4\", payload=(int)%5, "
+                   "ssrc=(uint)%6, clock-base=(uint)%7, seqnum-base=(uint)%8")
+            .arg(RTP_H264_CLOCK_RATE)
+            .arg(profileLevel)
+            .arg(QString(m_sps.toBase64()))
+            .arg(QString(m_pps.toBase64()))
+            .arg(RTP_H264_PAYLOAD_TYPE)
+            .arg(m_ssrc)
+            .arg(m_timestampBase)
+            .arg(m_seqBase);
+}
@@ -0,0 +1,98 @@
+//
+//  Copyright (c) 2014 Scott Ellis and Richard Barnett.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef RTPPACKETISER_H
+#define RTPPACKETISER_H
+
+#include "SyntroLib.h"
+
+//  Native RFC 6184 packetiser for the H.264 byte stream produced by the MMAL encoder.
+//  Produces the same packets and caps as rtph264pay so receivers can't tell the difference.
+
+//  max size of an RTP packet including the RTP header - same default as rtph264pay
+
+#define RTP_DEFAULT_MTU                 1400
+
+#define RTP_HEADER_LENGTH               12
+
+#define RTP_H264_PAYLOAD_TYPE           96
+#define RTP_H264_CLOCK_RATE             90000
+
+//  H.264 NAL unit types used by the GS path
+
+#define H264_NAL_SLICE                  1
+#define H264_NAL_IDR                    5
+#define H264_NAL_SEI                    6
+#define H264_NAL_SPS                    7
+#define H264_NAL_PPS                    8
+#define H264_NAL_FUA                    28
+
+class RTPH264Packetiser
+{
+public:
+    RTPH264Packetiser();
+
+    void reset();
+    void setMTU(int mtu) { m_mtu = mtu; }
+
+    //  splits an Annex B access unit into NAL units and appends the RTP packets for them to packets.
+    //  The segment must hold whole NALs and end with the picture since the marker goes on its last
+    //  VCL packet. rtpTimestamp is in units of RTP_H264_CLOCK_RATE. Returns the NAL types seen as
+    //  for nalTypes()
+
+    int packetise(const QByteArray& segment, quint32 rtpTimestamp, QList<QByteArray>& packets);
+
+    //  caps string for the receiver - empty until the SPS and PPS have been seen
+
+    QString getCaps();
+
+    QByteArray getSPS() { return m_sps; }
+    QByteArray getPPS() { return m_pps; }
+
+    //  finds the next NAL unit in an Annex B buffer starting at offset. Returns false if there
+    //  are no more, otherwise nal and length describe the NAL without its start code
+
+    static bool nextNAL(const unsigned char *data, int length, int& offset, const unsigned char *& nal, int& nalLength);
+
+    //  returns a mask with bit (1 << type) set for every NAL type in an Annex B segment
+
+    static int nalTypes(const QByteArray& segment);
+
+    //  returns the type of the NAL carried by an RTP packet from this packetiser (or rtph264pay)
+    //  and whether the packet has the start of it. Returns -1 if the packet is too short
+
+    static int packetNALType(const QByteArray& packet, bool& start);
+
+private:
+    void packetiseNAL(const unsigned char *nal, int length, bool last, quint32 rtpTimestamp, QList<QByteArray>& packets);
+    void writeHeader(unsigned char *packet, bool marker, quint32 rtpTimestamp);
+
+    int m_mtu;
+
+    quint32 m_ssrc;
+    quint32 m_timestampBase;
+    quint16 m_seqBase;
+    quint16 m_seq;
+
+    QByteArray m_sps;                                       // latest SPS without start code
+    QByteArray m_pps;                                       // latest PPS without start code
+};
+
+#endif // RTPPACKETISER_H
@@ -107,6 +107,14 @@ const int ABORT_INTERVAL = 100; // ms
 
 int mmal_status_to_int(MMAL_STATUS_T status);
 
+//  This is where the jpeg frame from the splitter is assembled. It is sized from the frame at
+//  half a byte per pixel, which no sensible quality setting gets near
+
+static unsigned char *jpegBuffer = NULL;
+static int jpegBufferSize;
+static int jpegLength;
+static int jpegDiscard;                 // the frame being assembled overflowed so is dropped
+
 // Forward
 typedef struct RASPIVID_STATE_S RASPIVID_STATE;
 
@@ -141,10 +149,14 @@ struct RASPIVID_STATE_S
    int intraperiod;                    /// Intra-refresh period (key frame rate)
    int quantisationParameter;          /// Quantisation parameter - quality. Set bitrate 0 and set this for variable bitrate
    int bInlineHeaders;                  /// Insert inline headers to stream (SPS, PPS)
+   int bInlineVectors;                  /// Output motion vectors as side info buffers
    int verbose;                        /// !0 if want detailed run information
    int immutableInput;                 /// Flag to specify whether encoder works in place or creates a new buffer. Result is preview can display either
                                        /// the camera output or the encoder output (with compression artifacts)
    int profile;                        /// H264 profile to use for encoding
+   int jpegInterval;                   /// Min mS between frames sent to the JPEG encoder. 0 for no JPEG encoder
+   int jpegQuality;                    /// JPEG quality factor
+   int64_t lastJpegTime;               /// When the last frame was sent to the JPEG encoder
 
    RASPIPREVIEW_PARAMETERS preview_parameters;   /// Preview setup parameters
    RASPICAM_CAMERA_PARAMETERS camera_parameters; /// Camera setup parameters
@@ -152,10 +164,16 @@ struct RASPIVID_STATE_S
    MMAL_COMPONENT_T *camera_component;    /// Pointer to the camera component
    MMAL_COMPONENT_T *encoder_component;   /// Pointer to the encoder component
    MMAL_CONNECTION_T *preview_connection; /// Pointer to the connection from camera to preview
-   MMAL_CONNECTION_T *encoder_connection; /// Pointer to the connection from camera to encoder
+   MMAL_CONNECTION_T *encoder_connection; /// Pointer to the connection from camera (or splitter) to encoder
 
    MMAL_POOL_T *encoder_pool; /// Pointer to the pool of buffers used by encoder output port
 
+   MMAL_COMPONENT_T *splitter_component;  /// Splits the camera video between the encoders when JPEG is wanted
+   MMAL_COMPONENT_T *jpeg_component;      /// Pointer to the JPEG encoder component
+   MMAL_CONNECTION_T *splitter_connection; /// Pointer to the connection from camera to splitter
+   MMAL_CONNECTION_T *jpeg_connection;    /// Pointer to the connection from splitter to JPEG encoder - not tunnelled
+   MMAL_POOL_T *jpeg_pool;                /// Pointer to the pool of buffers used by JPEG encoder output port
+
    PORT_USERDATA callback_data;        /// Used to move data to the encoder callback
 };
 
@@ -170,8 +188,11 @@ MMAL_PORT_T *camera_still_port = NULL;
 MMAL_PORT_T *preview_input_port = NULL;
 MMAL_PORT_T *encoder_input_port = NULL;
 MMAL_PORT_T *encoder_output_port = NULL;
+MMAL_PORT_T *jpeg_output_port = NULL;
 
-void newCompressedVideoSegment(unsigned char *data, int length);
+void newCompressedVideoSegment(unsigned char *data, int length, int frameEnd);
+void newMotionVectors(unsigned char *data, int length);
+void newJpegFrame(unsigned char *data, int length);
 
 
 /**
@@ -201,6 +222,7 @@ static void default_status(RASPIVID_STATE *state)
    state->profile = MMAL_VIDEO_PROFILE_H264_HIGH;
 
    state->bInlineHeaders = 1;
+   state->jpegQuality = 85;
 
    // Setup preview window defaults
    raspipreview_set_defaults(&state->preview_parameters);
@@ -259,7 +281,16 @@ static void encoder_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf
       if (buffer->length) {
          mmal_buffer_header_mem_lock(buffer);
 
-         newCompressedVideoSegment(buffer->data, buffer->length);
+         // motion vectors arrive as side info buffers between the frames. Pictures larger than
+         // the buffer size are split across buffers at arbitrary offsets. The parameter sets come
+         // in a config buffer of their own and belong with the picture that follows them
+
+         if (buffer->flags & MMAL_BUFFER_HEADER_FLAG_CODECSIDEINFO)
+            newMotionVectors(buffer->data, buffer->length);
+         else
+            newCompressedVideoSegment(buffer->data, buffer->length,
+                                      (buffer->flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END) &&
+                                      !(buffer->flags & MMAL_BUFFER_HEADER_FLAG_CONFIG));
 
          mmal_buffer_header_mem_unlock(buffer);
 
@@ -291,6 +322,100 @@ static void encoder_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf
 }
 
 
+/**
+ *  buffer header callback function for the JPEG encoder
+ *
+ *  Assembles the JPEG and hands it on once complete
+ *
+ * @param port Pointer to port from which callback originated
+ * @param buffer mmal buffer header pointer
+ */
+static void jpeg_buffer_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+{
+   MMAL_BUFFER_HEADER_T *new_buffer;
+   RASPIVID_STATE *pstate = (RASPIVID_STATE *)port->userdata;
+
+   mmal_buffer_header_mem_lock(buffer);
+
+   if (!jpegDiscard) {
+      if ((buffer->length + jpegLength) > jpegBufferSize) {
+         vcos_log_error("Jpeg too long - discarding frame");
+         jpegDiscard = 1;
+      } else {
+         memcpy(jpegBuffer + jpegLength, buffer->data, buffer->length);
+         jpegLength += buffer->length;
+      }
+   }
+
+   mmal_buffer_header_mem_unlock(buffer);
+
+   if (buffer->flags & MMAL_BUFFER_HEADER_FLAG_FRAME_END) {
+      if ((jpegLength > 0) && !jpegDiscard)
+         newJpegFrame(jpegBuffer, jpegLength);
+      jpegLength = 0;
+      jpegDiscard = 0;
+   } else if (buffer->flags & MMAL_BUFFER_HEADER_FLAG_TRANSMISSION_FAILED) {
+      jpegLength = 0;
+      jpegDiscard = 0;
+   }
+
+   mmal_buffer_header_release(buffer);
+
+   if (port->is_enabled)
+   {
+      MMAL_STATUS_T status = MMAL_SUCCESS;
+
+      new_buffer = mmal_queue_get(pstate->jpeg_pool->queue);
+
+      if (new_buffer)
+         status = mmal_port_send_buffer(port, new_buffer);
+
+      if (!new_buffer || status != MMAL_SUCCESS)
+         vcos_log_error("Unable to return a buffer to the JPEG encoder port");
+   }
+}
+
+/**
+ *  callback for the splitter to JPEG encoder connection
+ *
+ *  The connection isn't tunnelled so that frames can be thinned out here. Only one
+ *  every jpegInterval mS goes to the JPEG encoder, the rest go straight back
+ *
+ * @param connection Pointer to the connection
+ */
+static void jpeg_connection_callback(MMAL_CONNECTION_T *connection)
+{
+   MMAL_BUFFER_HEADER_T *buffer;
+   RASPIVID_STATE *pstate = (RASPIVID_STATE *)connection->user_data;
+
+   while ((buffer = mmal_queue_get(connection->queue)) != NULL)
+   {
+      int64_t now = vcos_getmicrosecs64() / 1000;
+
+      if ((buffer->cmd == 0) && (buffer->length > 0) && ((now - pstate->lastJpegTime) >= pstate->jpegInterval))
+      {
+         pstate->lastJpegTime = now;
+         if (mmal_port_send_buffer(connection->in, buffer) != MMAL_SUCCESS)
+            mmal_buffer_header_release(buffer);
+      }
+      else
+      {
+         mmal_buffer_header_release(buffer);
+      }
+   }
+
+   // anything back in the pool goes to the splitter for another frame
+
+   while ((buffer = mmal_queue_get(connection->pool->queue)) != NULL)
+   {
+      if (mmal_port_send_buffer(connection->out, buffer) != MMAL_SUCCESS)
+      {
+         mmal_buffer_header_release(buffer);
+         break;
+      }
+   }
+}
+
 /**
  * Create the camera component, set up its ports
  *
@@ -621,6 +746,13 @@ static MMAL_STATUS_T create_encoder_component(RASPIVID_STATE *state)
       // Continue rather than abort..
    }
 
+   if (state->bInlineVectors &&
+         (mmal_port_parameter_set_boolean(encoder_output, MMAL_PARAMETER_VIDEO_ENCODE_INLINE_VECTORS, 1) != MMAL_SUCCESS))
+   {
+      vcos_log_error("failed to set INLINE VECTORS parameters");
+      // Continue rather than abort..
+   }
+
    //  Enable component
    status = mmal_component_enable(encoder);
 
@@ -676,6 +808,294 @@ static void destroy_encoder_component(RASPIVID_STATE *state)
    }
 }
 
+/**
+ * Create the splitter component that feeds both encoders
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ *
+ */
+static MMAL_STATUS_T create_splitter_component(RASPIVID_STATE *state)
+{
+   MMAL_COMPONENT_T *splitter = 0;
+   MMAL_PORT_T *camera_video = state->camera_component->output[MMAL_CAMERA_VIDEO_PORT];
+   MMAL_STATUS_T status;
+   unsigned int i;
+
+   status = mmal_component_create(MMAL_COMPONENT_DEFAULT_VIDEO_SPLITTER, &splitter);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to create splitter component");
+      goto error;
+   }
+
+   if (!splitter->input_num || (splitter->output_num < 2))
+   {
+      status = MMAL_ENOSYS;
+      vcos_log_error("Splitter doesn't have enough ports");
+      goto error;
+   }
+
+   mmal_format_copy(splitter->input[0]->format, camera_video->format);
+
+   if (splitter->input[0]->buffer_num < VIDEO_OUTPUT_BUFFERS_NUM)
+      splitter->input[0]->buffer_num = VIDEO_OUTPUT_BUFFERS_NUM;
+
+   status = mmal_port_format_commit(splitter->input[0]);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to set format on splitter input port");
+      goto error;
+   }
+
+   for (i = 0; i < 2; i++)
+   {
+      mmal_format_copy(splitter->output[i]->format, splitter->input[0]->format);
+
+      if (splitter->output[i]->buffer_num < VIDEO_OUTPUT_BUFFERS_NUM)
+         splitter->output[i]->buffer_num = VIDEO_OUTPUT_BUFFERS_NUM;
+
+      status = mmal_port_format_commit(splitter->output[i]);
+
+      if (status != MMAL_SUCCESS)
+      {
+         vcos_log_error("Unable to set format on splitter output port %d", i);
+         goto error;
+      }
+   }
+
+   status = mmal_component_enable(splitter);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to enable splitter component");
+      goto error;
+   }
+
+   state->splitter_component = splitter;
+   return status;
+
+   error:
+   if (splitter)
+      mmal_component_destroy(splitter);
+
+   state->splitter_component = NULL;
+   return status;
+}
+
+/**
+ * Create the JPEG encoder component, set up its ports
+ *
+ * @param state Pointer to state control struct
+ *
+ * @return MMAL_SUCCESS if all OK, something else otherwise
+ *
+ */
+static MMAL_STATUS_T create_jpeg_component(RASPIVID_STATE *state)
+{
+   MMAL_COMPONENT_T *encoder = 0;
+   MMAL_PORT_T *encoder_input = NULL, *encoder_output = NULL;
+   MMAL_STATUS_T status;
+   MMAL_POOL_T *pool;
+
+   status = mmal_component_create(MMAL_COMPONENT_DEFAULT_IMAGE_ENCODER, &encoder);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to create JPEG encoder component");
+      goto error;
+   }
+
+   if (!encoder->input_num || !encoder->output_num)
+   {
+      status = MMAL_ENOSYS;
+      vcos_log_error("JPEG encoder doesn't have input/output ports");
+      goto error;
+   }
+
+   encoder_input = encoder->input[0];
+   encoder_output = encoder->output[0];
+
+   mmal_format_copy(encoder_input->format, state->splitter_component->output[1]->format);
+
+   status = mmal_port_format_commit(encoder_input);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to set format on JPEG encoder input port");
+      goto error;
+   }
+
+   mmal_format_copy(encoder_output->format, encoder_input->format);
+   encoder_output->format->encoding = MMAL_ENCODING_JPEG;
+
+   encoder_output->buffer_size = encoder_output->buffer_size_recommended;
+
+   if (encoder_output->buffer_size < encoder_output->buffer_size_min)
+      encoder_output->buffer_size = encoder_output->buffer_size_min;
+
+   encoder_output->buffer_num = encoder_output->buffer_num_recommended;
+
+   if (encoder_output->buffer_num < encoder_output->buffer_num_min)
+      encoder_output->buffer_num = encoder_output->buffer_num_min;
+
+   status = mmal_port_format_commit(encoder_output);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to set format on JPEG encoder output port");
+      goto error;
+   }
+
+   status = mmal_port_parameter_set_uint32(encoder_output, MMAL_PARAMETER_JPEG_Q_FACTOR, state->jpegQuality);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to set JPEG quality");
+      goto error;
+   }
+
+   status = mmal_component_enable(encoder);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Unable to enable JPEG encoder component");
+      goto error;
+   }
+
+   pool = mmal_port_pool_create(encoder_output, encoder_output->buffer_num, encoder_output->buffer_size);
+
+   if (!pool)
+   {
+      vcos_log_error("Failed to create buffer header pool for JPEG encoder output port %s", encoder_output->name);
+   }
+
+   jpegBufferSize = (state->width * state->height) / 2;
+
+   if (jpegBufferSize < (int)encoder_output->buffer_size)
+      jpegBufferSize = encoder_output->buffer_size;
+
+   free(jpegBuffer);
+   jpegBuffer = (unsigned char *)malloc(jpegBufferSize);
+
+   if (!jpegBuffer)
+   {
+      status = MMAL_ENOMEM;
+      vcos_log_error("Unable to allocate %d bytes for JPEG frames", jpegBufferSize);
+      if (pool)
+         mmal_port_pool_destroy(encoder_output, pool);
+      goto error;
+   }
+
+   state->jpeg_pool = pool;
+   state->jpeg_component = encoder;
+   return status;
+
+   error:
+   if (encoder)
+      mmal_component_destroy(encoder);
+
+   state->jpeg_component = NULL;
+   return status;
+}
+
+/**
+ * Destroy the splitter and JPEG encoder components
+ *
+ * @param state Pointer to state control struct
+ *
+ */
+static void destroy_jpeg_components(RASPIVID_STATE *state)
+{
+   if (state->jpeg_pool)
+   {
+      mmal_port_pool_destroy(state->jpeg_component->output[0], state->jpeg_pool);
+      state->jpeg_pool = NULL;
+   }
+
+   if (state->jpeg_component)
+   {
+      mmal_component_destroy(state->jpeg_component);
+      state->jpeg_component = NULL;
+   }
+
+   free(jpegBuffer);
+   jpegBuffer = NULL;
+   jpegBufferSize = 0;
+
+   if (state->splitter_component)
+   {
+      mmal_component_destroy(state->splitter_component);
+      state->splitter_component = NULL;
+   }
+}
+
+/**
+ * Connect the splitter to the JPEG encoder through the ARM so that frames can be dropped
+ *
+ * @param state Pointer to state control struct
+ * @return Returns a MMAL_STATUS_T giving result of operation
+ *
+ */
+static MMAL_STATUS_T connect_jpeg(RASPIVID_STATE *state)
+{
+   MMAL_STATUS_T status;
+   MMAL_BUFFER_HEADER_T *buffer;
+   int num, q;
+
+   status = mmal_connection_create(&state->jpeg_connection, state->splitter_component->output[1],
+                                   state->jpeg_component->input[0], MMAL_CONNECTION_FLAG_ALLOCATION_ON_INPUT);
+
+   if (status != MMAL_SUCCESS)
+   {
+      state->jpeg_connection = NULL;
+      return status;
+   }
+
+   state->jpeg_connection->callback = jpeg_connection_callback;
+   state->jpeg_connection->user_data = (void *)state;
+
+   status = mmal_connection_enable(state->jpeg_connection);
+
+   if (status != MMAL_SUCCESS)
+   {
+      mmal_connection_destroy(state->jpeg_connection);
+      state->jpeg_connection = NULL;
+      return status;
+   }
+
+   jpeg_output_port = state->jpeg_component->output[0];
+   jpeg_output_port->userdata = (struct MMAL_PORT_USERDATA_T *)state;
+   jpegLength = 0;
+   jpegDiscard = 0;
+
+   status = mmal_port_enable(jpeg_output_port, jpeg_buffer_callback);
+
+   if (status != MMAL_SUCCESS)
+   {
+      vcos_log_error("Failed to setup JPEG encoder output");
+      return status;
+   }
+
+   num = mmal_queue_length(state->jpeg_pool->queue);
+
+   for (q = 0; q < num; q++)
+   {
+      buffer = mmal_queue_get(state->jpeg_pool->queue);
+
+      if (!buffer || (mmal_port_send_buffer(jpeg_output_port, buffer) != MMAL_SUCCESS))
+         vcos_log_error("Unable to send a buffer to JPEG encoder output port (%d)", q);
+   }
+
+   // prime the splitter output with the connection's buffers
+
+   jpeg_connection_callback(state->jpeg_connection);
+   return MMAL_SUCCESS;
+}
+
 /**
  * Connect two specific ports together
  *
@@ -714,7 +1134,8 @@ static void check_disable_port(MMAL_PORT_T *port)
 }
 
 
-int raspiInit(int width, int height, int frameRate, int compressedVideoRate)
+int raspiInit(int width, int height, int frameRate, int compressedVideoRate, int intraPeriod, int inlineVectors,
+              int jpegInterval, int jpegQuality)
 {
 
     bcm_host_init();
@@ -727,6 +1148,11 @@ int raspiInit(int width, int height, int frameRate, int compressedVideoRate)
     state.height = height;
     state.framerate = frameRate;
     state.bitrate = compressedVideoRate;
+    state.intraperiod = intraPeriod;
+    state.bInlineVectors = inlineVectors;
+    state.jpegInterval = jpegInterval;
+    if (jpegQuality > 0)
+        state.jpegQuality = jpegQuality;
 
     // OK, we have a nice set of parameters. Now set up our components
     // We have three components. Camera, Preview and encoder.
@@ -743,6 +1169,15 @@ int raspiInit(int width, int height, int frameRate, int compressedVideoRate)
         raspipreview_destroy(&state.preview_parameters);
         destroy_camera_component(&state);
         exit_code = EX_SOFTWARE;
+    } else if ((state.jpegInterval > 0) &&
+               (((status = create_splitter_component(&state)) != MMAL_SUCCESS) ||
+                ((status = create_jpeg_component(&state)) != MMAL_SUCCESS))) {
+        vcos_log_error("%s: Failed to create JPEG components", __func__);
+        destroy_jpeg_components(&state);
+        destroy_encoder_component(&state);
+        raspipreview_destroy(&state.preview_parameters);
+        destroy_camera_component(&state);
+        exit_code = EX_SOFTWARE;
     } else {
         if (state.verbose)
             fprintf(stderr, "Starting component connection stage\n");
@@ -773,8 +1208,21 @@ int raspiInit(int width, int height, int frameRate, int compressedVideoRate)
             if (state.verbose)
                 fprintf(stderr, "Connecting camera stills port to encoder input port\n");
 
-            // Now connect the camera to the encoder
-            status = connect_ports(camera_video_port, encoder_input_port, &state.encoder_connection);
+            // Now connect the camera to the encoder, through the splitter if the JPEG encoder wants frames too
+
+            if (state.splitter_component != NULL) {
+                status = connect_ports(camera_video_port, state.splitter_component->input[0], &state.splitter_connection);
+
+                if (status != MMAL_SUCCESS) {
+                    state.splitter_connection = NULL;
+                    vcos_log_error("%s: Failed to connect camera video port to splitter input", __func__);
+                    goto error;
+                }
+
+                status = connect_ports(state.splitter_component->output[0], encoder_input_port, &state.encoder_connection);
+            } else {
+                status = connect_ports(camera_video_port, encoder_input_port, &state.encoder_connection);
+            }
 
             if (status != MMAL_SUCCESS) {
                 state.encoder_connection = NULL;
@@ -782,6 +1230,11 @@ int raspiInit(int width, int height, int frameRate, int compressedVideoRate)
                 goto error;
             }
 
+            if ((state.splitter_component != NULL) && (connect_jpeg(&state) != MMAL_SUCCESS)) {
+                vcos_log_error("%s: Failed to connect splitter to JPEG encoder", __func__);
+                goto error;
+            }
+
             state.callback_data.file_handle = NULL;
 
 
@@ -842,6 +1295,13 @@ int raspiStartCapture()
 {
     if (state.verbose)
         fprintf(stderr, "Starting video capture\n");
+    return raspiRequestIFrame();
+}
+
+int raspiRequestIFrame()
+{
+    if (encoder_output_port == NULL)
+        return -1;
     if (mmal_port_parameter_set_boolean(encoder_output_port, MMAL_PARAMETER_VIDEO_REQUEST_I_FRAME, 1) != MMAL_SUCCESS) {
         vcos_log_error("failed to request I-FRAME");
         return -1;
@@ -849,6 +1309,20 @@ int raspiStartCapture()
     return EX_OK;
 }
 
+int raspiSetBitrate(int bitrate)
+{
+    if (encoder_output_port == NULL)
+        return -1;
+    if (bitrate > MAX_BITRATE)
+        bitrate = MAX_BITRATE;
+    if (mmal_port_parameter_set_uint32(encoder_output_port, MMAL_PARAMETER_VIDEO_BIT_RATE, bitrate) != MMAL_SUCCESS) {
+        vcos_log_error("failed to set bitrate");
+        return -1;
+    }
+    state.bitrate = bitrate;
+    return EX_OK;
+}
+
 void raspiClose()
 {
     if (state.verbose)
@@ -857,19 +1331,34 @@ void raspiClose()
     // Disable all our ports that are not handled by connections
     check_disable_port(camera_still_port);
     check_disable_port(encoder_output_port);
+    check_disable_port(jpeg_output_port);
 
     if (state.preview_parameters.wantPreview && state.preview_connection)
         mmal_connection_destroy(state.preview_connection);
 
+    if (state.jpeg_connection)
+        mmal_connection_destroy(state.jpeg_connection);
+    state.jpeg_connection = NULL;
+
     if (state.encoder_connection)
         mmal_connection_destroy(state.encoder_connection);
 
+    if (state.splitter_connection)
+        mmal_connection_destroy(state.splitter_connection);
+    state.splitter_connection = NULL;
+
     // Can now close our file. Note disabling ports may flush buffers which causes
     // problems if we have already closed the file!
     if (state.callback_data.file_handle && state.callback_data.file_handle != stdout)
         fclose(state.callback_data.file_handle);
 
     // Disable components
+    if (state.jpeg_component)
+        mmal_component_disable(state.jpeg_component);
+
+    if (state.splitter_component)
+        mmal_component_disable(state.splitter_component);
+
     if (state.encoder_component)
         mmal_component_disable(state.encoder_component);
 
@@ -879,7 +1368,10 @@ void raspiClose()
     if (state.camera_component)
         mmal_component_disable(state.camera_component);
 
+    destroy_jpeg_components(&state);
+    jpeg_output_port = NULL;
     destroy_encoder_component(&state);
+    encoder_output_port = NULL;
     raspipreview_destroy(&state.preview_parameters);
     destroy_camera_component(&state);
 
@@ -24,8 +24,11 @@
 extern "C" {
 #endif
 
-int raspiInit(int width, int height, int frameRate, int compressedVideoRate);
+int raspiInit(int width, int height, int frameRate, int compressedVideoRate, int intraPeriod, int inlineVectors,
+              int jpegInterval, int jpegQuality);
 int raspiStartCapture();
+int raspiRequestIFrame();
+int raspiSetBitrate(int bitrate);
 void raspiClose();
 
 #ifdef __cplusplus
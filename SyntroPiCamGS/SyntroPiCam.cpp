@@ -82,7 +82,10 @@ void SyntroPiCam::startVideo()
 	}
 
     connect(m_camera, SIGNAL(newVideo(QByteArray)), m_client, SLOT(newVideo(QByteArray)), Qt::DirectConnection);
+    connect(m_camera, SIGNAL(newMotionVectors(QByteArray)), m_client, SLOT(newMotionVectors(QByteArray)), Qt::DirectConnection);
+    connect(m_camera, SIGNAL(newJPEG(QByteArray)), m_client, SLOT(newJPEG(QByteArray)), Qt::DirectConnection);
     connect(m_camera, SIGNAL(videoFormat(int,int,int)), m_client, SLOT(videoFormat(int,int,int)));
+    m_client->setEncoderControl(m_camera);
 
     m_camera->resumeThread();
 }
@@ -91,7 +94,10 @@ void SyntroPiCam::stopVideo()
 {
 	if (m_camera) {
         disconnect(m_camera, SIGNAL(newVideo(QByteArray)), m_client, SLOT(newVideo(QByteArray)));
+        disconnect(m_camera, SIGNAL(newMotionVectors(QByteArray)), m_client, SLOT(newMotionVectors(QByteArray)));
+        disconnect(m_camera, SIGNAL(newJPEG(QByteArray)), m_client, SLOT(newJPEG(QByteArray)));
         disconnect(m_camera, SIGNAL(videoFormat(int,int,int)), m_client, SLOT(videoFormat(int,int,int)));
+        m_client->setEncoderControl(NULL);
 
         m_camera->exitThread();
 		m_camera = NULL;
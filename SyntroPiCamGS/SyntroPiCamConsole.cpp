@@ -39,6 +39,11 @@ SyntroPiCamConsole::SyntroPiCamConsole(bool daemonMode, QObject *parent)
 
     m_videoByteRate = 0;
     m_audioByteRate = 0;
+    m_videoQueueLatency = 0;
+    m_videoDropCount = 0;
+    m_timeToFirstPicture = -1;
+    m_audioLatency = 0;
+    m_audioSuppressedCount = 0;
 	m_frameRateTimer = 0;
 	m_camera = NULL;
     m_audio = NULL;
@@ -116,8 +121,11 @@ bool SyntroPiCamConsole::startVideo()
 		connect(m_camera, SIGNAL(cameraState(QString)), this, SLOT(cameraState(QString)), Qt::DirectConnection);
     }
     connect(m_camera, SIGNAL(newVideo(QByteArray)), m_client, SLOT(newVideo(QByteArray)), Qt::DirectConnection);
+    connect(m_camera, SIGNAL(newMotionVectors(QByteArray)), m_client, SLOT(newMotionVectors(QByteArray)), Qt::DirectConnection);
+    connect(m_camera, SIGNAL(newJPEG(QByteArray)), m_client, SLOT(newJPEG(QByteArray)), Qt::DirectConnection);
     connect(m_camera, SIGNAL(videoFormat(int,int,int)), this, SLOT(videoFormat(int,int,int)));
     connect(m_camera, SIGNAL(videoFormat(int,int,int)), m_client, SLOT(videoFormat(int,int,int)));
+    m_client->setEncoderControl(m_camera);
 
     m_camera->resumeThread();
 
@@ -131,8 +139,11 @@ void SyntroPiCamConsole::stopVideo()
             disconnect(m_camera, SIGNAL(cameraState(QString)), this, SLOT(cameraState(QString)));
         }
         disconnect(m_camera, SIGNAL(newVideo(QByteArray)), m_client, SLOT(newVideo(QByteArray)));
+        disconnect(m_camera, SIGNAL(newMotionVectors(QByteArray)), m_client, SLOT(newMotionVectors(QByteArray)));
+        disconnect(m_camera, SIGNAL(newJPEG(QByteArray)), m_client, SLOT(newJPEG(QByteArray)));
         disconnect(m_camera, SIGNAL(videoFormat(int,int,int)), this, SLOT(videoFormat(int,int,int)));
         disconnect(m_camera, SIGNAL(videoFormat(int,int,int)), m_client, SLOT(videoFormat(int,int,int)));
+        m_client->setEncoderControl(NULL);
 
         m_camera->exitThread();
         m_camera = NULL;
@@ -179,6 +190,11 @@ void SyntroPiCamConsole::timerEvent(QTimerEvent *)
 {
     m_videoByteRate = (double)m_client->getVideoByteCount() / (double)RATE_TIMER_INTERVAL;
     m_audioByteRate = (double)m_client->getAudioByteCount() / (double)RATE_TIMER_INTERVAL;
+    m_videoQueueLatency = m_client->getVideoQueueLatency();
+    m_videoDropCount = m_client->getVideoDropCount();
+    m_timeToFirstPicture = m_client->getTimeToFirstPicture();
+    m_audioLatency = m_client->getAudioLatency();
+    m_audioSuppressedCount = m_client->getAudioSuppressedCount();
 }
 
 void SyntroPiCamConsole::showHelp()
@@ -196,6 +212,12 @@ void SyntroPiCamConsole::showStatus()
     if (m_cameraState == "Running") {
         printf("Video byte rate : %f bytes per second\n", m_videoByteRate);
         printf("Audio byte rate : %f bytes per second\n", m_audioByteRate);
+        printf("Video queue latency : %f uS\n", m_videoQueueLatency);
+        printf("Video segments dropped : %d\n", m_videoDropCount);
+        if (m_timeToFirstPicture >= 0)
+            printf("Time to first picture : %d mS\n", m_timeToFirstPicture);
+        printf("Audio encode latency : %f mS\n", m_audioLatency);
+        printf("Audio blocks suppressed : %d\n", m_audioSuppressedCount);
     } else {
         printf("Camera state    : %s\n", qPrintable(m_cameraState));
     }
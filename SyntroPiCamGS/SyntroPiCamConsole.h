@@ -67,6 +67,11 @@ private:
     int m_frameRateTimer;
     double m_videoByteRate;
     double m_audioByteRate;
+    double m_videoQueueLatency;
+    int m_videoDropCount;
+    int m_timeToFirstPicture;
+    double m_audioLatency;
+    int m_audioSuppressedCount;
 	bool m_daemonMode;
 	static volatile bool sigIntReceived;
 
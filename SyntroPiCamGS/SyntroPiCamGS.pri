@@ -28,7 +28,13 @@ HEADERS += SyntroPiCam.h \
         RaspiCamControl.h \
         RaspiPreview.h \
     	RaspiDriver.h \
-	AVMuxEncodeGS.h
+	AVMuxEncodeGS.h \
+	BitrateController.h \
+	EncoderControl.h \
+	MotionVectorAnalyser.h \
+	MP4FragmentWriter.h \
+	MP4Recorder.h \
+	RTPPacketiser.h
 
 SOURCES += main.cpp \
         SyntroPiCam.cpp \
@@ -39,7 +45,12 @@ SOURCES += main.cpp \
     	RaspiCamControl.c \
     	RaspiPreview.c \
     	RaspiDriver.c \
-	AVMuxEncodeGS.cpp
+	AVMuxEncodeGS.cpp \
+	BitrateController.cpp \
+	MotionVectorAnalyser.cpp \
+	MP4FragmentWriter.cpp \
+	MP4Recorder.cpp \
+	RTPPacketiser.cpp
 
 FORMS +=
 
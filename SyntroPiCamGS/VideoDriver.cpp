@@ -27,11 +27,26 @@
 #define MAXIMUM_RATE   30
 #define DEFAULT_RATE   10
 
+//  a picture still without a frame end at this size is passed on as it is rather than
+//  growing without limit
+
+#define MAXIMUM_FRAME_LENGTH    (4 * 1024 * 1024)
+
 static VideoDriver *theDriver;
 
-extern "C" void newCompressedVideoSegment(unsigned char *data, int length)
+extern "C" void newCompressedVideoSegment(unsigned char *data, int length, int frameEnd)
+{
+    theDriver->newCompressedDataSegment(data, length, frameEnd != 0);
+}
+
+extern "C" void newMotionVectors(unsigned char *data, int length)
 {
-    theDriver->newCompressedDataSegment(data, length);
+    theDriver->newMotionVectorData(data, length);
+}
+
+extern "C" void newJpegFrame(unsigned char *data, int length)
+{
+    theDriver->newJpegData(data, length);
 }
 
 VideoDriver::VideoDriver() : SyntroThread("VideoDriver", "SyntroPiCam")
@@ -41,6 +56,11 @@ VideoDriver::VideoDriver() : SyntroThread("VideoDriver", "SyntroPiCam")
 	m_height = DEFAULT_HEIGHT;
 	m_frameRate = DEFAULT_RATE;
     m_deviceOpen = false;
+    m_motionVectors = false;
+    m_intraPeriod = 0;
+    m_jpegInterval = 0;
+    m_jpegQuality = 0;
+    m_pendingBitrate = -1;
  }
 
 VideoDriver::~VideoDriver()
@@ -48,9 +68,67 @@ VideoDriver::~VideoDriver()
 
 }
 
-void VideoDriver::newCompressedDataSegment(unsigned char *data, int length)
+void VideoDriver::newCompressedDataSegment(unsigned char *data, int length, bool frameEnd)
+{
+    //  the usual case is a whole picture in one buffer which needs no assembly
+
+    if (frameEnd && m_videoFrame.isEmpty()) {
+        emit newVideo(QByteArray((const char *)data, length));
+        return;
+    }
+
+    m_videoFrame.append((const char *)data, length);
+
+    if (!frameEnd && (m_videoFrame.length() < MAXIMUM_FRAME_LENGTH))
+        return;
+
+    emit newVideo(m_videoFrame);
+    m_videoFrame.clear();
+}
+
+void VideoDriver::newMotionVectorData(unsigned char *data, int length)
+{
+    emit newMotionVectors(QByteArray((const char *)data, length));
+}
+
+void VideoDriver::newJpegData(unsigned char *data, int length)
+{
+    emit newJPEG(QByteArray((const char *)data, length));
+}
+
+void VideoDriver::requestIDR()
+{
+    //  usually called from the encoder's callback thread which mustn't wait on the encoder
+
+    QMetaObject::invokeMethod(this, "sendIDRRequest", Qt::QueuedConnection);
+}
+
+void VideoDriver::setBitrate(int bitrate)
+{
+    //  only the latest value matters if several are queued
+
+    m_pendingBitrateLock.lock();
+    m_pendingBitrate = bitrate;
+    m_pendingBitrateLock.unlock();
+
+    QMetaObject::invokeMethod(this, "sendBitrate", Qt::QueuedConnection);
+}
+
+void VideoDriver::sendBitrate()
+{
+    m_pendingBitrateLock.lock();
+    int bitrate = m_pendingBitrate;
+    m_pendingBitrate = -1;
+    m_pendingBitrateLock.unlock();
+
+    if (m_deviceOpen && (bitrate > 0))
+        raspiSetBitrate(bitrate);
+}
+
+void VideoDriver::sendIDRRequest()
 {
-    emit newVideo(QByteArray((const char *)data, length));
+    if (m_deviceOpen)
+        raspiRequestIFrame();
 }
 
 void VideoDriver::loadSettings()
@@ -99,6 +177,25 @@ void VideoDriver::loadSettings()
     settings->beginGroup(CAMCLIENT_STREAM_GROUP);
 
     m_compressedVideoRate = settings->value(CAMCLIENT_GS_VIDEO_RATE).toInt();
+    m_intraPeriod = settings->value(CAMCLIENT_GS_INTRAPERIOD).toInt();
+
+    //  the JPEG encoder is only added to the camera pipeline if the MJPEG stream is wanted
+
+    m_jpegInterval = 0;
+    if (settings->value(CAMCLIENT_GENERATE_MJPEG).toBool()) {
+        m_jpegInterval = settings->value(CAMCLIENT_MJPEG_INTERVAL).toInt();
+        if (m_jpegInterval <= 0)
+            m_jpegInterval = 1;
+    }
+    m_jpegQuality = settings->value(CAMCLIENT_MJPEG_QUALITY).toInt();
+
+    settings->endGroup();
+
+    //  the encoder only needs to produce vectors if they are going to be used
+
+    settings->beginGroup(CAMCLIENT_MOTION_GROUP);
+
+    m_motionVectors = settings->value(CAMCLIENT_MOTION_VECTORS).toBool();
 
     settings->endGroup();
 
@@ -122,7 +219,8 @@ void VideoDriver::newCamera()
 	closeDevice();
 	loadSettings();
 
-    if (raspiInit(m_width, m_height, m_frameRate, m_compressedVideoRate) == 0) {
+    if (raspiInit(m_width, m_height, m_frameRate, m_compressedVideoRate, m_intraPeriod, m_motionVectors,
+                  m_jpegInterval, m_jpegQuality) == 0) {
         m_deviceOpen = true;
         emit cameraState("Running");
         emit videoFormat(m_width, m_height, m_frameRate);
@@ -138,6 +236,7 @@ void VideoDriver::closeDevice()
     if (m_deviceOpen)
         raspiClose();
     m_deviceOpen = false;
+    m_videoFrame.clear();
     emit cameraState("Closed");
 }
 
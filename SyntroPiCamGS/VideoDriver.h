@@ -25,7 +25,9 @@
 #include <QSettings>
 #include <qimage.h>
 
-class VideoDriver : public SyntroThread
+#include "EncoderControl.h"
+
+class VideoDriver : public SyntroThread, public EncoderControl
 {
 	Q_OBJECT
 
@@ -39,15 +41,26 @@ public:
     void setPreviewPos(int x, int y);
 	QSize getImageSize();
 
-    void newCompressedDataSegment(unsigned char *data, int length);
+    void newCompressedDataSegment(unsigned char *data, int length, bool frameEnd);
+    void newMotionVectorData(unsigned char *data, int length);
+    void newJpegData(unsigned char *data, int length);
+
+    void requestIDR();
+    void setBitrate(int bitrate);
 
 public slots:
 
 signals:
     void videoFormat(int width, int height, int frameRate);
-    void newVideo(QByteArray);
+    void newVideo(QByteArray);                              // one whole access unit
+    void newMotionVectors(QByteArray);
+    void newJPEG(QByteArray);
 	void cameraState(QString state);
 
+private slots:
+    void sendIDRRequest();
+    void sendBitrate();
+
 protected:
 	void initThread();
 	void finishThread();
@@ -62,6 +75,15 @@ private:
 	int m_height;
     qreal m_frameRate;
     int m_compressedVideoRate;
+    int m_intraPeriod;                                      // frames between IDRs, 0 for the encoder default
+    bool m_motionVectors;
+    int m_jpegInterval;                                     // min mS between JPEGs, 0 for no JPEG encoder
+    int m_jpegQuality;
+
+    int m_pendingBitrate;                                   // latest setBitrate() value, -1 once applied
+    QMutex m_pendingBitrateLock;
+
+    QByteArray m_videoFrame;                                // picture being assembled from encoder buffers
 
     bool m_deviceOpen;
 
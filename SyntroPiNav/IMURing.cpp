@@ -0,0 +1,77 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "IMURing.h"
+
+//  The indexes run freely and wrap as unsigned, only the masked value indexes m_ring.
+//  fetchAndAddAcquire(0) is the acquire load that works with both Qt4 and Qt5.
+
+IMURing::IMURing()
+{
+    m_head = 0;
+    m_tail = 0;
+    m_dropCount = 0;
+}
+
+bool IMURing::put(const RTIMU_DATA& data)
+{
+    unsigned int head = (unsigned int)m_head.fetchAndAddAcquire(0);
+    unsigned int tail = (unsigned int)m_tail.fetchAndAddAcquire(0);
+
+    if ((head - tail) >= IMURING_SIZE) {
+        m_dropCount.fetchAndAddOrdered(1);
+        return false;
+    }
+
+    m_ring[head & IMURING_MASK] = data;
+
+    //  the release makes the sample visible before the new head
+
+    m_head.fetchAndStoreRelease((int)(head + 1));
+    return true;
+}
+
+int IMURing::take(QVector<RTIMU_DATA>& samples)
+{
+    unsigned int head = (unsigned int)m_head.fetchAndAddAcquire(0);
+    unsigned int tail = (unsigned int)m_tail.fetchAndAddAcquire(0);
+    int count = head - tail;
+
+    //  resizing to the same or a smaller size doesn't reallocate
+
+    samples.resize(count);
+
+    for (int i = 0; i < count; i++)
+        samples[i] = m_ring[(tail + i) & IMURING_MASK];
+
+    //  the slots can only be reused once they have been copied
+
+    m_tail.fetchAndStoreRelease((int)head);
+    return count;
+}
+
+void IMURing::discard()
+{
+    m_tail.fetchAndStoreRelease(m_head.fetchAndAddAcquire(0));
+}
+
+int IMURing::getDropCount()
+{
+    return m_dropCount.fetchAndStoreOrdered(0);
+}
@@ -0,0 +1,57 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _IMURING_H
+#define	_IMURING_H
+
+#include <qatomic.h>
+#include <qvector.h>
+
+#include "RTIMULibDefs.h"
+
+//  number of samples the ring holds - must be a power of 2. About 1 second at 1kHz
+
+#define IMURING_SIZE        1024
+#define IMURING_MASK        (IMURING_SIZE - 1)
+
+//  Single producer, single consumer ring of IMU samples. The IMU thread puts and the
+//  NavClient thread takes, neither ever waits for the other. The storage is allocated
+//  once so nothing is allocated per sample. If the ring is full the new sample is dropped
+//  and counted as the consumer owns the oldest.
+
+class IMURing
+{
+public:
+    IMURing();
+
+    bool put(const RTIMU_DATA& data);                       // producer only. false if dropped
+    int take(QVector<RTIMU_DATA>& samples);                 // consumer only. Replaces samples with everything
+                                                            // available now, returns the count
+    void discard();                                         // consumer only. Drops everything available now
+    int getDropCount();                                     // samples dropped since the last call
+
+private:
+    RTIMU_DATA m_ring[IMURING_SIZE];
+
+    QAtomicInt m_head;                                      // next slot to write - only the producer changes it
+    QAtomicInt m_tail;                                      // next slot to read - only the consumer changes it
+    QAtomicInt m_dropCount;
+};
+
+#endif // _IMURING_H
@@ -21,13 +21,27 @@
 #include "RTIMUSettings.h"
 #include "RTFusion.h"
 #include "RTIMU.h"
+#include "SimulatedIMU.h"
 
 #include "SyntroPiNav.h"
 
+#include <qfile.h>
+
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 IMUThread::IMUThread() : SyntroThread("IMUThread", "IMUThread")
 {
     m_calibrationMode = false;
     m_settings = new RTIMUSettings("RTIMULib");
+    m_imu = NULL;
+    m_timer = -1;
+    m_wakeFd = -1;
+    m_wakeIsTimer = false;
+    m_wakeNotifier = NULL;
+
+    loadSettings();
 }
 
 IMUThread::~IMUThread()
@@ -35,17 +49,44 @@ IMUThread::~IMUThread()
 
 }
 
+void IMUThread::loadSettings()
+{
+    QSettings *settings = SyntroUtils::getSettings();
+
+    settings->beginGroup(IMUTHREAD_GROUP);
+
+    if (!settings->contains(IMUTHREAD_DRDY_GPIO))
+        settings->setValue(IMUTHREAD_DRDY_GPIO, "-1");
+
+    if (!settings->contains(IMUTHREAD_SAMPLE_INTERVAL))
+        settings->setValue(IMUTHREAD_SAMPLE_INTERVAL, "0");
+
+    if (!settings->contains(IMUTHREAD_SIMULATE))
+        settings->setValue(IMUTHREAD_SIMULATE, false);
+
+    if (!settings->contains(IMUTHREAD_SIMULATED_RATE))
+        settings->setValue(IMUTHREAD_SIMULATED_RATE, "500");
+
+    m_drdyGPIO = settings->value(IMUTHREAD_DRDY_GPIO).toInt();
+    m_sampleInterval = settings->value(IMUTHREAD_SAMPLE_INTERVAL).toInt();
+    m_simulate = settings->value(IMUTHREAD_SIMULATE).toBool();
+    m_simulatedRate = settings->value(IMUTHREAD_SIMULATED_RATE).toInt();
+    if (m_simulatedRate <= 0)
+        m_simulatedRate = 500;
+
+    settings->endGroup();
+
+    delete settings;
+}
 
 void IMUThread::initThread()
 {
-    m_imu = NULL;
-    m_timer = -1;
     newIMU();
 }
 
 void IMUThread::finishThread()
 {
-    killTimer(m_timer);
+    stopSampling();
 
     if (m_imu != NULL)
         delete m_imu;
@@ -57,12 +98,19 @@ void IMUThread::finishThread()
 
 void IMUThread::newIMU()
 {
+    stopSampling();
+
     if (m_imu != NULL) {
         delete m_imu;
         m_imu = NULL;
     }
 
-    m_imu = RTIMU::createIMU(m_settings);
+    loadSettings();
+
+    if (m_simulate)
+        m_imu = new SimulatedIMU(m_settings, m_simulatedRate);
+    else
+        m_imu = RTIMU::createIMU(m_settings);
 
     if (m_imu == NULL)
         return;
@@ -71,25 +119,180 @@ void IMUThread::newIMU()
 
     m_imu->IMUInit();
 
-    m_timer = startTimer(m_imu->IMUGetPollInterval());
+    startSampling();
 }
 
+void IMUThread::startSampling()
+{
+    int interval = m_sampleInterval;
+
+    if (interval <= 0) {
+        if (m_simulate)
+            interval = 1000000 / m_simulatedRate;
+        else
+            interval = m_imu->IMUGetPollInterval() * 1000;
+    }
+
+    if (interval <= 0)
+        interval = 1000;
+
+    //  the data ready line is best as it follows the sensor's own clock. A timerfd at
+    //  the sample interval is next. The Qt timer only has mS resolution so is the last resort.
+
+    if ((m_drdyGPIO >= 0) && openDataReady()) {
+        m_timer = startTimer(IMUTHREAD_DRDY_BACKSTOP);
+        return;
+    }
+
+    if (openSampleTimer(interval))
+        return;
+
+    m_timer = startTimer(qMax(interval / 1000, 1));
+}
+
+void IMUThread::stopSampling()
+{
+    if (m_timer != -1)
+        killTimer(m_timer);
+    m_timer = -1;
+
+    if (m_wakeNotifier != NULL)
+        delete m_wakeNotifier;
+    m_wakeNotifier = NULL;
+
+    if (m_wakeFd != -1)
+        ::close(m_wakeFd);
+    m_wakeFd = -1;
+}
+
+bool IMUThread::openDataReady()
+{
+    QString gpioPath = QString("/sys/class/gpio/gpio%1").arg(m_drdyGPIO);
+    QFile file;
+    char buffer[8];
+
+    if (!QFile::exists(gpioPath)) {
+        file.setFileName("/sys/class/gpio/export");
+        if (!file.open(QIODevice::WriteOnly)) {
+            appLogError(QString("Failed to export GPIO %1 for IMU data ready").arg(m_drdyGPIO));
+            return false;
+        }
+        file.write(QByteArray::number(m_drdyGPIO));
+        file.close();
+    }
+
+    file.setFileName(gpioPath + "/direction");
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write("in");
+        file.close();
+    }
+
+    file.setFileName(gpioPath + "/edge");
+    if (!file.open(QIODevice::WriteOnly)) {
+        appLogError(QString("Failed to set edge on GPIO %1 for IMU data ready").arg(m_drdyGPIO));
+        return false;
+    }
+    file.write("rising");
+    file.close();
+
+    m_wakeFd = ::open(qPrintable(gpioPath + "/value"), O_RDONLY | O_NONBLOCK);
+
+    if (m_wakeFd == -1) {
+        appLogError(QString("Failed to open GPIO %1 for IMU data ready").arg(m_drdyGPIO));
+        return false;
+    }
+
+    //  the value has to be read once before poll() waits for the next edge
+
+    if (::read(m_wakeFd, buffer, sizeof(buffer)) < 0)
+        appLogError(QString("Failed to read GPIO %1").arg(m_drdyGPIO));
+
+    //  sysfs signals an edge as POLLPRI, which is an exception as far as select() is concerned
+
+    m_wakeIsTimer = false;
+    m_wakeNotifier = new QSocketNotifier(m_wakeFd, QSocketNotifier::Exception, this);
+    connect(m_wakeNotifier, SIGNAL(activated(int)), this, SLOT(dataReady()));
+    return true;
+}
+
+bool IMUThread::openSampleTimer(int interval)
+{
+    struct itimerspec spec;
+
+    m_wakeFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (m_wakeFd == -1) {
+        appLogError("Failed to create IMU sample timer");
+        return false;
+    }
+
+    spec.it_interval.tv_sec = interval / 1000000;
+    spec.it_interval.tv_nsec = (interval % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+
+    if (timerfd_settime(m_wakeFd, 0, &spec, NULL) == -1) {
+        appLogError("Failed to start IMU sample timer");
+        ::close(m_wakeFd);
+        m_wakeFd = -1;
+        return false;
+    }
+
+    m_wakeIsTimer = true;
+    m_wakeNotifier = new QSocketNotifier(m_wakeFd, QSocketNotifier::Read, this);
+    connect(m_wakeNotifier, SIGNAL(activated(int)), this, SLOT(dataReady()));
+    return true;
+}
+
+void IMUThread::dataReady()
+{
+    char buffer[8];
+
+    //  clear the wake up. For the timer it's the number of expiries, which doesn't matter
+    //  as everything available is read anyway
+
+    if (m_wakeIsTimer) {
+        if (::read(m_wakeFd, buffer, sizeof(buffer)) < 0)
+            return;
+    } else {
+        lseek(m_wakeFd, 0, SEEK_SET);
+        if (::read(m_wakeFd, buffer, sizeof(buffer)) < 0)
+            appLogError(QString("Failed to read GPIO %1").arg(m_drdyGPIO));
+    }
+
+    readSamples();
+}
 
 void IMUThread::timerEvent(QTimerEvent * /* event */)
 {
+    readSamples();
+}
+
+void IMUThread::readSamples()
+{
+    bool perSample;
+
     if (m_imu == NULL)
         return;
 
-    if (m_imu->IMUType() == RTIMU_TYPE_NULL)
+    if (!m_simulate && (m_imu->IMUType() == RTIMU_TYPE_NULL))
         return;
 
+    //  the calibration dialogs still want every sample on its own
+
+    perSample = receivers(SIGNAL(newIMUData(const RTIMU_DATA&))) > 0;
+
+    m_batch.clear();
+
     while (m_imu->IMURead()) {
         if (m_calibrationMode) {
             emit newCalData(m_imu->getCompass());
         } else {
-            emit newIMUData(m_imu->getIMUData());
+            m_batch.append(m_imu->getIMUData());
+            if (perSample)
+                emit newIMUData(m_imu->getIMUData());
         }
     }
-}
-
 
+    if (!m_batch.empty())
+        emit newIMUBatch(m_batch);
+}
@@ -25,11 +25,38 @@
 #include "RTMath.h"
 #include "RTIMULibDefs.h"
 
+#include <qsocketnotifier.h>
+
 class RTIMU;
 class RTIMUSettings;
 
 Q_DECLARE_METATYPE(RTIMU_DATA);
 
+//  group name for the IMU sampling entries
+
+#define IMUTHREAD_GROUP                 "IMUGroup"
+
+//  GPIO number of the IMU's data ready line. Samples are read on its rising edge. -1 if not wired
+
+#define IMUTHREAD_DRDY_GPIO             "DataReadyGPIO"
+
+//  interval in uS between reads when there is no data ready line. 0 uses the IMU's poll interval.
+//  Set it to match the sensor's output data rate when that's faster than the poll interval
+
+#define IMUTHREAD_SAMPLE_INTERVAL       "SampleInterval"
+
+//  true to use a simulated IMU rather than the one RTIMULib.ini selects
+
+#define IMUTHREAD_SIMULATE              "SimulateIMU"
+
+//  sample rate in Hz of the simulated IMU
+
+#define IMUTHREAD_SIMULATED_RATE        "SimulatedRate"
+
+//  interval in mS of the backstop timer used with the data ready line in case an edge is missed
+
+#define IMUTHREAD_DRDY_BACKSTOP         100
+
 class IMUThread : public SyntroThread
 {
     Q_OBJECT
@@ -47,19 +74,41 @@ public slots:
 
 signals:
     void newCalData(const RTVector3& compass);
-    void newIMUData(const RTIMU_DATA& data);
+    void newIMUData(const RTIMU_DATA& data);                // one per sample - only emitted if connected
+    void newIMUBatch(const QList<RTIMU_DATA>& batch);       // all the samples read on one wake up
 
 protected:
     void initThread();
     void finishThread();
     void timerEvent(QTimerEvent *event);
 
+private slots:
+    void dataReady();
+
 private:
+    void loadSettings();
+    void startSampling();
+    void stopSampling();
+    bool openDataReady();
+    bool openSampleTimer(int interval);
+    void readSamples();
+
     int m_timer;
     RTIMUSettings *m_settings;
 
     RTIMU *m_imu;
     bool m_calibrationMode;
+
+    int m_drdyGPIO;
+    int m_sampleInterval;                                   // uS, 0 for the IMU's poll interval
+    bool m_simulate;
+    int m_simulatedRate;
+
+    int m_wakeFd;                                           // data ready line or timerfd, -1 if neither
+    bool m_wakeIsTimer;
+    QSocketNotifier *m_wakeNotifier;
+
+    QList<RTIMU_DATA> m_batch;
 };
 
 #endif // _IMUTHREAD_H
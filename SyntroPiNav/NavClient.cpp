@@ -20,6 +20,7 @@
 #include "SyntroLib.h"
 #include "NavClient.h"
 #include "SyntroNavDefs.h"
+#include "NavCompact.h"
 
 #include <qdebug.h>
 
@@ -27,10 +28,37 @@ NavClient::NavClient(QObject *)
     : Endpoint(NAVCLIENT_BACKGROUND_INTERVAL, "NavClient")
 {
     m_servicePort = -1;
+    m_compactRecords = false;
+    m_pendingDropCount = 0;
+
+    QSettings *settings = SyntroUtils::getSettings();
+
+    settings->beginGroup(NAVCLIENT_STREAM_GROUP);
+
+    if (!settings->contains(NAVCLIENT_COMPACT_RECORDS))
+        settings->setValue(NAVCLIENT_COMPACT_RECORDS, false);
+
+    //  the default entry shows the format but is disabled
+
+    if (!settings->contains(QString(NAVCLIENT_DECIMATED_STREAMS) + "/size")) {
+        settings->beginWriteArray(NAVCLIENT_DECIMATED_STREAMS, 1);
+        settings->setArrayIndex(0);
+        settings->setValue(NAVCLIENT_DECIMATED_NAME, QString(SYNTRO_STREAMNAME_NAV) + "lr");
+        settings->setValue(NAVCLIENT_DECIMATED_RATE, "0");
+        settings->setValue(NAVCLIENT_DECIMATED_FACTOR, "0");
+        settings->setValue(NAVCLIENT_DECIMATED_AVERAGE, true);
+        settings->endArray();
+    }
+
+    settings->endGroup();
+
+    delete settings;
 }
 
 NavClient::~NavClient()
 {
+    qDeleteAll(m_decimatedStreams);
+    m_decimatedStreams.clear();
 }
 
 
@@ -44,110 +72,185 @@ void NavClient::appClientExit()
 
 }
 
+int NavClient::getDropCount()
+{
+    return m_imuRing.getDropCount() + m_pendingDropCount.fetchAndStoreOrdered(0);
+}
+
 void NavClient::appClientBackground()
 {
-    QMutexLocker locker(&m_navLock);
-    SYNTRO_NAVDATA data;
-    RTIMU_DATA localData;
     int recordCount;
-    int totalLength;
-    int validFields;
+    bool fullActive;
+    bool anyActive;
 
-    if (m_imuData.empty())
-        return;
+    fullActive = (m_servicePort != -1) && clientIsServiceActive(m_servicePort);
+    anyActive = fullActive;
 
-    if (m_servicePort == -1)
-        return;
+    if (!fullActive)
+        m_pending.clear();
 
-    if (!clientIsServiceActive(m_servicePort) || !clientClearToSend(m_servicePort))
-        return;                                             // can't send for network reasons
+    for (int i = 0; i < m_decimatedStreams.count(); i++) {
+        NAVCLIENT_STREAM *stream = m_decimatedStreams.at(i);
 
-    recordCount = m_imuData.count();
-    totalLength = sizeof(SYNTRO_NAVDATA) * recordCount;
+        stream->active = clientIsServiceActive(stream->servicePort);
 
-    SYNTRO_EHEAD *multiCast = clientBuildMessage(m_servicePort, sizeof(SYNTRO_RECORD_HEADER) + totalLength);
-    SYNTRO_RECORD_HEADER *head = (SYNTRO_RECORD_HEADER *)(multiCast + 1);
-    SyntroUtils::convertIntToUC2(SYNTRO_RECORD_TYPE_NAV, head->type);
-    SyntroUtils::convertIntToUC2(SYNTRO_RECORD_TYPE_NAV_IMU, head->subType);
-    SyntroUtils::convertIntToUC2(sizeof(SYNTRO_RECORD_HEADER), head->headerLength);
-    SyntroUtils::convertInt64ToUC8(SyntroClock(), head->timestamp);
+        //  a new subscriber starts with a fresh filter
 
-    for (int record = 0; record < recordCount; record++) {
+        if (!stream->active) {
+            stream->decimator.reset();
+            stream->pending.clear();
+        }
+        anyActive |= stream->active;
+    }
 
-        localData = m_imuData.dequeue();
+    if (!anyActive) {
+        // can't send for network reasons so dump queue
+        m_imuRing.discard();
+        return;
+    }
 
-        validFields = 0;
+    //  the ring is free for the IMU thread again as soon as the snapshot is taken. Every
+    //  stream is fed from the same converted samples.
 
-        if (localData.fusionPoseValid)
-            validFields |= SYNTRO_NAVDATA_VALID_FUSIONPOSE;
-        if (localData.fusionQPoseValid)
-            validFields |= SYNTRO_NAVDATA_VALID_FUSIONQPOSE;
-        if (localData.gyroValid)
-            validFields |= SYNTRO_NAVDATA_VALID_GYRO;
-        if (localData.accelValid)
-            validFields |= SYNTRO_NAVDATA_VALID_ACCEL;
-        if (localData.compassValid)
-            validFields |= SYNTRO_NAVDATA_VALID_COMPASS;
-        if (localData.compassValid)
-            validFields |= SYNTRO_NAVDATA_VALID_PRESSURE;
-        if (localData.compassValid)
-            validFields |= SYNTRO_NAVDATA_VALID_TEMPERATURE;
-        if (localData.compassValid)
-            validFields |= SYNTRO_NAVDATA_VALID_HUMIDITY;
+    recordCount = m_imuRing.take(m_imuData);
 
-        SyntroUtils::convertIntToUC2(validFields, data.validFields);
+    m_navData.resize(recordCount);
 
-        data.fusionPose[0] = localData.fusionPose.x();
-        data.fusionPose[1] = localData.fusionPose.y();
-        data.fusionPose[2] = localData.fusionPose.z();
+    for (int record = 0; record < recordCount; record++)
+        fillNavData(m_imuData.at(record), m_navData[record]);
 
-        data.fusionQPose[0] = localData.fusionQPose.scalar();
-        data.fusionQPose[1] = localData.fusionQPose.x();
-        data.fusionQPose[2] = localData.fusionQPose.y();
-        data.fusionQPose[3] = localData.fusionQPose.z();
+    if (fullActive) {
+        m_pending += m_navData;
+        trimPending(m_pending);
+        sendPending(m_servicePort, m_pending);
+    }
 
-        data.gyro[0] = localData.gyro.x();
-        data.gyro[1] = localData.gyro.y();
-        data.gyro[2] = localData.gyro.z();
+    for (int i = 0; i < m_decimatedStreams.count(); i++) {
+        NAVCLIENT_STREAM *stream = m_decimatedStreams.at(i);
 
-        data.accel[0] = localData.accel.x();
-        data.accel[1] = localData.accel.y();
-        data.accel[2] = localData.accel.z();
+        if (!stream->active)
+            continue;
 
-        data.compass[0] = localData.compass.x();
-        data.compass[1] = localData.compass.y();
-        data.compass[2] = localData.compass.z();
+        stream->decimator.process(m_navData.constData(), recordCount, stream->pending);
+        trimPending(stream->pending);
+        sendPending(stream->servicePort, stream->pending);
+    }
+}
 
-        data.pressure = localData.pressure;
-        data.temperature = localData.temperature;
-        data.humidity = localData.humidity;
+void NavClient::trimPending(QVector<SYNTRO_NAVDATA>& pending)
+{
+    int excess = pending.count() - NAVCLIENT_PENDING_MAX;
 
-        SyntroUtils::convertInt64ToUC8(localData.timestamp, data.timestamp);
+    if (excess <= 0)
+        return;
 
-        memcpy(((SYNTRO_NAVDATA *)(head + 1)) + record, &data, sizeof(SYNTRO_NAVDATA));
-    }
-    clientSendMessage(m_servicePort, multiCast, sizeof(SYNTRO_RECORD_HEADER) + totalLength, SYNTROLINK_MEDPRI);
+    pending.remove(0, excess);
+    m_pendingDropCount.fetchAndAddOrdered(excess);
 }
 
-void NavClient::newIMUData(const RTIMU_DATA& data)
+void NavClient::sendPending(int servicePort, QVector<SYNTRO_NAVDATA>& pending)
 {
-    QMutexLocker locker(&m_navLock);
-    if ((m_servicePort == -1) || !clientIsServiceActive(m_servicePort)) {
-        // can't send for network reasons so dump queue
-        m_imuData.clear();
-        return;
+    int recordCount = pending.count();
+    int totalLength;
+
+    if ((recordCount == 0) || !clientClearToSend(servicePort))
+        return;                                             // leave it pending until the link clears
+
+    if (m_compactRecords) {
+        SYNTRO_EHEAD *multiCast = clientBuildMessage(servicePort, sizeof(SYNTRO_RECORD_HEADER) + NavCompact::maxLength(recordCount));
+        SYNTRO_RECORD_HEADER *head = (SYNTRO_RECORD_HEADER *)(multiCast + 1);
+        SyntroUtils::convertIntToUC2(SYNTRO_RECORD_TYPE_NAV, head->type);
+        SyntroUtils::convertIntToUC2(SYNTRO_RECORD_TYPE_NAV_IMU_COMPACT, head->subType);
+        SyntroUtils::convertIntToUC2(sizeof(SYNTRO_RECORD_HEADER), head->headerLength);
+        SyntroUtils::convertInt64ToUC8(SyntroClock(), head->timestamp);
+
+        totalLength = NavCompact::encode(pending.constData(), recordCount, (unsigned char *)(head + 1));
+        clientSendMessage(servicePort, multiCast, sizeof(SYNTRO_RECORD_HEADER) + totalLength, SYNTROLINK_MEDPRI);
+    } else {
+        totalLength = sizeof(SYNTRO_NAVDATA) * recordCount;
+
+        SYNTRO_EHEAD *multiCast = clientBuildMessage(servicePort, sizeof(SYNTRO_RECORD_HEADER) + totalLength);
+        SYNTRO_RECORD_HEADER *head = (SYNTRO_RECORD_HEADER *)(multiCast + 1);
+        SyntroUtils::convertIntToUC2(SYNTRO_RECORD_TYPE_NAV, head->type);
+        SyntroUtils::convertIntToUC2(SYNTRO_RECORD_TYPE_NAV_IMU, head->subType);
+        SyntroUtils::convertIntToUC2(sizeof(SYNTRO_RECORD_HEADER), head->headerLength);
+        SyntroUtils::convertInt64ToUC8(SyntroClock(), head->timestamp);
+
+        memcpy(head + 1, pending.constData(), totalLength);
+        clientSendMessage(servicePort, multiCast, sizeof(SYNTRO_RECORD_HEADER) + totalLength, SYNTROLINK_MEDPRI);
     }
+    pending.clear();
+}
 
-    m_imuData.enqueue(data);
+void NavClient::fillNavData(const RTIMU_DATA& localData, SYNTRO_NAVDATA& data)
+{
+    int validFields = 0;
+
+    if (localData.fusionPoseValid)
+        validFields |= SYNTRO_NAVDATA_VALID_FUSIONPOSE;
+    if (localData.fusionQPoseValid)
+        validFields |= SYNTRO_NAVDATA_VALID_FUSIONQPOSE;
+    if (localData.gyroValid)
+        validFields |= SYNTRO_NAVDATA_VALID_GYRO;
+    if (localData.accelValid)
+        validFields |= SYNTRO_NAVDATA_VALID_ACCEL;
+    if (localData.compassValid)
+        validFields |= SYNTRO_NAVDATA_VALID_COMPASS;
+    if (localData.pressureValid)
+        validFields |= SYNTRO_NAVDATA_VALID_PRESSURE;
+    if (localData.temperatureValid)
+        validFields |= SYNTRO_NAVDATA_VALID_TEMPERATURE;
+    if (localData.humidityValid)
+        validFields |= SYNTRO_NAVDATA_VALID_HUMIDITY;
+
+    SyntroUtils::convertIntToUC2(validFields, data.validFields);
+
+    data.fusionPose[0] = localData.fusionPose.x();
+    data.fusionPose[1] = localData.fusionPose.y();
+    data.fusionPose[2] = localData.fusionPose.z();
+
+    data.fusionQPose[0] = localData.fusionQPose.scalar();
+    data.fusionQPose[1] = localData.fusionQPose.x();
+    data.fusionQPose[2] = localData.fusionQPose.y();
+    data.fusionQPose[3] = localData.fusionQPose.z();
+
+    data.gyro[0] = localData.gyro.x();
+    data.gyro[1] = localData.gyro.y();
+    data.gyro[2] = localData.gyro.z();
+
+    data.accel[0] = localData.accel.x();
+    data.accel[1] = localData.accel.y();
+    data.accel[2] = localData.accel.z();
+
+    data.compass[0] = localData.compass.x();
+    data.compass[1] = localData.compass.y();
+    data.compass[2] = localData.compass.z();
+
+    data.pressure = localData.pressure;
+    data.temperature = localData.temperature;
+    data.humidity = localData.humidity;
+
+    SyntroUtils::convertInt64ToUC8(localData.timestamp, data.timestamp);
+}
 
-    if (m_imuData.count() > 50) {
-        // stop queue getting stupidly big
-        m_imuData.dequeue();
-        qDebug() << "NavClient queue overflow";
-    }
+void NavClient::newIMUBatch(const QList<RTIMU_DATA>& batch)
+{
+    //  called from the IMU thread. A full ring drops and counts the samples rather than waiting
+
+    for (int i = 0; i < batch.count(); i++)
+        m_imuRing.put(batch.at(i));
 }
 
 
+void NavClient::removeDecimatedStreams()
+{
+    for (int i = 0; i < m_decimatedStreams.count(); i++)
+        clientRemoveService(m_decimatedStreams.at(i)->servicePort);
+
+    qDeleteAll(m_decimatedStreams);
+    m_decimatedStreams.clear();
+}
+
 void NavClient::newStream()
 {
     // remove the old streams
@@ -155,5 +258,44 @@ void NavClient::newStream()
     if (m_servicePort != -1)
         clientRemoveService(m_servicePort);
 
+    removeDecimatedStreams();
+    m_pending.clear();
+
     m_servicePort = clientAddService(SYNTRO_STREAMNAME_NAV, SERVICETYPE_MULTICAST, true);
+
+    QSettings *settings = SyntroUtils::getSettings();
+
+    settings->beginGroup(NAVCLIENT_STREAM_GROUP);
+
+    m_compactRecords = settings->value(NAVCLIENT_COMPACT_RECORDS).toBool();
+
+    int count = settings->beginReadArray(NAVCLIENT_DECIMATED_STREAMS);
+
+    for (int i = 0; i < count; i++) {
+        settings->setArrayIndex(i);
+
+        QString name = settings->value(NAVCLIENT_DECIMATED_NAME).toString();
+        int rate = settings->value(NAVCLIENT_DECIMATED_RATE).toInt();
+        int factor = settings->value(NAVCLIENT_DECIMATED_FACTOR).toInt();
+
+        if ((rate <= 0) && (factor <= 1))
+            continue;
+
+        if (name.isEmpty() || (name == SYNTRO_STREAMNAME_NAV)) {
+            appLogError(QString("Decimated nav stream %1 needs a name of its own").arg(i));
+            continue;
+        }
+
+        NAVCLIENT_STREAM *stream = new NAVCLIENT_STREAM;
+        stream->servicePort = clientAddService(name, SERVICETYPE_MULTICAST, true);
+        stream->active = false;
+        stream->decimator.setRate(rate, factor, settings->value(NAVCLIENT_DECIMATED_AVERAGE).toBool());
+        m_decimatedStreams.append(stream);
+    }
+
+    settings->endArray();
+
+    settings->endGroup();
+
+    delete settings;
 }
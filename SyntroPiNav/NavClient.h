@@ -20,16 +20,57 @@
 #ifndef NAVCLIENT_H
 #define NAVCLIENT_H
 
-#include <qmutex.h>
-#include <QMutex>
-#include <QQueue>
+#include <QVector>
 
 #include "SyntroLib.h"
 
 #include "RTIMULib.h"
+#include "SyntroNavDefs.h"
+#include "IMURing.h"
+#include "NavDecimator.h"
 
 #define NAVCLIENT_BACKGROUND_INTERVAL    (SYNTRO_CLOCKS_PER_SEC / 100)
 
+//  group name for stream-related entries
+
+#define NAVCLIENT_STREAM_GROUP           "StreamGroup"
+
+//  true to send SYNTRO_RECORD_TYPE_NAV_IMU_COMPACT records rather than SYNTRO_NAVDATA
+
+#define NAVCLIENT_COMPACT_RECORDS        "CompactRecords"
+
+//  array of extra services carrying a reduced rate version of the nav stream
+
+#define NAVCLIENT_DECIMATED_STREAMS      "DecimatedStreams"
+
+//  service name of a reduced rate stream. Must differ from the full rate service
+
+#define NAVCLIENT_DECIMATED_NAME         "Name"
+
+//  output rate in Hz. 0 uses Factor instead
+
+#define NAVCLIENT_DECIMATED_RATE         "Rate"
+
+//  send one in Factor samples. The stream is disabled if Rate is 0 and Factor is 0 or 1
+
+#define NAVCLIENT_DECIMATED_FACTOR       "Factor"
+
+//  true to send the average of the samples since the last output rather than just the latest
+
+#define NAVCLIENT_DECIMATED_AVERAGE      "Average"
+
+//  max samples waiting for clear to send on any one stream. The oldest are dropped beyond this
+
+#define NAVCLIENT_PENDING_MAX            IMURING_SIZE
+
+typedef struct
+{
+    int servicePort;
+    bool active;                                            // the service had subscribers at the last check
+    NavDecimator decimator;
+    QVector<SYNTRO_NAVDATA> pending;                        // samples waiting for clear to send
+} NAVCLIENT_STREAM;
+
 class NavClient : public Endpoint
 {
 	Q_OBJECT
@@ -38,8 +79,10 @@ public:
     NavClient(QObject *parent);
     virtual ~NavClient();
 
+    int getDropCount();                                     // samples lost to a full ring or queue since the last call
+
 public slots:
-    void newIMUData(const RTIMU_DATA& data);
+    void newIMUBatch(const QList<RTIMU_DATA>& batch);
 
     void newStream();
 
@@ -49,10 +92,22 @@ protected:
 	void appClientBackground();
 
 private:
-    QMutex m_navLock;
-    QQueue<RTIMU_DATA> m_imuData;
+    void fillNavData(const RTIMU_DATA& imuData, SYNTRO_NAVDATA& data);
+    void trimPending(QVector<SYNTRO_NAVDATA>& pending);
+    void sendPending(int servicePort, QVector<SYNTRO_NAVDATA>& pending);
+    void removeDecimatedStreams();
+
+    IMURing m_imuRing;                                      // filled by the IMU thread
+    QVector<RTIMU_DATA> m_imuData;                          // the latest snapshot of the ring
+    QVector<SYNTRO_NAVDATA> m_navData;                      // m_imuData converted, feeds every stream
 
     int m_servicePort;
+    bool m_compactRecords;
+    QVector<SYNTRO_NAVDATA> m_pending;                      // full rate samples waiting for clear to send
+
+    QList<NAVCLIENT_STREAM *> m_decimatedStreams;
+
+    QAtomicInt m_pendingDropCount;
 };
 
 #endif // NAVCLIENT_H
@@ -0,0 +1,212 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "NavCompact.h"
+
+#include <string.h>
+
+//  presence bits in the order the fields are sent, with their SYNTRO_NAVDATA valid bits
+
+static const int presenceMap[][2] = {
+    {NAVCOMPACT_PRESENT_FUSIONPOSE, SYNTRO_NAVDATA_VALID_FUSIONPOSE},
+    {NAVCOMPACT_PRESENT_FUSIONQPOSE, SYNTRO_NAVDATA_VALID_FUSIONQPOSE},
+    {NAVCOMPACT_PRESENT_GYRO, SYNTRO_NAVDATA_VALID_GYRO},
+    {NAVCOMPACT_PRESENT_ACCEL, SYNTRO_NAVDATA_VALID_ACCEL},
+    {NAVCOMPACT_PRESENT_COMPASS, SYNTRO_NAVDATA_VALID_COMPASS},
+    {NAVCOMPACT_PRESENT_PRESSURE, SYNTRO_NAVDATA_VALID_PRESSURE},
+    {NAVCOMPACT_PRESENT_TEMPERATURE, SYNTRO_NAVDATA_VALID_TEMPERATURE},
+    {NAVCOMPACT_PRESENT_HUMIDITY, SYNTRO_NAVDATA_VALID_HUMIDITY}
+};
+
+#define NAVCOMPACT_FIELD_COUNT  8
+
+int NavCompact::encode(const SYNTRO_NAVDATA *samples, int count, unsigned char *buffer)
+{
+    unsigned char *ptr = buffer;
+    qint64 base;
+
+    base = (count > 0) ? SyntroUtils::convertUC8ToInt64(samples[0].timestamp) : 0;
+
+    *ptr++ = NAVCOMPACT_VERSION;
+    *ptr++ = count & 0xff;
+    *ptr++ = (count >> 8) & 0xff;
+
+    for (int i = 0; i < 8; i++)
+        *ptr++ = (unsigned char)((quint64)base >> (i * 8));
+
+    for (int sample = 0; sample < count; sample++) {
+        const SYNTRO_NAVDATA *data = samples + sample;
+        int validFields = SyntroUtils::convertUC2ToInt(data->validFields);
+        int presence = 0;
+
+        for (int field = 0; field < NAVCOMPACT_FIELD_COUNT; field++) {
+            if (validFields & presenceMap[field][1])
+                presence |= presenceMap[field][0];
+        }
+
+        *ptr++ = presence;
+
+        //  zigzag so that a sample older than the base still encodes small
+
+        qint64 delta = SyntroUtils::convertUC8ToInt64(data->timestamp) - base;
+        quint64 zigzag = ((quint64)delta << 1) ^ (quint64)(delta >> 63);
+
+        while (zigzag >= 0x80) {
+            *ptr++ = (zigzag & 0x7f) | 0x80;
+            zigzag >>= 7;
+        }
+        *ptr++ = zigzag;
+
+        if (presence & NAVCOMPACT_PRESENT_FUSIONPOSE)
+            ptr = putValues(ptr, data->fusionPose, 3, NAVCOMPACT_SCALE_FUSIONPOSE, 0);
+        if (presence & NAVCOMPACT_PRESENT_FUSIONQPOSE)
+            ptr = putValues(ptr, data->fusionQPose, 4, NAVCOMPACT_SCALE_FUSIONQPOSE, 0);
+        if (presence & NAVCOMPACT_PRESENT_GYRO)
+            ptr = putValues(ptr, data->gyro, 3, NAVCOMPACT_SCALE_GYRO, 0);
+        if (presence & NAVCOMPACT_PRESENT_ACCEL)
+            ptr = putValues(ptr, data->accel, 3, NAVCOMPACT_SCALE_ACCEL, 0);
+        if (presence & NAVCOMPACT_PRESENT_COMPASS)
+            ptr = putValues(ptr, data->compass, 3, NAVCOMPACT_SCALE_COMPASS, 0);
+        if (presence & NAVCOMPACT_PRESENT_PRESSURE)
+            ptr = putValues(ptr, &data->pressure, 1, NAVCOMPACT_SCALE_PRESSURE, NAVCOMPACT_OFFSET_PRESSURE);
+        if (presence & NAVCOMPACT_PRESENT_TEMPERATURE)
+            ptr = putValues(ptr, &data->temperature, 1, NAVCOMPACT_SCALE_TEMPERATURE, 0);
+        if (presence & NAVCOMPACT_PRESENT_HUMIDITY)
+            ptr = putValues(ptr, &data->humidity, 1, NAVCOMPACT_SCALE_HUMIDITY, 0);
+    }
+    return ptr - buffer;
+}
+
+int NavCompact::decode(const unsigned char *buffer, int length, SYNTRO_NAVDATA *samples, int maxCount)
+{
+    const unsigned char *ptr = buffer;
+    const unsigned char *end = buffer + length;
+    quint64 base = 0;
+    int count;
+
+    if ((length < NAVCOMPACT_HEADER_SIZE) || (ptr[0] != NAVCOMPACT_VERSION))
+        return -1;
+
+    count = ptr[1] | (ptr[2] << 8);
+    if (count > maxCount)
+        return -1;
+
+    for (int i = 0; i < 8; i++)
+        base |= (quint64)ptr[3 + i] << (i * 8);
+    ptr += NAVCOMPACT_HEADER_SIZE;
+
+    for (int sample = 0; sample < count; sample++) {
+        SYNTRO_NAVDATA *data = samples + sample;
+        int presence;
+        int validFields = 0;
+        int valueCount = 0;
+        quint64 zigzag = 0;
+        int shift = 0;
+
+        memset(data, 0, sizeof(SYNTRO_NAVDATA));
+
+        if (ptr >= end)
+            return -1;
+
+        presence = *ptr++;
+
+        do {
+            if ((ptr >= end) || (shift > 63))
+                return -1;
+            zigzag |= (quint64)(*ptr & 0x7f) << shift;
+            shift += 7;
+        } while (*ptr++ & 0x80);
+
+        qint64 delta = (qint64)(zigzag >> 1) ^ -(qint64)(zigzag & 1);
+
+        SyntroUtils::convertInt64ToUC8((qint64)base + delta, data->timestamp);
+
+        for (int field = 0; field < NAVCOMPACT_FIELD_COUNT; field++) {
+            if (presence & presenceMap[field][0])
+                validFields |= presenceMap[field][1];
+        }
+        SyntroUtils::convertIntToUC2(validFields, data->validFields);
+
+        //  check the values are all there before reading any of them
+
+        valueCount += (presence & NAVCOMPACT_PRESENT_FUSIONPOSE) ? 3 : 0;
+        valueCount += (presence & NAVCOMPACT_PRESENT_FUSIONQPOSE) ? 4 : 0;
+        valueCount += (presence & NAVCOMPACT_PRESENT_GYRO) ? 3 : 0;
+        valueCount += (presence & NAVCOMPACT_PRESENT_ACCEL) ? 3 : 0;
+        valueCount += (presence & NAVCOMPACT_PRESENT_COMPASS) ? 3 : 0;
+        valueCount += (presence & NAVCOMPACT_PRESENT_PRESSURE) ? 1 : 0;
+        valueCount += (presence & NAVCOMPACT_PRESENT_TEMPERATURE) ? 1 : 0;
+        valueCount += (presence & NAVCOMPACT_PRESENT_HUMIDITY) ? 1 : 0;
+
+        if ((end - ptr) < (valueCount * 2))
+            return -1;
+
+        if (presence & NAVCOMPACT_PRESENT_FUSIONPOSE)
+            ptr = getValues(ptr, data->fusionPose, 3, NAVCOMPACT_SCALE_FUSIONPOSE, 0);
+        if (presence & NAVCOMPACT_PRESENT_FUSIONQPOSE)
+            ptr = getValues(ptr, data->fusionQPose, 4, NAVCOMPACT_SCALE_FUSIONQPOSE, 0);
+        if (presence & NAVCOMPACT_PRESENT_GYRO)
+            ptr = getValues(ptr, data->gyro, 3, NAVCOMPACT_SCALE_GYRO, 0);
+        if (presence & NAVCOMPACT_PRESENT_ACCEL)
+            ptr = getValues(ptr, data->accel, 3, NAVCOMPACT_SCALE_ACCEL, 0);
+        if (presence & NAVCOMPACT_PRESENT_COMPASS)
+            ptr = getValues(ptr, data->compass, 3, NAVCOMPACT_SCALE_COMPASS, 0);
+        if (presence & NAVCOMPACT_PRESENT_PRESSURE)
+            ptr = getValues(ptr, &data->pressure, 1, NAVCOMPACT_SCALE_PRESSURE, NAVCOMPACT_OFFSET_PRESSURE);
+        if (presence & NAVCOMPACT_PRESENT_TEMPERATURE)
+            ptr = getValues(ptr, &data->temperature, 1, NAVCOMPACT_SCALE_TEMPERATURE, 0);
+        if (presence & NAVCOMPACT_PRESENT_HUMIDITY)
+            ptr = getValues(ptr, &data->humidity, 1, NAVCOMPACT_SCALE_HUMIDITY, 0);
+    }
+    return count;
+}
+
+unsigned char *NavCompact::putValues(unsigned char *ptr, const float *values, int count, float scale, float offset)
+{
+    for (int i = 0; i < count; i++) {
+        float scaled = (values[i] - offset) / scale;
+        int quantised;
+
+        //  saturate rather than wrap. NaN ends up as zero
+
+        if (scaled >= 32767.0f)
+            quantised = 32767;
+        else if (scaled <= -32768.0f)
+            quantised = -32768;
+        else if (scaled == scaled)
+            quantised = (int)(scaled + ((scaled >= 0) ? 0.5f : -0.5f));
+        else
+            quantised = 0;
+
+        *ptr++ = quantised & 0xff;
+        *ptr++ = (quantised >> 8) & 0xff;
+    }
+    return ptr;
+}
+
+const unsigned char *NavCompact::getValues(const unsigned char *ptr, float *values, int count, float scale, float offset)
+{
+    for (int i = 0; i < count; i++) {
+        qint16 quantised = (qint16)(ptr[0] | (ptr[1] << 8));
+
+        values[i] = (float)quantised * scale + offset;
+        ptr += 2;
+    }
+    return ptr;
+}
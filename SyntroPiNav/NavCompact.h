@@ -0,0 +1,101 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef NAVCOMPACT_H
+#define NAVCOMPACT_H
+
+#include "SyntroLib.h"
+#include "SyntroNavDefs.h"
+
+//  record subtype for the compact format. This needs to stay in step with SyntroNavDefs.h
+
+#ifndef SYNTRO_RECORD_TYPE_NAV_IMU_COMPACT
+#define SYNTRO_RECORD_TYPE_NAV_IMU_COMPACT  32
+#endif
+
+//  A compact record follows the SYNTRO_RECORD_HEADER. All multi byte values are little endian.
+//
+//  version (uint8), sample count (uint16), base timestamp in uS (uint64)
+//
+//  then for each sample:
+//
+//  presence (uint8) - NAVCOMPACT_PRESENT_* bits for the fields that follow
+//  timestamp - sample timestamp minus the base timestamp in uS as a zigzag varint
+//  each present field in bit order as int16 fixed point values, saturated to the int16 range
+
+#define NAVCOMPACT_VERSION              1
+
+#define NAVCOMPACT_HEADER_SIZE          11
+
+#define NAVCOMPACT_PRESENT_FUSIONPOSE   0x01            // 3 values, radians
+#define NAVCOMPACT_PRESENT_FUSIONQPOSE  0x02            // 4 values, scalar x y z
+#define NAVCOMPACT_PRESENT_GYRO         0x04            // 3 values, radians per second
+#define NAVCOMPACT_PRESENT_ACCEL        0x08            // 3 values, g
+#define NAVCOMPACT_PRESENT_COMPASS      0x10            // 3 values, uT
+#define NAVCOMPACT_PRESENT_PRESSURE     0x20            // 1 value, hPa
+#define NAVCOMPACT_PRESENT_TEMPERATURE  0x40            // 1 value, degrees C
+#define NAVCOMPACT_PRESENT_HUMIDITY     0x80            // 1 value, % RH
+
+//  value = int16 * scale + offset. The scales give these ranges and resolutions:
+//
+//  fusion pose     +/-3.28 rad         0.0001 rad
+//  fusion qpose    +/-1                1/32767
+//  gyro            +/-65.5 rad/s       0.002 rad/s
+//  accel           +/-16.4 g           0.0005 g
+//  compass         +/-3277 uT          0.1 uT
+//  pressure        -638 to 2638 hPa    0.05 hPa
+//  temperature     +/-327 C            0.01 C
+//  humidity        +/-327 %            0.01 %
+
+#define NAVCOMPACT_SCALE_FUSIONPOSE     0.0001f
+#define NAVCOMPACT_SCALE_FUSIONQPOSE    (1.0f / 32767.0f)
+#define NAVCOMPACT_SCALE_GYRO           0.002f
+#define NAVCOMPACT_SCALE_ACCEL          0.0005f
+#define NAVCOMPACT_SCALE_COMPASS        0.1f
+#define NAVCOMPACT_SCALE_PRESSURE       0.05f
+#define NAVCOMPACT_OFFSET_PRESSURE      1000.0f
+#define NAVCOMPACT_SCALE_TEMPERATURE    0.01f
+#define NAVCOMPACT_SCALE_HUMIDITY       0.01f
+
+//  worst case bytes for one sample - presence, a 10 byte varint and all 19 values
+
+#define NAVCOMPACT_SAMPLE_MAX           (1 + 10 + 19 * 2)
+
+class NavCompact
+{
+public:
+    //  worst case length of an encoded batch
+
+    static int maxLength(int count) { return NAVCOMPACT_HEADER_SIZE + count * NAVCOMPACT_SAMPLE_MAX; }
+
+    //  encodes count samples into buffer, which must be at least maxLength(count). Returns the bytes used
+
+    static int encode(const SYNTRO_NAVDATA *samples, int count, unsigned char *buffer);
+
+    //  the reference decoder. Expands a batch back to SYNTRO_NAVDATA, fields that weren't present
+    //  are zero. Returns the number of samples or -1 if the record is malformed or has more than maxCount
+
+    static int decode(const unsigned char *buffer, int length, SYNTRO_NAVDATA *samples, int maxCount);
+
+private:
+    static unsigned char *putValues(unsigned char *ptr, const float *values, int count, float scale, float offset);
+    static const unsigned char *getValues(const unsigned char *ptr, float *values, int count, float scale, float offset);
+};
+
+#endif // NAVCOMPACT_H
@@ -0,0 +1,234 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "NavDecimator.h"
+
+#include <math.h>
+#include <string.h>
+
+//  index of each SYNTRO_NAVDATA valid bit in m_fieldCount
+
+#define NAVDECIMATOR_FUSIONPOSE     0
+#define NAVDECIMATOR_FUSIONQPOSE    1
+#define NAVDECIMATOR_GYRO           2
+#define NAVDECIMATOR_ACCEL          3
+#define NAVDECIMATOR_COMPASS        4
+#define NAVDECIMATOR_PRESSURE       5
+#define NAVDECIMATOR_TEMPERATURE    6
+#define NAVDECIMATOR_HUMIDITY       7
+
+static const int validBits[8] = {
+    SYNTRO_NAVDATA_VALID_FUSIONPOSE,
+    SYNTRO_NAVDATA_VALID_FUSIONQPOSE,
+    SYNTRO_NAVDATA_VALID_GYRO,
+    SYNTRO_NAVDATA_VALID_ACCEL,
+    SYNTRO_NAVDATA_VALID_COMPASS,
+    SYNTRO_NAVDATA_VALID_PRESSURE,
+    SYNTRO_NAVDATA_VALID_TEMPERATURE,
+    SYNTRO_NAVDATA_VALID_HUMIDITY
+};
+
+NavDecimator::NavDecimator()
+{
+    m_interval = 0;
+    m_factor = 1;
+    m_average = false;
+    reset();
+}
+
+void NavDecimator::setRate(int rate, int factor, bool average)
+{
+    m_interval = (rate > 0) ? (1000000 / rate) : 0;
+    m_factor = (factor > 0) ? factor : 1;
+    m_average = average;
+    reset();
+}
+
+void NavDecimator::reset()
+{
+    m_nextOutput = -1;
+    clearSums();
+}
+
+void NavDecimator::clearSums()
+{
+    m_count = 0;
+
+    memset(m_poseSin, 0, sizeof(m_poseSin));
+    memset(m_poseCos, 0, sizeof(m_poseCos));
+    memset(m_qpose, 0, sizeof(m_qpose));
+    memset(m_gyro, 0, sizeof(m_gyro));
+    memset(m_accel, 0, sizeof(m_accel));
+    memset(m_compass, 0, sizeof(m_compass));
+    m_pressure = 0;
+    m_temperature = 0;
+    m_humidity = 0;
+    memset(m_fieldCount, 0, sizeof(m_fieldCount));
+}
+
+void NavDecimator::process(const SYNTRO_NAVDATA *samples, int count, QVector<SYNTRO_NAVDATA>& output)
+{
+    for (int i = 0; i < count; i++) {
+        const SYNTRO_NAVDATA& data = samples[i];
+        bool due;
+
+        if (m_average)
+            accumulate(data);
+        m_count++;
+
+        if (m_interval > 0) {
+            qint64 timestamp = SyntroUtils::convertUC8ToInt64(data.timestamp);
+
+            if (m_nextOutput == -1)
+                m_nextOutput = timestamp;
+
+            due = timestamp >= m_nextOutput;
+
+            if (due) {
+                //  stay on the output grid unless there has been a gap, then restart it
+
+                m_nextOutput += m_interval;
+                if (m_nextOutput <= timestamp)
+                    m_nextOutput = timestamp + m_interval;
+            }
+        } else {
+            due = m_count >= m_factor;
+        }
+
+        if (!due)
+            continue;
+
+        output.append(data);
+
+        if (m_average)
+            average(output.last());
+
+        clearSums();
+    }
+}
+
+void NavDecimator::accumulate(const SYNTRO_NAVDATA& data)
+{
+    int validFields = SyntroUtils::convertUC2ToInt(data.validFields);
+
+    if (validFields & SYNTRO_NAVDATA_VALID_FUSIONPOSE) {
+        for (int i = 0; i < 3; i++) {
+            m_poseSin[i] += sin(data.fusionPose[i]);
+            m_poseCos[i] += cos(data.fusionPose[i]);
+        }
+    }
+
+    if (validFields & SYNTRO_NAVDATA_VALID_FUSIONQPOSE) {
+        double dot = 0;
+
+        //  q and -q are the same rotation so flip any that point away from the sum so far
+
+        for (int i = 0; i < 4; i++)
+            dot += m_qpose[i] * data.fusionQPose[i];
+
+        for (int i = 0; i < 4; i++)
+            m_qpose[i] += (dot < 0) ? -data.fusionQPose[i] : data.fusionQPose[i];
+    }
+
+    if (validFields & SYNTRO_NAVDATA_VALID_GYRO) {
+        for (int i = 0; i < 3; i++)
+            m_gyro[i] += data.gyro[i];
+    }
+
+    if (validFields & SYNTRO_NAVDATA_VALID_ACCEL) {
+        for (int i = 0; i < 3; i++)
+            m_accel[i] += data.accel[i];
+    }
+
+    if (validFields & SYNTRO_NAVDATA_VALID_COMPASS) {
+        for (int i = 0; i < 3; i++)
+            m_compass[i] += data.compass[i];
+    }
+
+    if (validFields & SYNTRO_NAVDATA_VALID_PRESSURE)
+        m_pressure += data.pressure;
+
+    if (validFields & SYNTRO_NAVDATA_VALID_TEMPERATURE)
+        m_temperature += data.temperature;
+
+    if (validFields & SYNTRO_NAVDATA_VALID_HUMIDITY)
+        m_humidity += data.humidity;
+
+    for (int field = 0; field < 8; field++) {
+        if (validFields & validBits[field])
+            m_fieldCount[field]++;
+    }
+}
+
+void NavDecimator::average(SYNTRO_NAVDATA& data)
+{
+    int validFields = 0;
+    int n;
+
+    //  a field is valid in the output if it was valid in any of the samples averaged
+
+    for (int field = 0; field < 8; field++) {
+        if (m_fieldCount[field] > 0)
+            validFields |= validBits[field];
+    }
+
+    SyntroUtils::convertIntToUC2(validFields, data.validFields);
+
+    if (m_fieldCount[NAVDECIMATOR_FUSIONPOSE] > 0) {
+        for (int i = 0; i < 3; i++)
+            data.fusionPose[i] = atan2(m_poseSin[i], m_poseCos[i]);
+    }
+
+    if (m_fieldCount[NAVDECIMATOR_FUSIONQPOSE] > 0) {
+        double length = 0;
+
+        for (int i = 0; i < 4; i++)
+            length += m_qpose[i] * m_qpose[i];
+        length = sqrt(length);
+
+        if (length > 0) {
+            for (int i = 0; i < 4; i++)
+                data.fusionQPose[i] = m_qpose[i] / length;
+        }
+    }
+
+    if ((n = m_fieldCount[NAVDECIMATOR_GYRO]) > 0) {
+        for (int i = 0; i < 3; i++)
+            data.gyro[i] = m_gyro[i] / n;
+    }
+
+    if ((n = m_fieldCount[NAVDECIMATOR_ACCEL]) > 0) {
+        for (int i = 0; i < 3; i++)
+            data.accel[i] = m_accel[i] / n;
+    }
+
+    if ((n = m_fieldCount[NAVDECIMATOR_COMPASS]) > 0) {
+        for (int i = 0; i < 3; i++)
+            data.compass[i] = m_compass[i] / n;
+    }
+
+    if ((n = m_fieldCount[NAVDECIMATOR_PRESSURE]) > 0)
+        data.pressure = m_pressure / n;
+
+    if ((n = m_fieldCount[NAVDECIMATOR_TEMPERATURE]) > 0)
+        data.temperature = m_temperature / n;
+
+    if ((n = m_fieldCount[NAVDECIMATOR_HUMIDITY]) > 0)
+        data.humidity = m_humidity / n;
+}
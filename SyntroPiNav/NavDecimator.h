@@ -0,0 +1,74 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef NAVDECIMATOR_H
+#define NAVDECIMATOR_H
+
+#include "SyntroLib.h"
+#include "SyntroNavDefs.h"
+
+#include <qvector.h>
+
+//  Reduces a stream of SYNTRO_NAVDATA samples to a lower rate, either to a target rate
+//  based on the sample timestamps or by passing every Nth sample.
+//
+//  With averaging on, each output is the mean of all the samples since the last output
+//  rather than just the last of them. That's a boxcar anti-alias filter with its first null
+//  at the output rate and half an output interval of delay. The pose angles use a circular
+//  mean and the quaternion a sign aligned, normalised mean so neither breaks at the wrap.
+
+class NavDecimator
+{
+public:
+    NavDecimator();
+
+    void setRate(int rate, int factor, bool average);       // rate in Hz, or factor if rate is 0
+    void reset();
+
+    //  appends the output samples for the input samples to output
+
+    void process(const SYNTRO_NAVDATA *samples, int count, QVector<SYNTRO_NAVDATA>& output);
+
+private:
+    void clearSums();
+    void accumulate(const SYNTRO_NAVDATA& data);
+    void average(SYNTRO_NAVDATA& data);
+
+    qint64 m_interval;                                      // uS between outputs in rate mode, 0 in factor mode
+    int m_factor;
+    bool m_average;
+
+    qint64 m_nextOutput;                                    // timestamp due for the next output, -1 to send the next sample
+    int m_count;                                            // samples since the last output
+
+    //  sums since the last output
+
+    double m_poseSin[3];
+    double m_poseCos[3];
+    double m_qpose[4];
+    double m_gyro[3];
+    double m_accel[3];
+    double m_compass[3];
+    double m_pressure;
+    double m_temperature;
+    double m_humidity;
+    int m_fieldCount[8];                                    // samples with each valid bit set, in bit order
+};
+
+#endif // NAVDECIMATOR_H
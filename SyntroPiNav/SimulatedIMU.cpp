@@ -0,0 +1,107 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "SimulatedIMU.h"
+
+#include <math.h>
+
+//  rate of turn about z in degrees per second
+
+#define SIMULATEDIMU_TURN_RATE      10.0
+
+//  if the reader falls this far behind in uS the missing samples are skipped rather than
+//  generated in one burst
+
+#define SIMULATEDIMU_MAX_BACKLOG    1000000
+
+SimulatedIMU::SimulatedIMU(RTIMUSettings *settings, int rate) : RTIMUNull(settings)
+{
+    m_interval = 1000000 / ((rate > 0) ? rate : 1);
+    m_nextSample = 0;
+    m_sampleCount = 0;
+    m_noiseSeed = 1;
+}
+
+bool SimulatedIMU::IMUInit()
+{
+    m_nextSample = RTMath::currentUSecsSinceEpoch();
+    m_sampleCount = 0;
+    return RTIMUNull::IMUInit();
+}
+
+int SimulatedIMU::IMUGetPollInterval()
+{
+    int interval = (int)(m_interval / 1000);
+
+    return (interval > 0) ? interval : 1;
+}
+
+bool SimulatedIMU::IMURead()
+{
+    RTIMU_DATA data;
+    uint64_t now = RTMath::currentUSecsSinceEpoch();
+
+    if (now < m_nextSample)
+        return false;
+
+    if ((now - m_nextSample) > SIMULATEDIMU_MAX_BACKLOG)
+        m_nextSample = now;
+
+    float heading = (float)(m_sampleCount * m_interval) / 1000000.0f * SIMULATEDIMU_TURN_RATE * RTMATH_DEGREE_TO_RAD;
+
+    data.timestamp = m_nextSample;
+
+    data.gyroValid = true;
+    data.gyro = RTVector3(noise(0.002f), noise(0.002f), SIMULATEDIMU_TURN_RATE * RTMATH_DEGREE_TO_RAD + noise(0.002f));
+
+    data.accelValid = true;
+    data.accel = RTVector3(noise(0.005f), noise(0.005f), 1.0f + noise(0.005f));
+
+    data.compassValid = true;
+    data.compass = RTVector3(30.0f * cos(heading) + noise(0.5f), -30.0f * sin(heading) + noise(0.5f), -40.0f + noise(0.5f));
+
+    data.pressureValid = true;
+    data.pressure = 1013.25f + noise(0.05f);
+
+    data.temperatureValid = true;
+    data.temperature = 20.0f + noise(0.1f);
+
+    data.humidityValid = false;
+    data.humidity = 0;
+
+    data.fusionPoseValid = false;
+    data.fusionQPoseValid = false;
+
+    //  RTIMUNull runs the fusion on whatever it's given
+
+    setIMUData(data);
+
+    m_nextSample += m_interval;
+    m_sampleCount++;
+    return true;
+}
+
+float SimulatedIMU::noise(float amplitude)
+{
+    //  a fixed sequence so that runs are repeatable
+
+    m_noiseSeed = m_noiseSeed * 1103515245 + 12345;
+
+    return amplitude * ((float)((m_noiseSeed >> 16) & 0x7fff) / 16384.0f - 1.0f);
+}
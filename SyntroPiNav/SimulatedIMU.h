@@ -0,0 +1,48 @@
+//
+//  Copyright (c) 2014 richards-tech.
+//
+//  This file is part of SyntroNet
+//
+//  SyntroNet is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  SyntroNet is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with SyntroNet.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _SIMULATEDIMU_H
+#define	_SIMULATEDIMU_H
+
+#include "RTIMULib.h"
+
+//  A stand in for a real IMU so that the sampling, fusion and streaming can be run without
+//  hardware. It turns slowly about z with a little noise on every sensor. IMURead() returns
+//  a sample each time one is due at the simulated rate so it drains like a sensor FIFO.
+
+class SimulatedIMU : public RTIMUNull
+{
+public:
+    SimulatedIMU(RTIMUSettings *settings, int rate);
+
+    virtual const char *IMUName() { return "Simulated IMU"; }
+    virtual bool IMUInit();
+    virtual int IMUGetPollInterval();
+    virtual bool IMURead();
+
+private:
+    float noise(float amplitude);
+
+    uint64_t m_interval;                                    // uS between samples
+    uint64_t m_nextSample;                                  // timestamp of the next sample
+    uint64_t m_sampleCount;
+    uint32_t m_noiseSeed;
+};
+
+#endif // _SIMULATEDIMU_H
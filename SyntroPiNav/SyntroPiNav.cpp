@@ -59,11 +59,11 @@ SyntroPiNav::SyntroPiNav()
     m_imuThread = new IMUThread();
     m_client = new NavClient(this);
 
-    connect(m_imuThread, SIGNAL(newIMUData(const RTIMU_DATA&)),
-            this, SLOT(newIMUData(const RTIMU_DATA&)), Qt::DirectConnection);
+    connect(m_imuThread, SIGNAL(newIMUBatch(const QList<RTIMU_DATA>&)),
+            this, SLOT(newIMUBatch(const QList<RTIMU_DATA>&)), Qt::DirectConnection);
 
-    connect(m_imuThread, SIGNAL(newIMUData(const RTIMU_DATA&)),
-            m_client, SLOT(newIMUData(const RTIMU_DATA&)), Qt::DirectConnection);
+    connect(m_imuThread, SIGNAL(newIMUBatch(const QList<RTIMU_DATA>&)),
+            m_client, SLOT(newIMUBatch(const QList<RTIMU_DATA>&)), Qt::DirectConnection);
 
     connect(this, SIGNAL(newIMU()), m_imuThread, SLOT(newIMU()));
 
@@ -161,10 +161,12 @@ void SyntroPiNav::onEnableDebug(int state)
 }
 
 
-void SyntroPiNav::newIMUData(const RTIMU_DATA& data)
+void SyntroPiNav::newIMUBatch(const QList<RTIMU_DATA>& batch)
 {
-    m_imuData = data;
-    m_sampleCount++;
+    //  only the latest sample is displayed
+
+    m_imuData = batch.last();
+    m_sampleCount += batch.count();
 }
 
 void SyntroPiNav::closeEvent(QCloseEvent *)
@@ -217,7 +219,7 @@ void SyntroPiNav::timerEvent(QTimerEvent *event)
 
         float rate = (float)m_sampleCount / (float(RATE_TIMER_INTERVAL));
         m_sampleCount = 0;
-        m_rateStatus->setText(QString("Sample rate: %1 per second").arg(rate));
+        m_rateStatus->setText(QString("Sample rate: %1 per second, %2 dropped").arg(rate).arg(m_client->getDropCount()));
 
         if (m_imuThread->getIMU() == NULL) {
             m_calStatus->setText("No IMU found");
@@ -53,7 +53,7 @@ public slots:
     void onEnableAccel(int);
     void onEnableCompass(int);
     void onEnableDebug(int);
-    void newIMUData(const RTIMU_DATA&);
+    void newIMUBatch(const QList<RTIMU_DATA>&);
 
 signals:
     void newIMU();
@@ -23,7 +23,11 @@ DEPENDPATH += $$PWD
 HEADERS += SyntroPiNav.h \
         SyntroPiNavConsole.h \
         NavClient.h \
+        NavCompact.h \
+        IMURing.h \
+        NavDecimator.h \
         IMUThread.h \
+        SimulatedIMU.h \
         CompassCalDlg.h \
         SelectIMUDlg.h
 
@@ -31,7 +35,11 @@ SOURCES += main.cpp \
         SyntroPiNav.cpp \
         SyntroPiNavConsole.cpp \
         NavClient.cpp \
+        NavCompact.cpp \
+        IMURing.cpp \
+        NavDecimator.cpp \
         IMUThread.cpp \
+        SimulatedIMU.cpp \
         CompassCalDlg.cpp \
 	SelectIMUDlg.cpp
 
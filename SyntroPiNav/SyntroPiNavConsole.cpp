@@ -58,8 +58,8 @@ SyntroPiNavConsole::SyntroPiNavConsole(bool daemonMode, QObject *parent)
 
     m_client = new NavClient(this);
 
-    connect(m_imuThread, SIGNAL(newIMUData(const RTIMU_DATA&)),
-            m_client, SLOT(newIMUData(const RTIMU_DATA&)), Qt::DirectConnection);
+    connect(m_imuThread, SIGNAL(newIMUBatch(const QList<RTIMU_DATA>&)),
+            m_client, SLOT(newIMUBatch(const QList<RTIMU_DATA>&)), Qt::DirectConnection);
 
 	m_client->resumeThread();
 
@@ -101,6 +101,7 @@ void SyntroPiNavConsole::showHelp()
 void SyntroPiNavConsole::showStatus()
 {    
 	printf("\nStatus: %s\n", qPrintable(m_client->getLinkState()));
+	printf("Samples dropped since last status: %d\n", m_client->getDropCount());
 
 }
 